@@ -0,0 +1,15 @@
+# Mesh NoC for tcu_fs.py (--noc-config) with 2x4 routers:
+#
+#   0 -- 1 -- 2 -- 3
+#   |    |    |    |
+#   4 -- 5 -- 6 -- 7
+#
+# router_list specifies the router for each tile (indexed by tile id). Tiles
+# that are not listed are distributed over the routers in order.
+
+class NoC_Params:
+    num_rows = 2
+    num_cols = 4
+    torus = False
+    # put the compute tiles in the center and the others at the edges
+    router_list = [1, 2, 5, 6, 0, 3, 4, 7]
@@ -28,6 +28,7 @@
 # either expressed or implied, of the FreeBSD Project.
 
 import optparse
+import runpy
 import sys
 import os
 
@@ -133,6 +134,23 @@ def getOptions():
                       metavar="T",
                       help="Stop after T ticks")
 
+    parser.add_option("--checkpoint-dir", default=m5.options.outdir,
+                      type="string",
+                      help="the directory for checkpoints requested by m5ops")
+    parser.add_option("--restore", default=None, type="string", metavar="DIR",
+                      help="restore the checkpoint in DIR")
+    parser.add_option("--noc-config", default=None, type="string",
+                      metavar="FILE",
+                      help="use a mesh NoC with the topology and tile "
+                           "placement in FILE (see noc_config/tcu_2x4.py)")
+    parser.add_option("--mem-file-mmap", action="store_true", default=False,
+                      help="map the images of memory tiles copy-on-write "
+                           "instead of copying them")
+    parser.add_option("--mem-backdoor", action="store_true", default=False,
+                      help="let the TCUs of tiles without caches access "
+                           "their memory directly (faster, but the timing "
+                           "is approximated without contention)")
+
     Options.addFSOptions(parser)
 
     (options, args) = parser.parse_args()
@@ -152,9 +170,9 @@ def getCacheStr(cache):
     )
 
 def printConfig(tile):
-    print('     TCU  =eps:%d, bufsz:%d B, blocksz:%d B, count:%d, tlb:%d' % \
+    print('     TCU  =eps:%d, bufsz:%d B, blocksz:%d B, count:%d, tlb:%d/%d' % \
         (tile.tcu.num_endpoints, tile.tcu.buf_size.value, tile.tcu.block_size.value,
-         tile.tcu.buf_count, tile.tcu.tlb_entries))
+         tile.tcu.buf_count, tile.tcu.tlb_entries, tile.tcu.l2_tlb_entries))
 
     try:
         print('     L1i$ =%s' % (getCacheStr(tile.l1icache)))
@@ -198,6 +216,26 @@ def connectCuToMem(tile, options, dport, iport=None, l1size=None):
         tile.tcu.icache_slave_port = interpose(tile, options, 'cu_imon', iport)
     tile.tcu.dcache_slave_port = interpose(tile, options, 'cu_dmon', dport)
 
+def connectToNoc(noc, no, requestor=None, responder=None):
+    # place the ports at the router of the tile (or the first one)
+    router = 0
+    if isinstance(noc, MeshXBar) and not no is None:
+        if no < len(noc._routers):
+            router = noc._routers[no]
+        else:
+            router = no % (int(noc.rows) * int(noc.cols))
+
+    if not requestor is None:
+        noc.cpu_side_ports = requestor
+        noc._cpu_routers.append(router)
+    if not responder is None:
+        noc.mem_side_ports = responder
+        noc._mem_routers.append(router)
+
+    if isinstance(noc, MeshXBar):
+        noc.cpu_side_routers = noc._cpu_routers
+        noc.mem_side_routers = noc._mem_routers
+
 def createTile(noc, options, no, systemType, l1size, l2size, spmsize,
                memTile, epCount):
     CPUClass = ObjectList.cpu_list.get(options.cpu_type)
@@ -221,8 +259,8 @@ def createTile(noc, options, no, systemType, l1size, l2size, spmsize,
     tile.tcu.num_endpoints = epCount
 
     # connection to noc
-    tile.tcu.noc_master_port = noc.cpu_side_ports
-    tile.tcu.noc_slave_port  = noc.mem_side_ports
+    connectToNoc(noc, no, requestor=tile.tcu.noc_master_port,
+                 responder=tile.tcu.noc_slave_port)
 
     tile.tcu.slave_region = [AddrRange(0, tile.tcu.mmio_region.start - 1)]
 
@@ -272,6 +310,9 @@ def createTile(noc, options, no, systemType, l1size, l2size, spmsize,
         tile.spm = Scratchpad(in_addr_map="true")
         tile.spm.cpu_port = tile.xbar.default
         tile.spm.range = spmsize
+        # there are no caches in between, so that the TCU can access the SPM
+        # directly, if desired
+        tile.tcu.mem_backdoor = options.mem_backdoor
 
     if options.isa == 'riscv':
         tile.tcu.tile_mem_offset = 0x10000000
@@ -325,7 +366,7 @@ def createCoreTile(noc, options, no, cmdline, memTile, epCount,
     tile.readfile = "/dev/stdin"
 
     # connection to the NoC for initialization
-    tile.noc_master_port = noc.cpu_side_ports
+    connectToNoc(noc, no, requestor=tile.noc_master_port)
 
     tile.cpu = CPUClass()
     tile.cpu.cpu_id = 0
@@ -363,7 +404,7 @@ def createCoreTile(noc, options, no, cmdline, memTile, epCount,
 
     # connect the IO space via bridge to the root NoC
     tile.bridge = Bridge(delay='50ns')
-    tile.bridge.mem_side_port = noc.cpu_side_ports
+    connectToNoc(noc, no, requestor=tile.bridge.mem_side_port)
     tile.bridge.cpu_side_port = tile.xbar.mem_side_ports
     tile.bridge.ranges = \
         [
@@ -429,7 +470,9 @@ def createKecAccTile(noc, options, no, cmdline, memTile, epCount, spmsize='8MB')
 
     # Make sure accelerator is accessed uncached and without speculation
     if options.isa == 'riscv':
-        tile.cpu.mmu.pma_checker.uncacheable.append(AddrRange(addr, size=0x1000))
+        # (covering the registers and the stream windows of all contexts)
+        size = 0x1000 + int(tile.kecacc.contexts) * int(tile.kecacc.window_size)
+        tile.cpu.mmu.pma_checker.uncacheable.append(AddrRange(addr, size=size))
 
     return tile
 
@@ -570,14 +613,10 @@ def createAccelTile(noc, options, no, accel, memTile, epCount,
 
     if accel == 'indir':
         tile.accel = TcuAccelInDir()
-    elif accel == 'copy' or accel == 'rot13':
-        algos = {
-            'copy'   : 0,
-            'rot13'  : 1,
-        }
+    elif accel in stream_algos:
         tile.accel = TcuAccelStream()
         tile.accel.logic = AccelLogic()
-        tile.accel.logic.algorithm = algos.get(accel)
+        tile.accel.logic.algorithm = accel
         tile.accel.logic.port = tile.xbar.cpu_side_ports
         tile.accel.buf_size = "4kB"
     else:
@@ -641,6 +680,7 @@ def createMemTile(noc, options, no, size, epCount,
         tile.mem_ctrl = Scratchpad(in_addr_map="true")
         tile.mem_ctrl.cpu_port = tile.xbar.mem_side_ports
         tile.mem_ctrl.range = size_bytes
+        tile.tcu.mem_backdoor = options.mem_backdoor
 
     if not image is None:
         if os.stat(image).st_size * imageNum > base_offset:
@@ -649,6 +689,7 @@ def createMemTile(noc, options, no, size, epCount,
             sys.exit(1)
         tile.mem_file = image
         tile.mem_file_num = imageNum
+        tile.mem_file_mmap = options.mem_file_mmap
 
     print('T%02d: %s x %d' % (no, image, imageNum))
     printConfig(tile, 0)
@@ -669,24 +710,33 @@ def createRoot(options):
     root.clk_domain = SrcClockDomain(clock=options.sys_clock,
                                      voltage_domain=root.voltage_domain)
 
-    # All tiles are connected to a NoC (Network on Chip). In this case it's just
-    # a simple XBar.
-    root.noc = IOXBar()
-    root.noc.frontend_latency = 4
-    root.noc.forward_latency = 2
-    root.noc.response_latency = 4
+    # All tiles are connected to a NoC (Network on Chip). By default, it's just
+    # a simple XBar. Alternatively, the tiles are placed on the routers of a
+    # mesh as specified in the given NoC config.
+    if options.noc_config:
+        params = runpy.run_path(options.noc_config)['NoC_Params']
+        root.noc = MeshXBar(rows=params.num_rows, cols=params.num_cols)
+        root.noc.torus = getattr(params, 'torus', False)
+        root.noc._routers = getattr(params, 'router_list', [])
+    else:
+        root.noc = IOXBar()
+        root.noc.frontend_latency = 4
+        root.noc.forward_latency = 2
+        root.noc.response_latency = 4
+    root.noc._cpu_routers = []
+    root.noc._mem_routers = []
 
     # create a dummy platform and system for the UART
     root.platform = IOPlatform()
     root.platform.system = System()
-    root.platform.system.system_port = root.noc.cpu_side_ports
+    connectToNoc(root.noc, None, requestor=root.platform.system.system_port)
     root.platform.intrctrl = IntrControl()
 
     # UART and terminal
     root.platform.com_1 = Uart8250()
     root.platform.com_1.pio_addr = IO_address_space_base + 0x3f8
     root.platform.com_1.device = Terminal()
-    root.platform.com_1.pio = root.noc.mem_side_ports
+    connectToNoc(root.noc, None, responder=root.platform.com_1.pio)
 
     return root
 
@@ -709,10 +759,9 @@ def runSimulation(root, options, tiles):
             if hasattr(tile, 'accel'):
                 if type(tile.accel).__name__ == 'TcuAccelInDir':
                     size |= 4 << 3 # indir accelerator
-                elif int(tile.accel.logic.algorithm) == 0:
-                    size |= 5 << 3 # copy accelerator
-                elif int(tile.accel.logic.algorithm) == 1:
-                    size |= 6 << 3 # rot13 accelerator
+                else:
+                    # stream accelerator
+                    size |= stream_algos[str(tile.accel.logic.algorithm)] << 3
             elif options.isa == 'arm':
                 size |= 2 << 3 # arm
             elif options.isa == 'riscv':
@@ -742,10 +791,17 @@ def runSimulation(root, options, tiles):
 
     sys.stdout.flush()
 
-    # Instantiate configuration
-    m5.instantiate()
+    # Instantiate configuration (the TCUs and memories might be restored)
+    m5.instantiate(options.restore)
+
+    # Simulate until program terminates and take checkpoints on request
+    while True:
+        exit_event = m5.simulate(options.maxtick - m5.curTick())
+        if exit_event.getCause() != "checkpoint":
+            break
 
-    # Simulate until program terminates
-    exit_event = m5.simulate(options.maxtick)
+        cpt_dir = os.path.join(options.checkpoint_dir, 'cpt.%d' % m5.curTick())
+        print('Writing checkpoint to', cpt_dir)
+        m5.checkpoint(cpt_dir)
 
     print('Exiting @ tick', m5.curTick(), 'because', exit_event.getCause())
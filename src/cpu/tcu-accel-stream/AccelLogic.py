@@ -31,9 +31,21 @@ from m5.objects.ClockedObject import ClockedObject
 from m5.params import *
 from m5.proxy import *
 
+# the algorithms of the stream accelerator and the tile type that M3 sees for
+# an accelerator tile with the algorithm
+stream_algos = {
+    'copy'    : 5,
+    'rot13'   : 6,
+    'crc32c'  : 10,
+    'aes-ctr' : 11,
+    'lz4'     : 12,
+    'base64'  : 13,
+}
+
 class AccelLogic(ClockedObject):
     type = 'AccelLogic'
     cxx_header = "cpu/tcu-accel-stream/logic.hh"
 
     port = MasterPort("Port to the TCU and Scratch-Pad-Memory")
-    algorithm = Param.Int(0, "The algorithm to use (0 = copy, 1 = rot13)")
+    algorithm = Param.String("copy", "The algorithm to use (see stream_algos)")
+    buffers = Param.Unsigned(2, "The number of chunk buffers, i.e., the depth of the pull/compute/push pipeline")
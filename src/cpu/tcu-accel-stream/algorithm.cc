@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#include "cpu/tcu-accel-stream/algorithm.hh"
+#include "cpu/tcu-accel-stream/algorithm_copy.hh"
+#include "cpu/tcu-accel-stream/algorithm_rot13.hh"
+
+#include <map>
+
+static std::map<std::string, TcuAccelStreamAlgo::Factory> &
+registry()
+{
+    // constructed on first use, because the registrations are static objects
+    static std::map<std::string, TcuAccelStreamAlgo::Factory> algos;
+    return algos;
+}
+
+TcuAccelStreamAlgo::Registration::Registration(const char *name,
+                                               Factory factory)
+{
+    bool added = registry().emplace(name, factory).second;
+    panic_if(!added, "Stream algorithm %s registered twice\n", name);
+}
+
+TcuAccelStreamAlgo *
+TcuAccelStreamAlgo::create(const std::string &name)
+{
+    auto algo = registry().find(name);
+    if (algo == registry().end())
+        return nullptr;
+    return algo->second();
+}
+
+// the header-only algorithms; the others register themselves
+REGISTER_STREAM_ALGO("copy", TcuAccelStreamAlgoCopy);
+REGISTER_STREAM_ALGO("rot13", TcuAccelStreamAlgoROT13);
@@ -1,6 +1,6 @@
 /*
  * Copyright (C) 2015-2018 Nils Asmussen <nils@os.inf.tu-dresden.de>
- * Copyright (C) 2019-2020 Nils Asmussen, Barkhausen Institut
+ * Copyright (C) 2019-2022 Nils Asmussen, Barkhausen Institut
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -33,15 +33,67 @@
 
 #include "sim/system.hh"
 
+#include <string>
+
+/**
+ * An algorithm of the stream accelerator. The logic feeds the algorithm with
+ * the chunks of a block in order and writes the output back to the start of
+ * the block, so that an algorithm can shrink the data (e.g., compress or
+ * decode it). Therefore, the output produced so far must never exceed the
+ * input consumed so far; the destination buffer is large enough for that.
+ */
 class TcuAccelStreamAlgo
 {
   public:
 
+    typedef TcuAccelStreamAlgo *(*Factory)();
+
+    /**
+     * Registers an algorithm under the given name. Use it via
+     * REGISTER_STREAM_ALGO.
+     */
+    struct Registration
+    {
+        Registration(const char *name, Factory factory);
+    };
+
+    /**
+     * Creates the algorithm with given name or returns nullptr if there is
+     * no such algorithm.
+     */
+    static TcuAccelStreamAlgo *create(const std::string &name);
+
+    virtual ~TcuAccelStreamAlgo() {}
+
     virtual const char *name() const = 0;
 
+    /**
+     * Called before the first chunk of a block.
+     */
+    virtual void start() {}
+
+    /**
+     * Processes the next <len> bytes at <src> and stores the output at <dst>.
+     *
+     * @return the number of output bytes
+     */
     virtual size_t execute(uint8_t *dst, const uint8_t *src, size_t len) = 0;
 
+    /**
+     * Called after the last chunk of a block to write the remaining output
+     * (at most <room> bytes) to <dst>.
+     *
+     * @return the number of output bytes
+     */
+    virtual size_t finish(uint8_t *, size_t) { return 0; }
+
     virtual Cycles getDelay(Cycles time, size_t len) = 0;
 };
 
+#define REGISTER_STREAM_ALGO(NAME, CLASS)                               \
+    static TcuAccelStreamAlgo::Registration                             \
+        CLASS##Registration(NAME, []() -> TcuAccelStreamAlgo * {        \
+            return new CLASS();                                         \
+        })
+
 #endif // __CPU_TCU_ACCEL_STREAM_ALGORITHM_HH__
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#include "cpu/tcu-accel-stream/algorithm_aes.hh"
+
+#if defined(__x86_64__)
+#   include <wmmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+REGISTER_STREAM_ALGO("aes-ctr", TcuAccelStreamAlgoAESCTR);
+
+typedef TcuAccelStreamAlgoAESCTR AES;
+
+static uint8_t sbox[256];
+
+static uint8_t
+xtime(uint8_t x)
+{
+    return (x << 1) ^ ((x & 0x80) ? 0x1B : 0);
+}
+
+static uint8_t
+rotl8(uint8_t x, int shift)
+{
+    return (x << shift) | (x >> (8 - shift));
+}
+
+static void
+initSbox()
+{
+    // walk through GF(2^8) with the generator 3 and its inverse
+    uint8_t p = 1, q = 1;
+    do
+    {
+        // p * 3
+        p = p ^ xtime(p);
+        // q / 3
+        q ^= q << 1;
+        q ^= q << 2;
+        q ^= q << 4;
+        if (q & 0x80)
+            q ^= 0x09;
+
+        // affine transformation of the inverse q of p
+        sbox[p] = q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^
+                  rotl8(q, 4) ^ 0x63;
+    }
+    while (p != 1);
+    // 0 has no inverse
+    sbox[0] = 0x63;
+}
+
+static void
+encryptSw(uint8_t *out, const uint8_t *in, const uint8_t *rk)
+{
+    uint8_t s[AES::AES_BLOCK];
+    for (size_t i = 0; i < AES::AES_BLOCK; ++i)
+        s[i] = in[i] ^ rk[i];
+
+    for (size_t r = 1; r <= AES::ROUNDS; ++r)
+    {
+        // SubBytes and ShiftRows; the state is stored column by column
+        uint8_t t[AES::AES_BLOCK];
+        for (size_t c = 0; c < 4; ++c)
+        {
+            for (size_t row = 0; row < 4; ++row)
+                t[c * 4 + row] = sbox[s[((c + row) % 4) * 4 + row]];
+        }
+
+        // MixColumns, except in the last round
+        if (r < AES::ROUNDS)
+        {
+            for (size_t c = 0; c < 4; ++c)
+            {
+                uint8_t *col = t + c * 4;
+                uint8_t all = col[0] ^ col[1] ^ col[2] ^ col[3];
+                uint8_t first = col[0];
+                col[0] ^= all ^ xtime(col[0] ^ col[1]);
+                col[1] ^= all ^ xtime(col[1] ^ col[2]);
+                col[2] ^= all ^ xtime(col[2] ^ col[3]);
+                col[3] ^= all ^ xtime(col[3] ^ first);
+            }
+        }
+
+        for (size_t i = 0; i < AES::AES_BLOCK; ++i)
+            s[i] = t[i] ^ rk[r * AES::AES_BLOCK + i];
+    }
+
+    memcpy(out, s, AES::AES_BLOCK);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("aes,sse2")))
+static void
+encryptHw(uint8_t *out, const uint8_t *in, const uint8_t *rk, size_t blocks)
+{
+    __m128i keys[AES::ROUNDS + 1];
+    for (size_t r = 0; r <= AES::ROUNDS; ++r)
+    {
+        keys[r] = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(rk + r * AES::AES_BLOCK));
+    }
+
+    // the blocks are independent, so that the AES units can overlap them
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        __m128i s = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(in + b * AES::AES_BLOCK));
+        s = _mm_xor_si128(s, keys[0]);
+        for (size_t r = 1; r < AES::ROUNDS; ++r)
+            s = _mm_aesenc_si128(s, keys[r]);
+        s = _mm_aesenclast_si128(s, keys[AES::ROUNDS]);
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i*>(out + b * AES::AES_BLOCK), s);
+    }
+}
+#endif
+
+static bool useHw = false;
+
+TcuAccelStreamAlgoAESCTR::TcuAccelStreamAlgoAESCTR()
+    : roundKeys(), nonce(0x4d335f5443555f41), counter(), keystream(),
+      ksPos(sizeof(keystream))
+{
+    if (sbox[0] == 0)
+    {
+        initSbox();
+#if defined(__x86_64__)
+        useHw = __builtin_cpu_supports("aes");
+#endif
+    }
+
+    static const uint8_t key[AES_BLOCK] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+
+    // key expansion of AES-128
+    memcpy(roundKeys, key, AES_BLOCK);
+    uint8_t rcon = 1;
+    for (size_t i = AES_BLOCK; i < sizeof(roundKeys); i += 4)
+    {
+        uint8_t t[4];
+        memcpy(t, roundKeys + i - 4, 4);
+        if (i % AES_BLOCK == 0)
+        {
+            uint8_t first = t[0];
+            t[0] = sbox[t[1]] ^ rcon;
+            t[1] = sbox[t[2]];
+            t[2] = sbox[t[3]];
+            t[3] = sbox[first];
+            rcon = xtime(rcon);
+        }
+        for (size_t j = 0; j < 4; ++j)
+            roundKeys[i + j] = roundKeys[i - AES_BLOCK + j] ^ t[j];
+    }
+}
+
+void
+TcuAccelStreamAlgoAESCTR::genKeystream()
+{
+    // the counter blocks consist of the nonce and the big-endian counter
+    uint8_t ctrs[sizeof(keystream)];
+    for (size_t off = 0; off < sizeof(ctrs); off += AES_BLOCK)
+    {
+        for (size_t i = 0; i < 8; ++i)
+        {
+            ctrs[off + i] = nonce >> (56 - i * 8);
+            ctrs[off + 8 + i] = counter >> (56 - i * 8);
+        }
+        counter++;
+    }
+
+#if defined(__x86_64__)
+    if (useHw)
+    {
+        encryptHw(keystream, ctrs, roundKeys, sizeof(ctrs) / AES_BLOCK);
+        ksPos = 0;
+        return;
+    }
+#endif
+
+    for (size_t off = 0; off < sizeof(ctrs); off += AES_BLOCK)
+        encryptSw(keystream + off, ctrs + off, roundKeys);
+    ksPos = 0;
+}
+
+size_t
+TcuAccelStreamAlgoAESCTR::execute(uint8_t *dst, const uint8_t *src,
+                                  size_t len)
+{
+    for (size_t done = 0; done < len; )
+    {
+        if (ksPos == sizeof(keystream))
+            genKeystream();
+
+        size_t amount = std::min(len - done, sizeof(keystream) - ksPos);
+        for (size_t i = 0; i < amount; ++i)
+            dst[done + i] = src[done + i] ^ keystream[ksPos + i];
+        done += amount;
+        ksPos += amount;
+    }
+    return len;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#ifndef __CPU_TCU_ACCEL_STREAM_ALGORITHM_AES_HH__
+#define __CPU_TCU_ACCEL_STREAM_ALGORITHM_AES_HH__
+
+#include "cpu/tcu-accel-stream/algorithm.hh"
+
+/**
+ * Encrypts (or decrypts) the stream with AES-128 in counter mode. The
+ * accelerator has no interface to set the key and nonce, so that we use
+ * fixed ones. The counter continues across blocks to never reuse the
+ * keystream. Uses AES-NI if the host supports it.
+ */
+class TcuAccelStreamAlgoAESCTR : public TcuAccelStreamAlgo
+{
+  public:
+
+    static const size_t AES_BLOCK   = 16;
+    static const size_t ROUNDS      = 10;
+
+    TcuAccelStreamAlgoAESCTR();
+
+    const char *name() const override { return "AES-CTR"; }
+
+    size_t execute(uint8_t *dst, const uint8_t *src, size_t len) override;
+
+    Cycles getDelay(Cycles, size_t len) override
+    {
+        // a fully pipelined core: one AES block per cycle plus the latency
+        // of the rounds
+        return Cycles((len + AES_BLOCK - 1) / AES_BLOCK + ROUNDS);
+    }
+
+  private:
+
+    void genKeystream();
+
+    // the expanded key
+    uint8_t roundKeys[(ROUNDS + 1) * AES_BLOCK];
+    uint64_t nonce;
+    uint64_t counter;
+    // the keystream generated in advance and the bytes used of it
+    uint8_t keystream[16 * AES_BLOCK];
+    size_t ksPos;
+};
+
+#endif // __CPU_TCU_ACCEL_STREAM_ALGORITHM_AES_HH__
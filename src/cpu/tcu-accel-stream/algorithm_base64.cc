@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#include "cpu/tcu-accel-stream/algorithm_base64.hh"
+
+#include <algorithm>
+#include <iterator>
+
+REGISTER_STREAM_ALGO("base64", TcuAccelStreamAlgoBase64);
+
+static const uint8_t INVALID    = 0xFF;
+static const uint8_t PADDING    = 0xFE;
+
+static uint8_t decTable[256];
+
+TcuAccelStreamAlgoBase64::TcuAccelStreamAlgoBase64()
+    : bits(), count()
+{
+    if (decTable['='] == PADDING)
+        return;
+
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::fill(std::begin(decTable), std::end(decTable), INVALID);
+    for (size_t i = 0; i < 64; ++i)
+        decTable[static_cast<uint8_t>(alphabet[i])] = i;
+    decTable['='] = PADDING;
+}
+
+size_t
+TcuAccelStreamAlgoBase64::flush(uint8_t *dst)
+{
+    // a single sextet does not form a byte
+    size_t bytes = count > 1 ? count - 1 : 0;
+    bits <<= 6 * (4 - count);
+    for (size_t i = 0; i < bytes; ++i)
+        dst[i] = bits >> (16 - i * 8);
+    bits = 0;
+    count = 0;
+    return bytes;
+}
+
+size_t
+TcuAccelStreamAlgoBase64::execute(uint8_t *dst, const uint8_t *src,
+                                  size_t len)
+{
+    uint8_t *op = dst;
+    size_t i = 0;
+    while (i < len)
+    {
+        // fast path for complete quanta
+        if (count == 0 && len - i >= 4)
+        {
+            uint32_t a = decTable[src[i + 0]];
+            uint32_t b = decTable[src[i + 1]];
+            uint32_t c = decTable[src[i + 2]];
+            uint32_t d = decTable[src[i + 3]];
+            // the special values have the upper bits set
+            if (((a | b | c | d) & 0xC0) == 0)
+            {
+                uint32_t val = (a << 18) | (b << 12) | (c << 6) | d;
+                op[0] = val >> 16;
+                op[1] = val >> 8;
+                op[2] = val;
+                op += 3;
+                i += 4;
+                continue;
+            }
+        }
+
+        uint8_t val = decTable[src[i++]];
+        if (val == PADDING)
+            op += flush(op);
+        else if (val != INVALID)
+        {
+            bits = (bits << 6) | val;
+            if (++count == 4)
+                op += flush(op);
+        }
+    }
+    return op - dst;
+}
+
+size_t
+TcuAccelStreamAlgoBase64::finish(uint8_t *dst, size_t)
+{
+    // the last quantum without padding
+    return flush(dst);
+}
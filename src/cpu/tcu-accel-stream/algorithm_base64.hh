@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#ifndef __CPU_TCU_ACCEL_STREAM_ALGORITHM_BASE64_HH__
+#define __CPU_TCU_ACCEL_STREAM_ALGORITHM_BASE64_HH__
+
+#include "cpu/tcu-accel-stream/algorithm.hh"
+
+/**
+ * Decodes base64 (RFC 4648) with or without padding. Characters outside of
+ * the alphabet (e.g., line breaks) are skipped. Decoding is used instead of
+ * encoding, because the output of the accelerator cannot be larger than its
+ * input.
+ */
+class TcuAccelStreamAlgoBase64 : public TcuAccelStreamAlgo
+{
+  public:
+
+    TcuAccelStreamAlgoBase64();
+
+    const char *name() const override { return "BASE64"; }
+
+    void start() override
+    {
+        bits = 0;
+        count = 0;
+    }
+
+    size_t execute(uint8_t *dst, const uint8_t *src, size_t len) override;
+
+    size_t finish(uint8_t *dst, size_t room) override;
+
+    Cycles getDelay(Cycles, size_t len) override
+    {
+        // four characters (one quantum) per cycle
+        const size_t BLOCK_SIZE      = 4;
+        return Cycles((len + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    }
+
+  private:
+
+    size_t flush(uint8_t *dst);
+
+    // the sextets of the current quantum and their number
+    uint32_t bits;
+    unsigned count;
+};
+
+#endif // __CPU_TCU_ACCEL_STREAM_ALGORITHM_BASE64_HH__
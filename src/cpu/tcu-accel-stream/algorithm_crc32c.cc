@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#include "cpu/tcu-accel-stream/algorithm_crc32c.hh"
+
+#if defined(__x86_64__)
+#   include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#   include <arm_acle.h>
+#endif
+
+#include "sim/byteswap.hh"
+
+#include <cstring>
+
+REGISTER_STREAM_ALGO("crc32c", TcuAccelStreamAlgoCRC32C);
+
+// the reflected Castagnoli polynomial
+static const uint32_t CRC32C_POLY = 0x82F63B78;
+
+static uint32_t crcTable[256];
+
+static uint32_t
+updateTable(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+        crc = crcTable[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t
+updateHw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    uint64_t crc64 = crc;
+    for (; len >= 8; len -= 8, buf += 8)
+    {
+        uint64_t word;
+        memcpy(&word, buf, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = crc64;
+    for (; len > 0; --len)
+        crc = _mm_crc32_u8(crc, *buf++);
+    return crc;
+}
+#elif defined(__ARM_FEATURE_CRC32)
+static uint32_t
+updateHw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    for (; len >= 8; len -= 8, buf += 8)
+    {
+        uint64_t word;
+        memcpy(&word, buf, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; len > 0; --len)
+        crc = __crc32cb(crc, *buf++);
+    return crc;
+}
+#endif
+
+static uint32_t (*updateFunc)(uint32_t, const uint8_t *, size_t);
+
+TcuAccelStreamAlgoCRC32C::TcuAccelStreamAlgoCRC32C()
+    : crc(~0U)
+{
+    if (updateFunc)
+        return;
+
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        updateFunc = updateHw;
+        return;
+    }
+#elif defined(__ARM_FEATURE_CRC32)
+    updateFunc = updateHw;
+    return;
+#endif
+
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        uint32_t val = i;
+        for (int j = 0; j < 8; ++j)
+            val = (val >> 1) ^ ((val & 1) ? CRC32C_POLY : 0);
+        crcTable[i] = val;
+    }
+    updateFunc = updateTable;
+}
+
+uint32_t
+TcuAccelStreamAlgoCRC32C::update(uint32_t crc, const uint8_t *buf,
+                                 size_t len)
+{
+    return updateFunc(crc, buf, len);
+}
+
+size_t
+TcuAccelStreamAlgoCRC32C::execute(uint8_t *, const uint8_t *src, size_t len)
+{
+    crc = update(crc, src, len);
+    return 0;
+}
+
+size_t
+TcuAccelStreamAlgoCRC32C::finish(uint8_t *dst, size_t room)
+{
+    if (room < sizeof(crc))
+    {
+        warn_once("CRC32C: block of %lu bytes too small for the checksum\n",
+                  room);
+        return 0;
+    }
+
+    uint32_t res = htole(~crc);
+    memcpy(dst, &res, sizeof(res));
+    return sizeof(res);
+}
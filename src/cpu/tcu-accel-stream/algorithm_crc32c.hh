@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#ifndef __CPU_TCU_ACCEL_STREAM_ALGORITHM_CRC32C_HH__
+#define __CPU_TCU_ACCEL_STREAM_ALGORITHM_CRC32C_HH__
+
+#include "cpu/tcu-accel-stream/algorithm.hh"
+
+/**
+ * Computes the CRC32C (Castagnoli) of each block and outputs it as a 32-bit
+ * little-endian value. Uses the CRC32 instruction of the host if available.
+ */
+class TcuAccelStreamAlgoCRC32C : public TcuAccelStreamAlgo
+{
+  public:
+
+    TcuAccelStreamAlgoCRC32C();
+
+    const char *name() const override { return "CRC32C"; }
+
+    void start() override { crc = ~0U; }
+
+    size_t execute(uint8_t *dst, const uint8_t *src, size_t len) override;
+
+    size_t finish(uint8_t *dst, size_t room) override;
+
+    Cycles getDelay(Cycles, size_t len) override
+    {
+        // one 64-bit word per cycle
+        const size_t BLOCK_SIZE      = 8;
+        return Cycles((len + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    }
+
+    static uint32_t update(uint32_t crc, const uint8_t *buf, size_t len);
+
+  private:
+
+    uint32_t crc;
+};
+
+#endif // __CPU_TCU_ACCEL_STREAM_ALGORITHM_CRC32C_HH__
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#include "cpu/tcu-accel-stream/algorithm_lz4.hh"
+
+#include <algorithm>
+#include <cstring>
+
+REGISTER_STREAM_ALGO("lz4", TcuAccelStreamAlgoLZ4);
+
+// the constraints of the LZ4 block format
+static const size_t MIN_MATCH       = 4;
+static const size_t LAST_LITERALS   = 5;
+static const size_t MF_LIMIT        = 12;
+static const size_t MAX_OFFSET      = 65535;
+
+static uint32_t
+read32(const uint8_t *p)
+{
+    uint32_t val;
+    memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+static uint64_t
+read64(const uint8_t *p)
+{
+    uint64_t val;
+    memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+static uint8_t *
+writeLength(uint8_t *op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+static uint8_t *
+writeLiterals(uint8_t *op, uint8_t *token, const uint8_t *lits, size_t len)
+{
+    *token = std::min(len, static_cast<size_t>(15)) << 4;
+    if (len >= 15)
+        op = writeLength(op, len - 15);
+    memcpy(op, lits, len);
+    return op + len;
+}
+
+size_t
+TcuAccelStreamAlgoLZ4::execute(uint8_t *, const uint8_t *src, size_t len)
+{
+    // we compress the block as a whole at the end
+    input.insert(input.end(), src, src + len);
+    return 0;
+}
+
+size_t
+TcuAccelStreamAlgoLZ4::compress(uint8_t *dst)
+{
+    const uint8_t *src = input.data();
+    const size_t len = input.size();
+    uint8_t *op = dst;
+    size_t anchor = 0;
+
+    std::fill(std::begin(table), std::end(table), 0);
+
+    // the last match has to start MF_LIMIT bytes before the end
+    for (size_t ip = 0; ip + MF_LIMIT <= len; )
+    {
+        uint32_t seq = read32(src + ip);
+        uint32_t hash = (seq * 2654435761U) >> (32 - HASH_BITS);
+        size_t ref = table[hash];
+        table[hash] = ip + 1;
+
+        if (ref == 0 || ip - (ref - 1) > MAX_OFFSET ||
+            read32(src + ref - 1) != seq)
+        {
+            ip++;
+            continue;
+        }
+        ref--;
+
+        // extend the match word by word and finish it byte by byte; the
+        // last bytes have to be literals
+        size_t limit = len - LAST_LITERALS;
+        size_t mlen = MIN_MATCH;
+        while (ip + mlen + 8 <= limit &&
+               read64(src + ip + mlen) == read64(src + ref + mlen))
+            mlen += 8;
+        while (ip + mlen < limit && src[ip + mlen] == src[ref + mlen])
+            mlen++;
+
+        uint8_t *token = op++;
+        op = writeLiterals(op, token, src + anchor, ip - anchor);
+
+        size_t offset = ip - ref;
+        *op++ = offset & 0xFF;
+        *op++ = offset >> 8;
+
+        size_t mcode = mlen - MIN_MATCH;
+        *token |= std::min(mcode, static_cast<size_t>(15));
+        if (mcode >= 15)
+            op = writeLength(op, mcode - 15);
+
+        ip += mlen;
+        anchor = ip;
+    }
+
+    uint8_t *token = op++;
+    op = writeLiterals(op, token, src + anchor, len - anchor);
+    return op - dst;
+}
+
+size_t
+TcuAccelStreamAlgoLZ4::finish(uint8_t *dst, size_t room)
+{
+    assert(room >= input.size());
+
+    // compress into a buffer of the worst-case size
+    std::vector<uint8_t> out(input.size() + input.size() / 255 + 16);
+    size_t size = compress(out.data());
+
+    if (size < input.size())
+        memcpy(dst, out.data(), size);
+    else
+    {
+        size = input.size();
+        memcpy(dst, input.data(), size);
+    }
+    return size;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#ifndef __CPU_TCU_ACCEL_STREAM_ALGORITHM_LZ4_HH__
+#define __CPU_TCU_ACCEL_STREAM_ALGORITHM_LZ4_HH__
+
+#include "cpu/tcu-accel-stream/algorithm.hh"
+
+#include <vector>
+
+/**
+ * Compresses each block into the LZ4 block format, using a greedy parser
+ * with a single hash table like LZ4's fast mode. If the compressed block
+ * would not be smaller, the block is passed through unchanged, so that the
+ * output size equals the input size in this case.
+ */
+class TcuAccelStreamAlgoLZ4 : public TcuAccelStreamAlgo
+{
+  public:
+
+    static const size_t HASH_BITS   = 12;
+
+    const char *name() const override { return "LZ4"; }
+
+    void start() override { input.clear(); }
+
+    size_t execute(uint8_t *dst, const uint8_t *src, size_t len) override;
+
+    size_t finish(uint8_t *dst, size_t room) override;
+
+    Cycles getDelay(Cycles, size_t len) override
+    {
+        // the match finder consumes two bytes per cycle
+        const size_t BLOCK_SIZE      = 2;
+        return Cycles((len + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    }
+
+  private:
+
+    size_t compress(uint8_t *dst);
+
+    // the input of the current block
+    std::vector<uint8_t> input;
+    // the positions of the last occurrences (+1) of the hashed sequences
+    uint32_t table[1 << HASH_BITS];
+};
+
+#endif // __CPU_TCU_ACCEL_STREAM_ALGORITHM_LZ4_HH__
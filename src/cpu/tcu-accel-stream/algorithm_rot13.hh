@@ -41,14 +41,13 @@ class TcuAccelStreamAlgoROT13 : public TcuAccelStreamAlgo
 
     size_t execute(uint8_t *dst, const uint8_t *src, size_t len) override
     {
+        // branch-free, so that the compiler can vectorize the loop
         for (size_t i = 0; i < len; ++i)
         {
-            if (src[i] >= 'a' && src[i] <= 'z')
-                dst[i] = 'a' + ((src[i] - 'a') + 13) % 26;
-            else if (src[i] >= 'A' && src[i] <= 'Z')
-                dst[i] = 'A' + ((src[i] - 'A') + 13) % 26;
-            else
-                dst[i] = src[i];
+            uint8_t lower = src[i] | 0x20;
+            int8_t rot = (lower >= 'a' && lower <= 'm') ? 13
+                       : (lower >= 'n' && lower <= 'z') ? -13 : 0;
+            dst[i] = src[i] + rot;
         }
         return len;
     }
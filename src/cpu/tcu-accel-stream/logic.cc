@@ -31,144 +31,224 @@
 #include "debug/TcuAccelStream.hh"
 #include "debug/TcuAccelStreamState.hh"
 #include "cpu/tcu-accel-stream/accelerator.hh"
-#include "cpu/tcu-accel-stream/algorithm_copy.hh"
-#include "cpu/tcu-accel-stream/algorithm_rot13.hh"
 #include "cpu/tcu-accel-stream/logic.hh"
 
+#include <algorithm>
+
 AccelLogic::AccelLogic(const AccelLogicParams &p)
-    : ClockedObject(p), tickEvent(this), port("port", this),
-      accel(), algo(), state(), stateChanged(),
-      compTime(), opStart(), dataSize(), offset(), pos(), pullSize(), pullData()
+    : ClockedObject(p), tickEvent(this), computeEvent(this),
+      port("port", this), sendQueue(), accel(), algo(), state(),
+      stateChanged(), compTime(),
+      dataSize(), outSize(), offset(), pullPos(), computePos(),
+      bufs(p.buffers), stageCount(), computing()
 {
-    if (p.algorithm == 0)
-        algo = new TcuAccelStreamAlgoCopy();
-    else if(p.algorithm == 1)
-        algo = new TcuAccelStreamAlgoROT13();
-    else
-        panic("Unknown algorithm %d\n", p.algorithm);
+    algo = TcuAccelStreamAlgo::create(p.algorithm);
+    fatal_if(!algo, "Unknown algorithm %s\n", p.algorithm);
+
+    fatal_if(p.buffers == 0, "AccelLogic needs at least one buffer\n");
+}
+
+void
+AccelLogic::regStats()
+{
+    ClockedObject::regStats();
+
+    static const char *stageNames[] = {
+        "free", "pull", "pulled", "compute", "push"
+    };
+    static_assert(sizeof(stageNames) / sizeof(stageNames[0]) == STAGE_COUNT,
+                  "stageNames out of sync");
+
+    chunks
+        .name(name() + ".chunks")
+        .desc("Number of processed chunks");
+    occupancy
+        .init(STAGE_COUNT)
+        .name(name() + ".occupancy")
+        .desc("Average number of buffers per pipeline stage");
+    for (size_t i = 0; i < STAGE_COUNT; ++i)
+        occupancy.subname(i, stageNames[i]);
 }
 
 std::string
 AccelLogic::stateName() const
 {
-    const char *names[] = {"PULL", "PUSH", "DONE"};
+    const char *names[] = {"RUN", "DONE"};
     return names[static_cast<size_t>(state)];
 }
 
 void
 AccelLogic::start(Addr _offset, Addr _dataSize, Cycles _compTime)
 {
+    assert(sendQueue.empty() && !computing);
+
     dataSize = _dataSize;
     compTime = _compTime;
-    state = dataSize == 0 ? LOGIC_DONE : LOGIC_PULL;
+    state = dataSize == 0 ? LOGIC_DONE : LOGIC_RUN;
     offset = _offset;
-    pos = 0;
+    pullPos = 0;
+    computePos = 0;
     outSize = 0;
-    opStart = curCycle();
+    algo->start();
+
+    for (auto &buf : bufs)
+        buf.stage = STAGE_FREE;
+    std::fill(std::begin(stageCount), std::end(stageCount), 0);
+    stageCount[STAGE_FREE] = bufs.size();
+    for (size_t i = 0; i < STAGE_COUNT; ++i)
+        occupancy[i] = stageCount[i];
+
     schedule(tickEvent, clockEdge(Cycles(1)));
 }
 
 void
-AccelLogic::tick()
+AccelLogic::kick()
 {
-    PacketPtr pkt = nullptr;
+    if (!tickEvent.scheduled())
+        schedule(tickEvent, clockEdge(Cycles(1)));
+}
+
+void
+AccelLogic::setStage(Buffer &buf, Stage stage)
+{
+    DPRINTF(TcuAccelStreamState, "buf%lu: %luB @ %#lx: stage %d -> %d\n",
+        &buf - &bufs[0], buf.size, buf.pos, buf.stage, stage);
+
+    stageCount[buf.stage]--;
+    occupancy[buf.stage] = stageCount[buf.stage];
+    buf.stage = stage;
+    stageCount[buf.stage]++;
+    occupancy[buf.stage] = stageCount[buf.stage];
+}
 
+void
+AccelLogic::tick()
+{
     DPRINTF(TcuAccelStreamState, "[%s] tick\n",
         stateName().c_str());
 
-    switch(state)
+    auto lastState = state;
+
+    if (state == State::LOGIC_RUN)
     {
-        case State::LOGIC_PULL:
+        for (auto &buf : bufs)
         {
-            size_t rem = dataSize - pos;
-            pullSize = std::min(accel->chunkSize, rem);
-            pkt = accel->tcuif().createPacket(
-                accel->bufferAddr() + offset + pos,
-                pullSize,
-                MemCmd::ReadReq
-            );
-            break;
-        }
-        case State::LOGIC_PUSH:
-        {
-            pkt = accel->tcuif().createPacket(
-                accel->bufferAddr() + offset + pos,
-                pullData,
-                pullSize,
-                MemCmd::WriteReq
-            );
-            break;
+            // pull the next chunk into each free buffer
+            if (buf.stage == STAGE_FREE && pullPos < dataSize)
+            {
+                buf.pos = pullPos;
+                buf.size = std::min(accel->chunkSize, dataSize - pullPos);
+                pullPos += buf.size;
+                setStage(buf, STAGE_PULL);
+
+                sendPkt(accel->tcuif().createPacket(
+                    accel->bufferAddr() + offset + buf.pos,
+                    buf.size,
+                    MemCmd::ReadReq
+                ));
+            }
+
+            // the algorithm processes the chunks in order
+            if (buf.stage == STAGE_PULLED && !computing &&
+                buf.pos == computePos)
+            {
+                computing = &buf;
+                setStage(buf, STAGE_COMPUTE);
+
+                Cycles delay = algo->getDelay(compTime, buf.size);
+                schedule(computeEvent,
+                         clockEdge(std::max(delay, Cycles(1))));
+            }
         }
-        case State::LOGIC_DONE:
+
+        if (computePos == dataSize &&
+            stageCount[STAGE_FREE] == bufs.size())
         {
-            accel->logicFinished();
-            break;
+            DPRINTF(TcuAccelStream, "%s for %luB -> %luB done\n",
+                algo->name(), dataSize, outSize);
+            state = State::LOGIC_DONE;
         }
     }
 
-    if (pkt)
-        sendPkt(pkt);
+    stateChanged = state != lastState;
+
+    if (state == State::LOGIC_DONE)
+        accel->logicFinished();
 }
 
 void
-AccelLogic::handleMemResp(PacketPtr pkt)
+AccelLogic::computeDone()
 {
-    Cycles delay(1);
+    Buffer &buf = *computing;
+    computing = nullptr;
 
-    DPRINTF(TcuAccelStreamState, "[%s] Got response from memory\n",
-        stateName().c_str());
+    // the output is written back behind the previous output, which can be
+    // at most as large as the input consumed so far
+    size_t room = computePos + buf.size - outSize;
+    // the packet takes care of deleting the data
+    uint8_t *data = new uint8_t[room];
+    size_t produced = algo->execute(data, buf.input->getConstPtr<uint8_t>(),
+                                    buf.size);
+    accel->tcuif().freePacket(buf.input);
+    buf.input = nullptr;
 
-    auto lastState = state;
+    computePos += buf.size;
+    if (computePos == dataSize)
+        produced += algo->finish(data + produced, room - produced);
+    panic_if(produced > room, "%s produced %luB, but only %luB fit\n",
+             algo->name(), produced, room);
 
-    switch(state)
+    buf.outPos = outSize;
+    buf.outSize = produced;
+    outSize += produced;
+    chunks++;
+
+    if (produced == 0)
     {
-        case State::LOGIC_PULL:
-        {
-            // load data to be able to change it and write it back
-            pullData = new uint8_t[pullSize];
+        delete[] data;
+        setStage(buf, STAGE_FREE);
+    }
+    else
+    {
+        setStage(buf, STAGE_PUSH);
 
-            // execute the algorithm
-            outSize += algo->execute(
-                pullData, pkt->getConstPtr<uint8_t>(), pullSize
-            );
+        sendPkt(accel->tcuif().createPacket(
+            accel->bufferAddr() + offset + buf.outPos,
+            data,
+            buf.outSize,
+            MemCmd::WriteReq
+        ));
+    }
 
-            state = State::LOGIC_PUSH;
-            break;
-        }
-        case State::LOGIC_PUSH:
-        {
-            pos += pullSize;
+    // continue with the next chunk
+    kick();
+}
 
-            if (pos == dataSize)
-            {
-                // decrease it by the time we've already spent reading the
-                // data from SPM, because that's already included in the
-                // BLOCK_TIME.
-                // TODO if we use caches, this is not correct
-                delay = algo->getDelay(compTime, dataSize);
-                DPRINTF(TcuAccelStream, "%s for %luB took %llu cycles\n",
-                    algo->name(), dataSize, delay);
-
-                if (delay > (curCycle() - opStart))
-                    delay = delay - (curCycle() - opStart);
-                else
-                    delay = Cycles(1);
-                state = State::LOGIC_DONE;
-            }
-            else
-                state = State::LOGIC_PULL;
-            break;
-        }
-        case State::LOGIC_DONE:
-        {
-            assert(false);
-            break;
-        }
-    }
+void
+AccelLogic::handleMemResp(PacketPtr pkt)
+{
+    Addr pos = pkt->getAddr() - (accel->bufferAddr() + offset);
+    auto buf = std::find_if(bufs.begin(), bufs.end(), [pos](Buffer &b) {
+        return (b.stage == STAGE_PULL && b.pos == pos) ||
+               (b.stage == STAGE_PUSH && b.outPos == pos);
+    });
+    assert(buf != bufs.end());
 
-    stateChanged = state != lastState;
+    DPRINTF(TcuAccelStreamState, "[%s] Got response from memory\n",
+        stateName().c_str());
+
+    if (buf->stage == STAGE_PULL)
+    {
+        buf->input = pkt;
+        setStage(*buf, STAGE_PULLED);
+    }
+    else
+    {
+        accel->tcuif().freePacket(pkt);
+        setStage(*buf, STAGE_FREE);
+    }
 
-    schedule(tickEvent, clockEdge(delay));
+    kick();
 }
 
 bool
@@ -181,7 +261,7 @@ AccelLogic::CpuPort::recvTimingResp(PacketPtr pkt)
 void
 AccelLogic::CpuPort::recvReqRetry()
 {
-    logic.recvRetry();
+    logic.sendPending();
 }
 
 Port &
@@ -193,22 +273,18 @@ AccelLogic::getPort(const std::string& if_name, PortID idx)
         return SimObject::getPort(if_name, idx);
 }
 
-bool
+void
 AccelLogic::sendPkt(PacketPtr pkt)
 {
-    if (!port.sendTimingReq(pkt))
-    {
-        retryPkt = pkt;
-        return false;
-    }
-
-    return true;
+    sendQueue.push_back(pkt);
+    // otherwise, we are waiting for a retry
+    if (sendQueue.size() == 1)
+        sendPending();
 }
 
 void
-AccelLogic::recvRetry()
+AccelLogic::sendPending()
 {
-    assert(retryPkt);
-    if (port.sendTimingReq(retryPkt))
-        retryPkt = nullptr;
+    while (!sendQueue.empty() && port.sendTimingReq(sendQueue.front()))
+        sendQueue.pop_front();
 }
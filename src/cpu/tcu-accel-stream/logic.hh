@@ -36,8 +36,20 @@
 #include "cpu/tcu-accel-stream/algorithm.hh"
 #include "sim/system.hh"
 
+#include <deque>
+#include <vector>
+
 class TcuAccelStream;
 
+/**
+ * The logic of the stream accelerator, which pulls the data chunk by chunk
+ * from the buffer, runs the algorithm on it and pushes the result back. The
+ * chunks are processed in a pipeline with one buffer per chunk in flight,
+ * so that pulling chunk i+1, computing chunk i and pushing chunk i-1 can
+ * overlap. The algorithm processes one chunk at a time in order and the
+ * output is written back to the start of the block, because the algorithm
+ * might shrink the data.
+ */
 class AccelLogic : public ClockedObject
 {
     class CpuPort : public MasterPort
@@ -58,16 +70,28 @@ class AccelLogic : public ClockedObject
 
     enum State
     {
-        LOGIC_PULL,
-        LOGIC_PUSH,
+        LOGIC_RUN,
         LOGIC_DONE,
     };
 
+    enum Stage
+    {
+        STAGE_FREE,
+        STAGE_PULL,
+        // pulled, waiting for the algorithm
+        STAGE_PULLED,
+        STAGE_COMPUTE,
+        STAGE_PUSH,
+        STAGE_COUNT,
+    };
+
     explicit AccelLogic(const AccelLogicParams &p);
 
     Port& getPort(const std::string &if_name,
                   PortID idx = InvalidPortID) override;
 
+    void regStats() override;
+
     void setAccelerator(TcuAccelStream *_accel) {
         accel = _accel;
     }
@@ -81,29 +105,56 @@ class AccelLogic : public ClockedObject
     void start(Addr _offset, Addr _dataSize, Cycles _compTime);
 
    private:
+
+    struct Buffer
+    {
+        Stage stage;
+        // position and size of the chunk
+        Addr pos;
+        Addr size;
+        // the response of the pull
+        PacketPtr input;
+        // position and size of the output
+        Addr outPos;
+        Addr outSize;
+    };
+
     void tick();
+    void computeDone();
     void handleMemResp(PacketPtr pkt);
 
-    bool sendPkt(PacketPtr pkt);
-    void recvRetry();
+    void kick();
+    void setStage(Buffer &buf, Stage stage);
+
+    void sendPkt(PacketPtr pkt);
+    void sendPending();
 
     EventWrapper<AccelLogic, &AccelLogic::tick> tickEvent;
+    EventWrapper<AccelLogic, &AccelLogic::computeDone> computeEvent;
 
     CpuPort port;
-    PacketPtr retryPkt;
+    // the requests to send; the first one waits for a retry, if any
+    std::deque<PacketPtr> sendQueue;
 
     TcuAccelStream *accel;
     TcuAccelStreamAlgo *algo;
     State state;
     bool stateChanged;
     Cycles compTime;
-    Cycles opStart;
     Addr dataSize;
     Addr outSize;
     Addr offset;
-    Addr pos;
-    Addr pullSize;
-    uint8_t *pullData;
+    // the next chunk to pull and to compute
+    Addr pullPos;
+    Addr computePos;
+
+    std::vector<Buffer> bufs;
+    unsigned stageCount[STAGE_COUNT];
+    // the buffer the algorithm works on or nullptr
+    Buffer *computing;
+
+    Stats::Scalar chunks;
+    Stats::AverageVector occupancy;
 };
 
 #endif /* __CPU_TCU_ACCEL_STREAM_LOGIC_HH__ */
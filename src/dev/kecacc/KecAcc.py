@@ -36,6 +36,8 @@ class KecAcc(BasicPioDevice):
 
     port = RequestPort("Port to the memory system")
     buf_size = Param.MemorySize('512KiB', "Maximum size of processable buffers")
+    window_size = Param.MemorySize('64KiB', "Size of the stream window of each context (the maximum size of a single TCU transfer into it)")
+    contexts = Param.Unsigned(1, "Number of independent sponge contexts, each with its own command register (the Keccak core has one pipeline stage per context)")
 
     mem_width = Param.Unsigned(16, "Memory width (bytes read/written per cycle)")
     pipeline_cycles = Param.Cycles(2, "Cycles for load pipeline overhead")
@@ -32,6 +32,7 @@
 #include "dev/kecacc/kecacc.hh"
 
 #include "base/bitunion.hh"
+#include "base/cast.hh"
 #include "base/trace.hh"
 #include "debug/KecAcc.hh"
 #include "sim/system.hh"
@@ -53,8 +54,17 @@ enum
     CMD_ABSORB_LAST,
     // Squeeze bytes to specified memory address
     CMD_SQUEEZE,
+    // Absorb bytes written to the stream window of the context
+    CMD_ABSORB_STREAM,
+    // Like CMD_ABSORB_STREAM, but apply padding afterwards
+    CMD_ABSORB_STREAM_LAST,
+    // Squeeze bytes read from the stream window of the context
+    CMD_SQUEEZE_STREAM,
 };
 
+// the stream windows start after the command registers
+const Addr WINDOW_OFFSET = 0x1000;
+
 BitUnion64(CmdReg)
     BitfieldRO<3, 0> cmd;
     SubBitUnion(init, 63, 4)
@@ -70,18 +80,41 @@ BitUnion64(CmdReg)
 EndBitUnion(CmdReg)
 }
 
+KecAcc::Context::Context(KecAcc &acc, unsigned _id, size_t bufSize)
+    : id(_id), cmd(0), xkcp(),
+      buffer(new uint8_t[bufSize + alignof(uint64_t)]), start(0),
+      streamLeft(0), streamPos(0),
+      perms(0), permuting(false), permExtra(0), squeezePkt(nullptr),
+      delayedPkt(nullptr),
+      sendDelayedPktEvent([this, &acc]{ acc.sendDelayedPkt(*this); },
+                          acc.name() + ".sendDelayedPkt"),
+      finishCmdEvent([this, &acc]{ acc.finishCommand(*this); },
+                     acc.name() + ".finishCmd"),
+      permDoneEvent([this, &acc]{ acc.permutationDone(*this); },
+                    acc.name() + ".permDone")
+{
+}
+
 KecAcc::KecAcc(const Params &p)
-    : BasicPioDevice(p, sizeof(uint64_t)), port("port", *this),
-      requestorId(p.system->getRequestorId(this)), delayedPkt(nullptr),
-      sendDelayedPktEvent(this), finishCmdEvent(this),
-      cmd(0), xkcp(), buffer(new uint8_t[p.buf_size + alignof(uint64_t)]),
-      start(0)
+    : BasicPioDevice(p, WINDOW_OFFSET + p.contexts * p.window_size),
+      port("port", *this), requestorId(p.system->getRequestorId(this)),
+      ctxs(),
+      issueCycles(divCeil(uint64_t(p.permute_cycles), p.contexts)),
+      nextIssue(0), nextCtx(0), issuePermEvent(this)
 {
+    fatal_if(p.contexts == 0, "KecAcc needs at least one context\n");
+    fatal_if(p.contexts * sizeof(uint64_t) > WINDOW_OFFSET,
+             "Too many contexts for the register space\n");
+    for (unsigned i = 0; i < p.contexts; ++i)
+        ctxs.emplace_back(new Context(*this, i, p.buf_size));
 }
 
 KecAcc::~KecAcc()
 {
-    delete delayedPkt;
+    for (auto &ctx : ctxs) {
+        delete ctx->delayedPkt;
+        delete ctx->squeezePkt;
+    }
 }
 
 Port &
@@ -96,9 +129,15 @@ Tick
 KecAcc::read(PacketPtr pkt)
 {
     auto reg_addr = pkt->getAddr() - pioAddr;
-    fatal_if(reg_addr, "Unsupported register: %#lx\n", reg_addr);
+    if (reg_addr >= WINDOW_OFFSET)
+        return streamSqueeze(windowContext(reg_addr, pkt),
+                             windowOffset(reg_addr), pkt);
 
-    uint64_t val = cmd;
+    fatal_if(reg_addr % sizeof(uint64_t) ||
+             reg_addr / sizeof(uint64_t) >= ctxs.size(),
+             "Unsupported register: %#lx\n", reg_addr);
+
+    uint64_t val = ctxs[reg_addr / sizeof(uint64_t)]->cmd;
     //DPRINTF(KecAcc, "Read register %#lx = %#lx\n", reg_addr, val);
 
     pkt->setUintX(val, ByteOrder::little);
@@ -110,14 +149,21 @@ Tick
 KecAcc::write(PacketPtr pkt)
 {
     auto reg_addr = pkt->getAddr() - pioAddr;
-    fatal_if(reg_addr, "Unsupported register: %#lx\n", reg_addr);
+    if (reg_addr >= WINDOW_OFFSET)
+        return streamAbsorb(windowContext(reg_addr, pkt),
+                            windowOffset(reg_addr), pkt);
+
+    fatal_if(reg_addr % sizeof(uint64_t) ||
+             reg_addr / sizeof(uint64_t) >= ctxs.size(),
+             "Unsupported register: %#lx\n", reg_addr);
 
     auto val = pkt->getUintX(ByteOrder::little);
     DPRINTF(KecAcc, "Write register %#lx = %#lx\n", reg_addr, val);
 
-    fatal_if(cmd, "Cannot write while accelerator is busy\n");
-    cmd = val;
-    start = curCycle();
+    Context &ctx = *ctxs[reg_addr / sizeof(uint64_t)];
+    fatal_if(ctx.cmd, "Cannot write while context %u is busy\n", ctx.id);
+    ctx.cmd = val;
+    ctx.start = curCycle();
 
     CmdReg reg(val);
 
@@ -126,43 +172,56 @@ KecAcc::write(PacketPtr pkt)
       case CMD_LOAD:
         break;
       default:
-        fatal_if(!xkcp.rate_bytes(), "Accelerator not initialized\n");
+        fatal_if(!ctx.xkcp.rate_bytes(), "Accelerator not initialized\n");
     }
 
     switch (reg.cmd) {
       case CMD_INIT:
-        fatal_if(!xkcp.init(reg.init.hash_type),
+        fatal_if(!ctx.xkcp.init(reg.init.hash_type),
                  "Unsupported hash type: %d\n", reg.init.hash_type);
-        schedule(finishCmdEvent, clockEdge(params().init_cycles));
+        schedule(ctx.finishCmdEvent, clockEdge(params().init_cycles));
         break;
       case CMD_LOAD:
-        sendPkt(createMemReq(MemCmd::ReadReq, reg.state.addr, xkcp.state,
-                             sizeof(xkcp.state)));
+        sendPkt(ctx, createMemReq(ctx, MemCmd::ReadReq, reg.state.addr,
+                                  ctx.xkcp.state, sizeof(ctx.xkcp.state)));
         break;
       case CMD_SAVE:
-        sendPkt(createMemReq(MemCmd::WriteReq, reg.state.addr, xkcp.state,
-                             sizeof(xkcp.state)), params().save_cycles);
+        sendPkt(ctx, createMemReq(ctx, MemCmd::WriteReq, reg.state.addr,
+                                  ctx.xkcp.state, sizeof(ctx.xkcp.state)),
+                params().save_cycles);
         break;
       case CMD_ABSORB:
         if (reg.sponge.bytes == 0) {
-            schedule(finishCmdEvent, nextCycle());
+            schedule(ctx.finishCmdEvent, nextCycle());
             break;
         }
-        startAbsorb();
+        startAbsorb(ctx);
         break;
       case CMD_ABSORB_LAST:
         if (reg.sponge.bytes == 0) {
-            schedule(finishCmdEvent, clockEdge(pad()));
+            schedule(ctx.finishCmdEvent, clockEdge(pad(ctx)));
             break;
         }
-        startAbsorb();
+        startAbsorb(ctx);
         break;
       case CMD_SQUEEZE:
         if (reg.sponge.bytes == 0) {
-            schedule(finishCmdEvent, nextCycle());
+            schedule(ctx.finishCmdEvent, nextCycle());
             break;
         }
-        startSqueeze();
+        startSqueeze(ctx);
+        break;
+      case CMD_ABSORB_STREAM:
+      case CMD_ABSORB_STREAM_LAST:
+        // the data arrives via the stream window (see streamAbsorb)
+        ctx.streamLeft = reg.sponge.bytes;
+        ctx.streamPos = 0;
+        ctx.streamPending.clear();
+        if (reg.sponge.bytes == 0)
+            finishStream(ctx);
+        break;
+      case CMD_SQUEEZE_STREAM:
+        startSqueezeStream(ctx);
         break;
       default:
         fatal("Unsupported command: %d\n", reg.cmd);
@@ -173,12 +232,14 @@ KecAcc::write(PacketPtr pkt)
 }
 
 PacketPtr
-KecAcc::createMemReq(MemCmd memCmd, Addr addr, void *ptr, unsigned size) const
+KecAcc::createMemReq(Context &ctx, MemCmd memCmd, Addr addr, void *ptr,
+                     unsigned size) const
 {
     Request::Flags flags;
     auto req = std::make_shared<Request>(addr, size, flags, requestorId);
     auto pkt = new Packet(req, memCmd);
     pkt->dataStatic(ptr);
+    pkt->pushSenderState(new CtxSenderState(ctx));
 
     // Calculate memory access time with selected mem width of accelerator
     Cycles delay(divCeil(size, params().mem_width));
@@ -187,9 +248,9 @@ KecAcc::createMemReq(MemCmd memCmd, Addr addr, void *ptr, unsigned size) const
 }
 
 PacketPtr
-KecAcc::createSpongeMemReq(MemCmd memCmd) const
+KecAcc::createSpongeMemReq(Context &ctx, MemCmd memCmd) const
 {
-    CmdReg reg = cmd;
+    CmdReg reg = ctx.cmd;
 
     // Since the entire buffer is loaded at once it must fit into the
     // configured buffer size. It can be increased in the configuration.
@@ -197,12 +258,12 @@ KecAcc::createSpongeMemReq(MemCmd memCmd) const
              "Buffer too small for requested bytes\n");
 
     // Adjust buffer start according to backend alignment offset
-    auto buffer_start = buffer.get() + xkcp.alignment_offset();
-    auto pkt = createMemReq(memCmd, reg.sponge.addr,
+    auto buffer_start = ctx.buffer.get() + ctx.xkcp.alignment_offset();
+    auto pkt = createMemReq(ctx, memCmd, reg.sponge.addr,
                             buffer_start, reg.sponge.bytes);
 
     // Calculate cycles per block which include an additional pipeline overhead
-    unsigned int rate = xkcp.rate_bytes();
+    unsigned int rate = ctx.xkcp.rate_bytes();
     Cycles cpb(divCeil(rate, params().mem_width) + params().pipeline_cycles);
 
     // Adjust memory access time according to number of blocks in the buffer
@@ -214,129 +275,348 @@ KecAcc::createSpongeMemReq(MemCmd memCmd) const
 }
 
 void
-KecAcc::sendPkt(PacketPtr pkt, Cycles delay)
+KecAcc::sendPkt(Context &ctx, PacketPtr pkt, Cycles delay)
 {
     DPRINTF(KecAcc,
-            "sendPkt: %s (addr: %#lx, size: %u, cycles: %llu, delay: %llu)\n",
-            pkt->cmdString(), pkt->getAddr(), pkt->getSize(),
+            "ctx%u: sendPkt: %s (addr: %#lx, size: %u, cycles: %llu, "
+            "delay: %llu)\n",
+            ctx.id, pkt->cmdString(), pkt->getAddr(), pkt->getSize(),
             ticksToCycles(pkt->payloadDelay), delay);
 
     if (delay) {
-        delayedPkt = pkt;
-        schedule(&sendDelayedPktEvent, clockEdge(delay));
+        ctx.delayedPkt = pkt;
+        schedule(ctx.sendDelayedPktEvent, clockEdge(delay));
     } else {
         port.sendTimingReqRetry(pkt);
     }
 }
 
 void
-KecAcc::sendDelayedPkt()
+KecAcc::sendDelayedPkt(Context &ctx)
 {
-    assert(delayedPkt);
-    port.sendTimingReqRetry(delayedPkt);
-    delayedPkt = nullptr;
+    assert(ctx.delayedPkt);
+    port.sendTimingReqRetry(ctx.delayedPkt);
+    ctx.delayedPkt = nullptr;
 }
 
 void
-KecAcc::startAbsorb()
+KecAcc::startAbsorb(Context &ctx)
 {
-    CmdReg reg = cmd;
+    CmdReg reg = ctx.cmd;
     fatal_if(reg.sponge.bytes > params().buf_size,
              "Buffer too small for requested bytes\n");
-    sendPkt(createSpongeMemReq(MemCmd::ReadReq));
+    sendPkt(ctx, createSpongeMemReq(ctx, MemCmd::ReadReq));
 }
 
 void
-KecAcc::startSqueeze()
+KecAcc::startSqueeze(Context &ctx)
 {
-    CmdReg reg = cmd;
+    CmdReg reg = ctx.cmd;
     fatal_if(reg.sponge.bytes > params().buf_size,
              "Buffer too small for requested bytes\n");
-    auto pkt = createSpongeMemReq(MemCmd::WriteReq);
-    sendPkt(pkt, squeeze(pkt));
+    auto pkt = createSpongeMemReq(ctx, MemCmd::WriteReq);
+    auto nperm = squeeze(ctx, pkt);
+    // the data is written after the permutations producing it
+    ctx.squeezePkt = pkt;
+    permute(ctx, nperm, Cycles(0));
 }
 
-Cycles
-KecAcc::absorb(PacketPtr pkt)
+void
+KecAcc::startSqueezeStream(Context &ctx)
+{
+    CmdReg reg = ctx.cmd;
+    fatal_if(reg.sponge.bytes > params().buf_size,
+             "Buffer too small for requested bytes\n");
+
+    // squeeze everything now; the reads from the window have to wait for
+    // the permutations (see streamSqueeze)
+    auto nperm = ctx.xkcp.squeeze(
+        ctx.buffer.get() + ctx.xkcp.alignment_offset(), reg.sponge.bytes);
+    DPRINTF(KecAcc, "ctx%u: squeeze stream(%lu)\n", ctx.id,
+            reg.sponge.bytes);
+
+    ctx.streamLeft = reg.sponge.bytes;
+    if (reg.sponge.bytes == 0)
+        schedule(ctx.finishCmdEvent, nextCycle());
+    else
+        permute(ctx, nperm, Cycles(0));
+}
+
+KecAcc::Context &
+KecAcc::windowContext(Addr reg_addr, PacketPtr pkt) const
+{
+    Addr off = windowOffset(reg_addr);
+    // a transfer must not spill into the window of the next context
+    fatal_if(off + pkt->getSize() > params().window_size,
+             "Stream access at %#lx+%u exceeds the window\n",
+             reg_addr, pkt->getSize());
+    return *ctxs[(reg_addr - WINDOW_OFFSET) / params().window_size];
+}
+
+Addr
+KecAcc::windowOffset(Addr reg_addr) const
+{
+    return (reg_addr - WINDOW_OFFSET) % params().window_size;
+}
+
+Tick
+KecAcc::streamAbsorb(Context &ctx, Addr offset, PacketPtr pkt)
 {
-    DPRINTF(KecAcc, "absorb(%u)\n", pkt->getSize());
+    CmdReg reg = ctx.cmd;
+    fatal_if(reg.cmd != CMD_ABSORB_STREAM &&
+             reg.cmd != CMD_ABSORB_STREAM_LAST,
+             "ctx%u: stream write without absorb command\n", ctx.id);
+    fatal_if(offset + pkt->getSize() > reg.sponge.bytes ||
+             pkt->getSize() > ctx.streamLeft,
+             "ctx%u: stream write exceeds absorb command\n", ctx.id);
+    fatal_if(offset < ctx.streamPos || ctx.streamPending.count(offset),
+             "ctx%u: stream write at %#lx written twice\n", ctx.id, offset);
+
+    // the TCU has multiple writes in flight, so that they can arrive out of
+    // order. we absorb the data that is in order and buffer the rest.
+    uint64_t nperm = 0;
+    auto data = pkt->getConstPtr<uint8_t>();
+    if (offset == ctx.streamPos) {
+        DPRINTF(KecAcc, "ctx%u: absorb stream(%#lx, %u)\n", ctx.id, offset,
+                pkt->getSize());
+        nperm += ctx.xkcp.absorb(data, pkt->getSize());
+        ctx.streamPos += pkt->getSize();
+
+        auto it = ctx.streamPending.begin();
+        while (it != ctx.streamPending.end() && it->first == ctx.streamPos) {
+            DPRINTF(KecAcc, "ctx%u: absorb stream(%#lx, %lu)\n", ctx.id,
+                    it->first, it->second.size());
+            nperm += ctx.xkcp.absorb(it->second.data(), it->second.size());
+            ctx.streamPos += it->second.size();
+            it = ctx.streamPending.erase(it);
+        }
+    } else {
+        DPRINTF(KecAcc, "ctx%u: buffer stream(%#lx, %u)\n", ctx.id, offset,
+                pkt->getSize());
+        ctx.streamPending.emplace(offset,
+            std::vector<uint8_t>(data, data + pkt->getSize()));
+    }
+    ctx.streamLeft -= pkt->getSize();
+
+    if (nperm) {
+        ctx.perms += nperm;
+        kickCore();
+    }
+    if (ctx.streamLeft == 0 && ctx.perms == 0 && !ctx.permuting)
+        finishStream(ctx);
+
+    // the sponge accepts mem_width bytes per cycle
+    Cycles beats(divCeil(pkt->getSize(), params().mem_width));
+    pkt->makeResponse();
+    return pioDelay + cyclesToTicks(beats);
+}
+
+Tick
+KecAcc::streamSqueeze(Context &ctx, Addr offset, PacketPtr pkt)
+{
+    CmdReg reg = ctx.cmd;
+    fatal_if(reg.cmd != CMD_SQUEEZE_STREAM,
+             "ctx%u: stream read without squeeze command\n", ctx.id);
+    fatal_if(offset + pkt->getSize() > reg.sponge.bytes ||
+             pkt->getSize() > ctx.streamLeft,
+             "ctx%u: stream read exceeds squeeze command\n", ctx.id);
+
+    // the reads can arrive in any order; each gets the bytes at its offset
+    DPRINTF(KecAcc, "ctx%u: read stream(%#lx, %u)\n", ctx.id, offset,
+            pkt->getSize());
+    pkt->setData(ctx.buffer.get() + ctx.xkcp.alignment_offset() + offset);
+    ctx.streamLeft -= pkt->getSize();
+
+    // the data is available once the remaining permutations are done
+    uint64_t perms = ctx.perms + (ctx.permuting ? 1 : 0);
+    Cycles wait(perms * params().permute_cycles);
+    if (ctx.streamLeft == 0 && perms == 0)
+        schedule(ctx.finishCmdEvent, nextCycle());
+
+    Cycles beats(divCeil(pkt->getSize(), params().mem_width));
+    pkt->makeResponse();
+    return pioDelay + cyclesToTicks(wait + beats);
+}
+
+void
+KecAcc::finishStream(Context &ctx)
+{
+    CmdReg reg = ctx.cmd;
+    ctx.permExtra = Cycles(0);
+    if (reg.cmd == CMD_ABSORB_STREAM_LAST)
+        ctx.permExtra = pad(ctx);
+    schedule(ctx.finishCmdEvent, clockEdge(ctx.permExtra));
+}
+
+uint64_t
+KecAcc::absorb(Context &ctx, PacketPtr pkt)
+{
+    DPRINTF(KecAcc, "ctx%u: absorb(%u)\n", ctx.id, pkt->getSize());
     assert(pkt->isRead());
-    auto nperm = xkcp.absorb(pkt->getConstPtr<uint8_t>(), pkt->getSize());
-    return Cycles(std::max(nperm * params().permute_cycles, 1UL));
+    return ctx.xkcp.absorb(pkt->getConstPtr<uint8_t>(), pkt->getSize());
 }
 
-Cycles
-KecAcc::squeeze(PacketPtr pkt)
+uint64_t
+KecAcc::squeeze(Context &ctx, PacketPtr pkt)
 {
-    DPRINTF(KecAcc, "squeeze(%u)\n", pkt->getSize());
+    DPRINTF(KecAcc, "ctx%u: squeeze(%u)\n", ctx.id, pkt->getSize());
     assert(pkt->isWrite());
-    auto nperm = xkcp.squeeze(pkt->getPtr<uint8_t>(), pkt->getSize());
-    return Cycles(std::max(nperm * params().permute_cycles, 1UL));
+    return ctx.xkcp.squeeze(pkt->getPtr<uint8_t>(), pkt->getSize());
 }
 
 Cycles
-KecAcc::pad()
+KecAcc::pad(Context &ctx)
 {
-    DPRINTF(KecAcc, "pad\n");
-    xkcp.pad();
+    DPRINTF(KecAcc, "ctx%u: pad\n", ctx.id);
+    ctx.xkcp.pad();
     return params().pad_cycles;
 }
 
+void
+KecAcc::permute(Context &ctx, uint64_t nperm, Cycles extra)
+{
+    assert(ctx.perms == 0 && !ctx.permuting);
+
+    ctx.permExtra = extra;
+    if (nperm == 0) {
+        // the data did not fill a block; take at least one cycle
+        schedule(ctx.permDoneEvent, clockEdge(Cycles(1)));
+        ctx.permuting = true;
+        return;
+    }
+
+    ctx.perms = nperm;
+    kickCore();
+}
+
+void
+KecAcc::kickCore()
+{
+    if (issuePermEvent.scheduled())
+        return;
+
+    Cycles now = curCycle();
+    schedule(issuePermEvent,
+             clockEdge(nextIssue > now ? nextIssue - now : Cycles(0)));
+}
+
+void
+KecAcc::issuePermutation()
+{
+    // issue a permutation of the next context with one, round-robin; a
+    // context can only issue its next permutation once the previous is done
+    for (size_t i = 0; i < ctxs.size(); ++i) {
+        Context &ctx = *ctxs[(nextCtx + i) % ctxs.size()];
+        if (ctx.perms == 0 || ctx.permuting)
+            continue;
+
+        DPRINTF(KecAcc, "ctx%u: permute (%lu left)\n", ctx.id, ctx.perms);
+        ctx.perms--;
+        ctx.permuting = true;
+        schedule(ctx.permDoneEvent, clockEdge(params().permute_cycles));
+
+        nextCtx = (ctx.id + 1) % ctxs.size();
+        nextIssue = curCycle() + issueCycles;
+        break;
+    }
+
+    // the next issue is triggered by permutationDone, if all contexts with
+    // pending permutations are waiting for their previous one
+    for (auto &ctx : ctxs) {
+        if (ctx->perms > 0 && !ctx->permuting) {
+            schedule(issuePermEvent, clockEdge(nextIssue - curCycle()));
+            break;
+        }
+    }
+}
+
+void
+KecAcc::permutationDone(Context &ctx)
+{
+    ctx.permuting = false;
+    if (ctx.perms > 0) {
+        kickCore();
+        return;
+    }
+
+    CmdReg reg = ctx.cmd;
+    if (reg.cmd == CMD_ABSORB_STREAM || reg.cmd == CMD_ABSORB_STREAM_LAST) {
+        // otherwise, we wait for more data
+        if (ctx.streamLeft == 0)
+            finishStream(ctx);
+    } else if (reg.cmd == CMD_SQUEEZE_STREAM) {
+        // the command is done once the last byte has been read
+        if (ctx.streamLeft == 0)
+            schedule(ctx.finishCmdEvent, nextCycle());
+    } else if (ctx.squeezePkt) {
+        sendPkt(ctx, ctx.squeezePkt);
+        ctx.squeezePkt = nullptr;
+    } else {
+        schedule(ctx.finishCmdEvent, clockEdge(ctx.permExtra));
+    }
+}
+
 void
 KecAcc::completeIO(PacketPtr pkt)
 {
-    CmdReg reg = cmd;
-    Cycles c(0);
-    DPRINTF(KecAcc, "completeIO(%d)\n", reg.cmd);
+    auto state = safe_cast<CtxSenderState*>(pkt->popSenderState());
+    Context &ctx = state->ctx;
+    delete state;
+
+    CmdReg reg = ctx.cmd;
+    DPRINTF(KecAcc, "ctx%u: completeIO(%d)\n", ctx.id, reg.cmd);
 
     switch (reg.cmd) {
       case CMD_LOAD:
         assert(pkt->isRead());
-        c = params().load_cycles;
+        schedule(ctx.finishCmdEvent, clockEdge(params().load_cycles));
         break;
       case CMD_ABSORB:
-        c = absorb(pkt);
+        permute(ctx, absorb(ctx, pkt), Cycles(0));
         break;
-      case CMD_ABSORB_LAST:
-        c = absorb(pkt);
-        c += pad();
+      case CMD_ABSORB_LAST: {
+        auto nperm = absorb(ctx, pkt);
+        permute(ctx, nperm, pad(ctx));
         break;
+      }
       case CMD_SAVE:
       case CMD_SQUEEZE:
         assert(pkt->isWrite());
+        schedule(ctx.finishCmdEvent, clockEdge(Cycles(0)));
         break;
       default:
         panic("Unexpected I/O completion for cmd: %d\n", reg.cmd);
     }
 
     delete pkt;
-    schedule(finishCmdEvent, clockEdge(c));
 }
 
 void
-KecAcc::finishCommand()
+KecAcc::finishCommand(Context &ctx)
 {
-    DPRINTF(KecAcc, "finishCommand(%#lx) in %llu cycles\n",
-            cmd, curCycle() - start);
-    cmd = CMD_IDLE;
+    DPRINTF(KecAcc, "ctx%u: finishCommand(%#lx) in %llu cycles\n",
+            ctx.id, ctx.cmd, curCycle() - ctx.start);
+    ctx.cmd = CMD_IDLE;
 }
 
 KecAcc::CPUPort::CPUPort(const std::string &name, KecAcc &acc)
-    : RequestPort(name, &acc), acc(acc), retryPkt(nullptr)
+    : RequestPort(name, &acc), acc(acc), retryPkts()
 {
 }
 
 KecAcc::CPUPort::~CPUPort()
 {
-    delete retryPkt;
+    for (auto pkt : retryPkts)
+        delete pkt;
 }
 
 void
 KecAcc::CPUPort::sendTimingReqRetry(PacketPtr pkt)
 {
-    assert(!retryPkt);
-    if (!sendTimingReq(pkt))
-        retryPkt = pkt;
+    retryPkts.push_back(pkt);
+    // otherwise, we are waiting for a retry
+    if (retryPkts.size() == 1 && sendTimingReq(pkt))
+        retryPkts.pop_front();
 }
 
 bool
@@ -349,7 +629,7 @@ KecAcc::CPUPort::recvTimingResp(PacketPtr pkt)
 void
 KecAcc::CPUPort::recvReqRetry()
 {
-    assert(retryPkt);
-    if (sendTimingReq(retryPkt))
-        retryPkt = nullptr;
+    assert(!retryPkts.empty());
+    while (!retryPkts.empty() && sendTimingReq(retryPkts.front()))
+        retryPkts.pop_front();
 }
@@ -32,10 +32,26 @@
 #ifndef __DEV_KECACC_HH__
 #define __DEV_KECACC_HH__
 
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
 #include "dev/io_device.hh"
 #include "dev/kecacc/kecacc-xkcp.hh"
 #include "params/KecAcc.hh"
 
+/**
+ * The accelerator has multiple independent sponge contexts, each with its
+ * own command register (at offset ctx * 8). The contexts share the memory
+ * port and the Keccak core, which is pipelined with one stage per context
+ * and interleaves the permutations of the contexts round-robin.
+ *
+ * Besides reading from and writing to memory, each context can absorb the
+ * data written to its stream window (at 0x1000 + ctx * window_size) and
+ * squeeze to reads from it. This allows the TCU to transfer data from a
+ * memory endpoint directly into the sponge and vice versa.
+ */
 class KecAcc : public BasicPioDevice
 {
   public:
@@ -63,33 +79,84 @@ class KecAcc : public BasicPioDevice
 
       private:
         KecAcc &acc;
-        PacketPtr retryPkt;
+        // the packets to send; the first one waits for a retry, if any
+        std::deque<PacketPtr> retryPkts;
     };
 
-    void startAbsorb();
-    void startSqueeze();
-    Cycles absorb(PacketPtr pkt);
-    Cycles squeeze(PacketPtr pkt);
-    Cycles pad();
+    struct Context
+    {
+        Context(KecAcc &acc, unsigned id, size_t bufSize);
+
+        unsigned id;
+        uint64_t cmd;
+        KecAccXKCP xkcp;
+        std::unique_ptr<uint8_t[]> buffer;
+        Cycles start;
+
+        // the bytes still to transfer via the stream window, the window
+        // offset up to which the stream has been absorbed, and the writes
+        // that arrived ahead of it (offset -> data)
+        uint64_t streamLeft;
+        uint64_t streamPos;
+        std::map<Addr, std::vector<uint8_t>> streamPending;
+
+        // the permutations still to perform and whether one is in flight
+        uint64_t perms;
+        bool permuting;
+        // the cycles to add after the permutations
+        Cycles permExtra;
+        // the squeeze packet to send after the permutations
+        PacketPtr squeezePkt;
+
+        PacketPtr delayedPkt;
+        EventFunctionWrapper sendDelayedPktEvent;
+        EventFunctionWrapper finishCmdEvent;
+        EventFunctionWrapper permDoneEvent;
+    };
+
+    struct CtxSenderState : public Packet::SenderState
+    {
+        explicit CtxSenderState(Context &_ctx) : ctx(_ctx) {}
+
+        Context &ctx;
+    };
+
+    void startAbsorb(Context &ctx);
+    void startSqueeze(Context &ctx);
+    void startSqueezeStream(Context &ctx);
+    Context &windowContext(Addr reg_addr, PacketPtr pkt) const;
+    Addr windowOffset(Addr reg_addr) const;
+    Tick streamAbsorb(Context &ctx, Addr offset, PacketPtr pkt);
+    Tick streamSqueeze(Context &ctx, Addr offset, PacketPtr pkt);
+    void finishStream(Context &ctx);
+    uint64_t absorb(Context &ctx, PacketPtr pkt);
+    uint64_t squeeze(Context &ctx, PacketPtr pkt);
+    Cycles pad(Context &ctx);
     void completeIO(PacketPtr pkt);
-    void finishCommand();
+    void finishCommand(Context &ctx);
+
+    void permute(Context &ctx, uint64_t nperm, Cycles extra);
+    void kickCore();
+    void issuePermutation();
+    void permutationDone(Context &ctx);
 
-    PacketPtr createMemReq(MemCmd memCmd, Addr addr,
+    PacketPtr createMemReq(Context &ctx, MemCmd memCmd, Addr addr,
                            void *ptr, unsigned size) const;
-    PacketPtr createSpongeMemReq(MemCmd memCmd) const;
-    void sendPkt(PacketPtr pkt, Cycles delay = Cycles(0));
-    void sendDelayedPkt();
+    PacketPtr createSpongeMemReq(Context &ctx, MemCmd memCmd) const;
+    void sendPkt(Context &ctx, PacketPtr pkt, Cycles delay = Cycles(0));
+    void sendDelayedPkt(Context &ctx);
 
     CPUPort port;
     RequestorID requestorId;
-    PacketPtr delayedPkt;
-    EventWrapper<KecAcc, &KecAcc::sendDelayedPkt> sendDelayedPktEvent;
-    EventWrapper<KecAcc, &KecAcc::finishCommand> finishCmdEvent;
-
-    uint64_t cmd;
-    KecAccXKCP xkcp;
-    std::unique_ptr<uint8_t[]> buffer;
-    Cycles start;
+
+    std::vector<std::unique_ptr<Context>> ctxs;
+
+    // the pipelined Keccak core: a new permutation can be issued every
+    // issueCycles; the context to consider first for the next one
+    const Cycles issueCycles;
+    Cycles nextIssue;
+    size_t nextCtx;
+    EventWrapper<KecAcc, &KecAcc::issuePermutation> issuePermEvent;
 };
 
 #endif // __DEV_KECACC_HH__
@@ -239,6 +239,48 @@ PhysicalMemory::createBackingStore(
     }
 }
 
+Addr
+PhysicalMemory::mapFile(Addr addr, int fd, Addr size)
+{
+    // the file contents would not end up in the shared memory
+    if (!sharedBackstore.empty())
+        return 0;
+
+    const Addr page_size = sysconf(_SC_PAGESIZE);
+    size &= ~(page_size - 1);
+    if (size == 0)
+        return 0;
+
+    for (auto& s : backingStore) {
+        if (s.range.interleaved() || !s.range.contains(addr))
+            continue;
+
+        // the backing store itself is page aligned
+        Addr offset = addr - s.range.start();
+        if (offset % page_size != 0 || offset + size > s.range.size())
+            return 0;
+
+        DPRINTF(AddrRanges, "Mapping file to range %s\n",
+                RangeSize(addr, size).to_string());
+
+        int map_flags = MAP_PRIVATE | MAP_FIXED;
+        if (mmapUsingNoReserve)
+            map_flags |= MAP_NORESERVE;
+
+        // replace the anonymous memory, so that the pages are shared with
+        // the page cache until they are written
+        void *pmem = mmap(s.pmem + offset, size, PROT_READ | PROT_WRITE,
+                          map_flags, fd, 0);
+        if (pmem == MAP_FAILED) {
+            perror("mmap");
+            fatal("Could not mmap file to range %s!\n",
+                  RangeSize(addr, size).to_string());
+        }
+        return size;
+    }
+    return 0;
+}
+
 PhysicalMemory::~PhysicalMemory()
 {
     // unmap the backing store
@@ -221,6 +221,18 @@ class PhysicalMemory : public Serializable
     std::vector<BackingStoreEntry> getBackingStore() const
     { return backingStore; }
 
+    /**
+     * Map the beginning of the given file copy-on-write into the backing
+     * store at the given physical address. Only whole pages are mapped and
+     * the caller is responsible for the rest.
+     *
+     * @param addr The physical address, which needs to be page aligned
+     * @param fd The file to map from offset 0
+     * @param size The number of bytes to map at most
+     * @return The number of mapped bytes (0 if the range cannot be mapped)
+     */
+    Addr mapFile(Addr addr, int fd, Addr size);
+
     /**
      * Perform an untimed memory access and update all the state
      * (e.g. locked addresses) and statistics accordingly. The packet
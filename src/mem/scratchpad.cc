@@ -37,7 +37,8 @@ Scratchpad::Scratchpad(const ScratchpadParams &p)
     tcuPort(name() + ".tcu_port", *this),
     latency(p.latency),
     throughput(p.throughput),
-    offset(p.offset)
+    offset(p.offset),
+    offsetBackdoor()
 {
 }
 
@@ -117,6 +118,47 @@ Scratchpad::recvAtomic(PacketPtr pkt)
     return totalDelay;
 }
 
+Tick
+Scratchpad::recvAtomicBackdoor(PacketPtr pkt, MemBackdoorPtr &_backdoor)
+{
+    Addr addr = pkt->getAddr();
+
+    // requests without data only ask for the backdoor
+    Tick latency = 0;
+    if (pkt->getSize() > 0)
+        latency = recvAtomic(pkt);
+    else if (pkt->needsResponse())
+        pkt->makeResponse();
+
+    if (addr < offset || !getAddrRange().contains(addr - offset))
+        return latency;
+
+    MemBackdoorPtr memBackdoor = nullptr;
+    getBackdoor(memBackdoor);
+    if (!memBackdoor)
+        return latency;
+
+    if (!offsetBackdoor.ptr())
+    {
+        offsetBackdoor.range(RangeSize(memBackdoor->range().start() + offset,
+                                       memBackdoor->range().size()));
+        offsetBackdoor.ptr(memBackdoor->ptr());
+        offsetBackdoor.flags(memBackdoor->flags());
+
+        // forward invalidations (e.g., due to load-locked) to our users
+        memBackdoor->addInvalidationCallback(
+            [this](const MemBackdoor &)
+            {
+                offsetBackdoor.invalidate();
+                offsetBackdoor.ptr(nullptr);
+            }
+        );
+    }
+
+    _backdoor = &offsetBackdoor;
+    return latency;
+}
+
 Scratchpad::ScratchpadPort::ScratchpadPort(const std::string& _name,
                                            Scratchpad& _scratchpad)
     : SimpleTimingPort(_name, &_scratchpad), scratchpad(_scratchpad)
@@ -136,3 +178,10 @@ Scratchpad::ScratchpadPort::recvAtomic(PacketPtr pkt)
 {
     return scratchpad.recvAtomic(pkt);
 }
+
+Tick
+Scratchpad::ScratchpadPort::recvAtomicBackdoor(PacketPtr pkt,
+                                               MemBackdoorPtr &backdoor)
+{
+    return scratchpad.recvAtomicBackdoor(pkt, backdoor);
+}
@@ -54,6 +54,9 @@ class Scratchpad : public AbstractMemory
 
         Tick recvAtomic(PacketPtr pkt) override;
 
+        Tick recvAtomicBackdoor(PacketPtr pkt,
+                                MemBackdoorPtr &backdoor) override;
+
         AddrRangeList getAddrRanges() const override;
     };
 
@@ -67,10 +70,15 @@ class Scratchpad : public AbstractMemory
 
     const Addr offset;
 
+    // the backdoor of the AbstractMemory, but with our offset applied
+    MemBackdoor offsetBackdoor;
+
   protected:
 
     Tick recvAtomic(PacketPtr pkt);
 
+    Tick recvAtomicBackdoor(PacketPtr pkt, MemBackdoorPtr &backdoor);
+
   public:
 
     Scratchpad(const ScratchpadParams &p);
@@ -0,0 +1,52 @@
+# Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+# ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those
+# of the authors and should not be interpreted as representing official policies,
+# either expressed or implied, of the FreeBSD Project.
+
+from m5.objects.XBar import NoncoherentXBar
+from m5.params import *
+
+class MeshXBar(NoncoherentXBar):
+    type = 'MeshXBar'
+    cxx_header = "mem/tcu/mesh_xbar.hh"
+
+    rows = Param.Unsigned("The number of router rows")
+    cols = Param.Unsigned("The number of router columns")
+    torus = Param.Bool(False, "Connect the outer routers via wrap-around links")
+
+    router_latency = Param.Cycles(1, "The latency of a router")
+    link_latency = Param.Cycles(1, "The latency of a link between two routers")
+    link_width = Param.Unsigned(16, "The width of a link (bytes per cycle)")
+    buffer_depth = Param.Unsigned(4, "The number of packets the input buffer of a router can hold per link and virtual channel")
+    vcs = Param.Unsigned(4, "The number of virtual channels; packets use the channel of their QoS value and higher channels have priority")
+
+    cpu_side_routers = VectorParam.Unsigned([], "The router of each CPU-side port (default: 0)")
+    mem_side_routers = VectorParam.Unsigned([], "The router of each memory-side port (default: 0)")
+
+    # the routers and links account for most of the latency
+    frontend_latency = 1
+    forward_latency = 0
+    response_latency = 1
+    width = 16
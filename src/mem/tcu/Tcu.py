@@ -29,6 +29,7 @@
 
 from m5.objects.ClockedObject import ClockedObject
 from m5.objects.Connector import BaseConnector
+from m5.objects.ReplacementPolicies import *
 from m5.params import *
 from m5.proxy import *
 
@@ -70,19 +71,49 @@ class Tcu(BaseTcu):
     max_noc_packet_size = Param.MemorySize("1kB", "Maximum size of a NoC packet (needs to be the same for all TCUs)")
 
     tlb_entries = Param.Unsigned(32, "The number of TLB entries")
+    tlb_assoc = Param.Unsigned(0, "The associativity of the TLB (0 = fully associative)")
+    tlb_replacement_policy = Param.BaseReplacementPolicy(LRURP(), "Replacement policy of the TLB")
+
+    l2_tlb_entries = Param.Unsigned(0, "The number of L2 TLB entries (0 = no L2 TLB)")
+    l2_tlb_assoc = Param.Unsigned(8, "The associativity of the L2 TLB (0 = fully associative)")
+    l2_tlb_replacement_policy = Param.BaseReplacementPolicy(LRURP(), "Replacement policy of the L2 TLB")
+
+    pt_walker = Param.Bool(False, "Resolve TLB misses by walking the page table in PT_ROOT")
+    pte_cache_entries = Param.Unsigned(16, "The number of PTEs the page-table walker caches")
 
     block_size = Param.MemorySize("64B", "The block size with which to access the local memory")
 
     buf_count = Param.Unsigned(4, "The number of temporary buffers for transfers")
     buf_size = Param.MemorySize("1kB", "The size of a temporary buffer")
+    buf_reserved_local = Param.Unsigned(0, "The number of buffers reserved for commands of the local core")
+    buf_reserved_llc = Param.Unsigned(0, "The number of buffers reserved for memory requests of the LLC")
+    buf_reserved_msgrecv = Param.Unsigned(0, "The number of buffers reserved for message receives")
+    buf_reserved_remote = Param.Unsigned(0, "The number of buffers reserved for remote reads and writes")
     req_count = Param.Unsigned(4, "The number of parallel requests to memory")
+    noc_req_count = Param.Unsigned(4, "The number of parallel NoC requests for READ/WRITE")
+    noc_msg_slots = Param.Unsigned(2, "The number of incoming NoC messages that can be accepted in parallel")
+    noc_mem_slots = Param.Unsigned(2, "The number of incoming NoC reads/writes that can be accepted in parallel")
+    noc_llc_slots = Param.Unsigned(2, "The number of incoming NoC LLC fills/evictions that can be accepted in parallel")
+    llc_mshrs = Param.Unsigned(0, "The number of outstanding LLC fills (0 = unlimited; concurrent misses to the same block are coalesced)")
+    llc_wb_combine_latency = Param.Cycles(0, "The time writebacks of the LLC are held back to combine them with adjacent ones (0 = disabled)")
+
+    mem_backdoor = Param.Bool(False, "Access the local memory directly via its backdoor, if possible (only for tiles without caches); the timing is approximated without contention")
+    mem_backdoor_latency = Param.Cycles(11, "Latency charged per memory request of a transfer via the memory backdoor")
+    mem_backdoor_throughput = Param.Unsigned(16, "Bytes per cycle charged per memory request of a transfer via the memory backdoor")
+
+    ext_recv_slots = Param.Unsigned(256, "The maximum number of slots of extended receive EPs (power of two)")
+
+    cmd_queue_slots = Param.Unsigned(8, "The number of slots in the command queue (max. 64); queued commands are executed sequentially")
 
     mmio_latency = Param.Cycles(6, "Latency for MMIO-based register accesses")
     cpu_to_cache_latency = Param.Cycles(1, "Latency for cache access for the CPU")
     tlb_latency = Param.Cycles(3, "Latency to access the TLB")
+    l2_tlb_latency = Param.Cycles(5, "Additional latency to access the L2 TLB")
 
     cmd_read_latency = Param.Cycles(20, "Latency for the READ command (start until NoC request)")
     cmd_write_latency = Param.Cycles(14, "Latency for the WRITE command (start until NoC request)")
+    cmd_atomic_latency = Param.Cycles(14, "Latency for the ATOMIC command (start until NoC request)")
+    cmd_copy_latency = Param.Cycles(20, "Latency for the COPY command (start until NoC request)")
     cmd_send_latency = Param.Cycles(21, "Latency for the SEND command (start until NoC request)")
     cmd_reply_latency = Param.Cycles(25, "Latency for the REPLY command (start until NoC request)")
     cmd_recv_latency = Param.Cycles(20, "Latency for receiving a message")
@@ -29,6 +29,7 @@
  * policies, either expressed or implied, of the FreeBSD Project.
  */
 
+#include "debug/Drain.hh"
 #include "debug/TcuSlavePort.hh"
 #include "debug/TcuMasterPort.hh"
 #include "debug/Tcu.hh"
@@ -100,19 +101,14 @@ BaseTcu::DCacheMasterPort::recvTimingResp(PacketPtr pkt)
 BaseTcu::TcuSlavePort::TcuSlavePort(const std::string& _name, BaseTcu& _tcu)
   : SlavePort(_name, &_tcu),
     tcu(_tcu),
-    busy(false),
     sendReqRetry(false),
+    outstanding(),
     pendingResponses()
 { }
 
 void
-BaseTcu::TcuSlavePort::requestFinished()
+BaseTcu::TcuSlavePort::retryRequest()
 {
-    assert(busy);
-    busy = false;
-
-    DPRINTF(TcuSlavePort, "Timing request finished\n");
-
     if (sendReqRetry)
     {
         DPRINTF(TcuSlavePort, "Send request retry\n");
@@ -131,6 +127,10 @@ BaseTcu::TcuSlavePort::schedTimingResp(PacketPtr pkt, Tick when)
 
     assert(pkt->isResponse());
 
+    // in atomic mode, the response is complete as soon as recvAtomic returns
+    if (tcu.atomicMode())
+        return;
+
     auto respEvent = new ResponseEvent(*this, pkt);
     tcu.schedule(respEvent, when);
 }
@@ -138,8 +138,14 @@ BaseTcu::TcuSlavePort::schedTimingResp(PacketPtr pkt, Tick when)
 Tick
 BaseTcu::TcuSlavePort::recvAtomic(PacketPtr pkt)
 {
-    panic("Atomic mode is not supported by the TCU!");
-    return 0;
+    DPRINTF(TcuSlavePort, "Receive atomic %s request at %#x (%u bytes)\n",
+                          pkt->cmd.toString(),
+                          pkt->getAddr(),
+                          pkt->getSize());
+
+    return tcu.runAtomic([this, pkt] {
+        handleRequest(pkt, false);
+    });
 }
 
 void
@@ -150,16 +156,15 @@ BaseTcu::TcuSlavePort::recvFunctional(PacketPtr pkt)
                           pkt->getAddr(),
                           pkt->getSize());
 
-    // don't actually make us busy/unbusy here, because we might interfere
-    // with the timing requests
-    bool dummy = false;
-    handleRequest(pkt, &dummy, true);
+    handleRequest(pkt, true);
 }
 
 bool
 BaseTcu::TcuSlavePort::recvTimingReq(PacketPtr pkt)
 {
-    if (busy)
+    // the request might already be turned into a response during handling
+    bool needsResp = pkt->needsResponse();
+    if (!handleRequest(pkt, false))
     {
         DPRINTF(TcuSlavePort, "Reject timing %s request at %#x (%u bytes)\n",
                           pkt->cmd.toString(),
@@ -175,9 +180,9 @@ BaseTcu::TcuSlavePort::recvTimingReq(PacketPtr pkt)
                           pkt->getAddr(),
                           pkt->getSize());
 
-    assert(!sendReqRetry);
-
-    return handleRequest(pkt, &busy, false);
+    if (needsResp)
+        outstanding++;
+    return true;
 }
 
 void
@@ -201,6 +206,7 @@ BaseTcu::TcuSlavePort::recvRespRetry()
             DPRINTF(TcuSlavePort, "Poping %p from queue\n", ev);
             pendingResponses.pop();
             delete ev;
+            outstanding--;
         }
         else
             break;
@@ -228,7 +234,10 @@ BaseTcu::TcuSlavePort::ResponseEvent::process()
         }
         // if it succeeded, let the event system delete the event
         else
+        {
             setFlags(AutoDelete);
+            port.outstanding--;
+        }
     }
     else
     {
@@ -258,15 +267,9 @@ BaseTcu::NocSlavePort::getAddrRanges() const
 }
 
 bool
-BaseTcu::NocSlavePort::handleRequest(PacketPtr pkt,
-                                     bool *busy,
-                                     bool functional)
+BaseTcu::NocSlavePort::handleRequest(PacketPtr pkt, bool functional)
 {
-    *busy = true;
-
-    tcu.handleNocRequest(pkt);
-
-    return true;
+    return tcu.handleNocRequest(pkt, functional);
 }
 
 AddrRangeList
@@ -278,10 +281,12 @@ BaseTcu::LLCSlavePort::getAddrRanges() const
 }
 
 bool
-BaseTcu::LLCSlavePort::handleRequest(PacketPtr pkt,
-                                          bool *busy,
-                                          bool functional)
+BaseTcu::LLCSlavePort::handleRequest(PacketPtr pkt, bool functional)
 {
+    // the LLC retries as soon as we can accept the request
+    if (!functional && !tcu.atomicMode() && !tcu.canHandleLLCRequest(pkt))
+        return false;
+
     // if that failed, it was an invalid request (probably due to speculative
     // execution)
     if (!tcu.handleLLCRequest(pkt, functional))
@@ -302,7 +307,10 @@ BaseTcu::BaseTcu(const BaseTcuParams &p)
     icacheSlavePort(icacheMasterPort, *this, true),
     dcacheSlavePort(dcacheMasterPort, *this, false),
     llcSlavePort(*this),
-    nocReqFinishedEvent(*this),
+    drainEvent(*this),
+    pool(name() + ".pool"),
+    atomicDepth(),
+    atomicTicks(),
     tileId(p.tile_id),
     mmioRegion(p.mmio_region),
     slaveRegion(p.slave_region)
@@ -330,6 +338,48 @@ BaseTcu::init()
         llcSlavePort.sendRangeChange();
 }
 
+void
+BaseTcu::regStats()
+{
+    ClockedObject::regStats();
+
+    pool.regStats();
+}
+
+DrainState
+BaseTcu::drain()
+{
+    if (isDrained())
+        return DrainState::Drained;
+
+    // the units become idle at various places. thus, just check that in
+    // every cycle until we are done.
+    if (!drainEvent.scheduled())
+        schedule(drainEvent, clockEdge(Cycles(1)));
+    return DrainState::Draining;
+}
+
+bool
+BaseTcu::isDrained()
+{
+    return nocSlavePort.isIdle() &&
+           icacheSlavePort.isIdle() &&
+           dcacheSlavePort.isIdle() &&
+           llcSlavePort.isIdle();
+}
+
+void
+BaseTcu::checkDrained()
+{
+    if (isDrained())
+    {
+        DPRINTF(Drain, "TCU drained\n");
+        signalDrainDone();
+    }
+    else
+        schedule(drainEvent, clockEdge(Cycles(1)));
+}
+
 Port&
 BaseTcu::getPort(const std::string &if_name, PortID idx)
 {
@@ -358,14 +408,18 @@ BaseTcu::generateRequest(Addr paddr, Addr size, MemCmd cmd)
 {
     Request::Flags flags;
 
-    auto req = std::make_shared<Request>(paddr, size, flags, requestorId);
+    // the request is shared with the packet and potentially others, so that
+    // its memory goes back to the pool as soon as the last reference is gone
+    auto req = std::allocate_shared<Request>(TcuPool::Allocator<Request>(pool),
+                                             paddr, size, flags, requestorId);
 
-    auto pkt = new Packet(req, cmd);
+    auto pkt = pool.create<Packet>(req, cmd);
 
     if (size)
     {
-        auto pktData = new uint8_t[size];
-        pkt->dataDynamic(pktData);
+        // the payload belongs to the pool, not to the packet
+        auto pktData = static_cast<uint8_t*>(pool.alloc(size));
+        pkt->dataStatic(pktData);
     }
 
     return pkt;
@@ -374,7 +428,12 @@ BaseTcu::generateRequest(Addr paddr, Addr size, MemCmd cmd)
 void
 BaseTcu::freeRequest(PacketPtr pkt)
 {
-    delete pkt;
+    uint8_t *pktData = nullptr;
+    if (pkt->req->getSize())
+        pktData = pkt->getPtr<uint8_t>();
+
+    pool.destroy(pkt);
+    pool.free(pktData);
 }
 
 void
@@ -410,6 +469,35 @@ BaseTcu::sendFunctionalMemRequest(PacketPtr pkt)
     dcacheMasterPort.sendFunctional(pkt);
 }
 
+bool
+BaseTcu::atomicMode() const
+{
+    return system->isAtomicMode();
+}
+
+Tick
+BaseTcu::sendAtomicNocRequest(PacketPtr pkt)
+{
+    printNocRequest(pkt, "atomic");
+    return nocMasterPort.sendAtomic(pkt);
+}
+
+Tick
+BaseTcu::sendAtomicMemRequest(PacketPtr pkt)
+{
+    pkt->req->setRequestorId(requestorId);
+
+    return dcacheMasterPort.sendAtomic(pkt);
+}
+
+Tick
+BaseTcu::sendMemBackdoorRequest(PacketPtr pkt, MemBackdoorPtr &backdoor)
+{
+    pkt->req->setRequestorId(requestorId);
+
+    return dcacheMasterPort.sendAtomicBackdoor(pkt, backdoor);
+}
+
 // -- responses --
 
 void
@@ -444,18 +532,6 @@ BaseTcu::schedLLCResponse(PacketPtr pkt, bool success)
 
 // -- misc --
 
-void
-BaseTcu::schedNocRequestFinished(Tick when)
-{
-    schedule(nocReqFinishedEvent, when);
-}
-
-void
-BaseTcu::nocRequestFinished()
-{
-    nocSlavePort.requestFinished();
-}
-
 void
 BaseTcu::schedDummyResponse(TcuSlavePort &port, PacketPtr pkt, bool functional)
 {
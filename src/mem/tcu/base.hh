@@ -37,6 +37,7 @@
 #include "mem/mem_object.hh"
 #include "mem/qport.hh"
 #include "params/BaseTcu.hh"
+#include "mem/tcu/pool.hh"
 #include "mem/tcu/tlb.hh"
 
 class BaseTcu : public ClockedObject
@@ -106,10 +107,11 @@ class BaseTcu : public ClockedObject
 
         BaseTcu& tcu;
 
-        bool busy;
-
         bool sendReqRetry;
 
+        // accepted timing requests whose response has not been sent yet
+        unsigned outstanding;
+
         struct ResponseEvent : public Event
         {
             TcuSlavePort& port;
@@ -135,9 +137,8 @@ class BaseTcu : public ClockedObject
 
         TcuSlavePort(const std::string& _name, BaseTcu& _tcu);
 
-        virtual bool handleRequest(PacketPtr pkt,
-                                   bool *busy,
-                                   bool functional) = 0;
+        /// returns false if the request cannot be accepted at the moment
+        virtual bool handleRequest(PacketPtr pkt, bool functional) = 0;
 
         void schedTimingResp(PacketPtr pkt, Tick when);
 
@@ -149,7 +150,10 @@ class BaseTcu : public ClockedObject
 
         void recvRespRetry() override;
 
-        void requestFinished();
+        /// sends a retry to the requester, if we rejected a request before
+        void retryRequest();
+
+        bool isIdle() const { return outstanding == 0; }
     };
 
     class NocSlavePort : public TcuSlavePort
@@ -164,9 +168,7 @@ class BaseTcu : public ClockedObject
 
         AddrRangeList getAddrRanges() const override;
 
-        bool handleRequest(PacketPtr pkt,
-                           bool *busy,
-                           bool functional) override;
+        bool handleRequest(PacketPtr pkt, bool functional) override;
     };
 
     template<class T>
@@ -195,7 +197,7 @@ class BaseTcu : public ClockedObject
             return ranges;
         }
 
-        bool handleRequest(PacketPtr pkt, bool *, bool functional) override
+        bool handleRequest(PacketPtr pkt, bool functional) override
         {
             bool res = tcu.handleCoreMemRequest(pkt, *this, port, icache, functional);
             if (!res)
@@ -218,9 +220,7 @@ class BaseTcu : public ClockedObject
 
         AddrRangeList getAddrRanges() const override;
 
-        bool handleRequest(PacketPtr pkt,
-                           bool *busy,
-                           bool functional) override;
+        bool handleRequest(PacketPtr pkt, bool functional) override;
     };
 
   public:
@@ -229,9 +229,12 @@ class BaseTcu : public ClockedObject
 
     void init() override;
 
+    void regStats() override;
+
+    DrainState drain() override;
+
     Port& getPort(const std::string &n, PortID idx) override;
 
-    void schedNocRequestFinished(Tick when);
 
     // requests
 
@@ -247,6 +250,12 @@ class BaseTcu : public ClockedObject
 
     void sendFunctionalMemRequest(PacketPtr pkt);
 
+    Tick sendAtomicNocRequest(PacketPtr pkt);
+
+    Tick sendAtomicMemRequest(PacketPtr pkt);
+
+    Tick sendMemBackdoorRequest(PacketPtr pkt, MemBackdoorPtr &backdoor);
+
     // responses
 
     void schedNocResponse(PacketPtr pkt, Tick when);
@@ -263,7 +272,7 @@ class BaseTcu : public ClockedObject
 
     // requests that are sent to us
 
-    virtual void handleNocRequest(PacketPtr pkt) = 0;
+    virtual bool handleNocRequest(PacketPtr pkt, bool functional) = 0;
 
     virtual bool handleCoreMemRequest(PacketPtr pkt,
                                       TcuSlavePort &sport,
@@ -271,11 +280,61 @@ class BaseTcu : public ClockedObject
                                       bool icache,
                                       bool functional) = 0;
 
+    virtual bool canHandleLLCRequest(PacketPtr pkt) = 0;
+
     virtual bool handleLLCRequest(PacketPtr pkt, bool functional) = 0;
 
+    // atomic mode
+
+    bool atomicMode() const;
+
+    /// whether we are handling an atomic request at the moment
+    bool inAtomicAccess() const { return atomicDepth > 0; }
+
+    /// adds the given time to the latency of the current atomic request
+    void chargeAtomic(Tick ticks)
+    {
+        if (inAtomicAccess())
+            atomicTicks += ticks;
+    }
+
+    /**
+     * Runs <func> as an atomic request, i.e., everything it causes in the TCU
+     * is done before we return and charged to the returned latency. Requests
+     * that we send to ourself in the meantime measure their own latency.
+     */
+    template<typename F>
+    Tick runAtomic(F func)
+    {
+        Tick outerTicks = atomicTicks;
+        atomicTicks = 0;
+        atomicDepth++;
+
+        func();
+
+        if (atomicDepth == 1)
+            finishAtomicAccess();
+
+        atomicDepth--;
+        Tick latency = atomicTicks;
+        atomicTicks = outerTicks;
+        return latency;
+    }
+
   protected:
 
-    void nocRequestFinished();
+    /// called at the end of the outermost atomic request
+    virtual void finishAtomicAccess() {}
+
+    /**
+     * Returns whether no activity is left that would get lost by a
+     * checkpoint. It is called in every cycle while draining and may take
+     * steps to become idle.
+     */
+    virtual bool isDrained();
+
+    void checkDrained();
+
 
     void schedDummyResponse(TcuSlavePort &port, PacketPtr pkt, bool functional);
 
@@ -299,7 +358,14 @@ class BaseTcu : public ClockedObject
 
     LLCSlavePort llcSlavePort;
 
-    EventWrapper<BaseTcu, &BaseTcu::nocRequestFinished> nocReqFinishedEvent;
+    EventWrapper<BaseTcu, &BaseTcu::checkDrained> drainEvent;
+
+    // packets, requests, sender states and payloads of our own accesses
+    TcuPool pool;
+
+    // the nesting level of atomic requests and the latency of the current one
+    unsigned atomicDepth;
+    Tick atomicTicks;
 
   public:
 
@@ -32,6 +32,7 @@
 #include "mem/tcu/cmds.hh"
 #include "mem/tcu/mem_unit.hh"
 #include "mem/tcu/msg_unit.hh"
+#include "mem/tcu/pt_unit.hh"
 #include "mem/tcu/tcu.hh"
 
 static const char *cmdNames[] =
@@ -44,6 +45,11 @@ static const char *cmdNames[] =
     "FETCH_MSG",
     "ACK_MSG",
     "SLEEP",
+    "SEND_MC",
+    "FETCH_MSGS",
+    "ACK_MSGS",
+    "ATOMIC",
+    "COPY",
 };
 
 static const char *privCmdNames[] =
@@ -85,10 +91,17 @@ TcuCommands::TcuCommands(Tcu &_tcu)
       cmdFinish(),
       extCmdFinish(),
       abort(),
-      cmdIsRemote()
+      abortCmdPending(),
+      cmdRemoteReqs(),
+      atomicFinish(),
+      atomicError(),
+      cmdQueue(),
+      deferredCmdPkt(),
+      cmdDeferred(),
+      nextCmdEvent(*this)
 {
     static_assert(sizeof(cmdNames) / sizeof(cmdNames[0]) ==
-        CmdCommand::SLEEP + 1, "cmdNames out of sync");
+        CmdCommand::COPY + 1, "cmdNames out of sync");
     static_assert(sizeof(privCmdNames) / sizeof(privCmdNames[0]) ==
         PrivCommand::ABORT_CMD + 1, "privCmdNames out of sync");
     static_assert(sizeof(extCmdNames) / sizeof(extCmdNames[0]) ==
@@ -127,17 +140,189 @@ TcuCommands::regStats()
         .flags(Stats::total | Stats::nozero);
     for (size_t i = 0; i < sizeof(extCmdNames) / sizeof(extCmdNames[0]); ++i)
         extCommands.subname(i, extCmdNames[i]);
+
+    queuedCommands
+        .name(name() + ".queuedCommands")
+        .desc("Number of commands submitted via the command queue");
+    deferredCommands
+        .name(name() + ".deferredCommands")
+        .desc("Number of core commands delayed by a queued command");
 }
 
 void
 TcuCommands::startCommand(RegFile::Result written, PacketPtr pkt, Tick when)
 {
+    // in atomic mode, the commands are executed right away and the requester
+    // gets its response as soon as we return
+    if (tcu.atomicMode())
+    {
+        if (written & RegFile::WROTE_EXT_CMD)
+            executeExtCommand(nullptr);
+        if (written & RegFile::WROTE_CMD)
+            executeCommand(nullptr);
+        if (written & RegFile::WROTE_PRIV_CMD)
+            executePrivCommand(nullptr);
+        if (written & RegFile::WROTE_QUEUE_CMD)
+            enqueueCommands();
+        return;
+    }
+
     if (written & RegFile::WROTE_EXT_CMD)
         tcu.schedule(new ExecExtCmdEvent(*this, pkt), when);
     if (written & RegFile::WROTE_CMD)
         tcu.schedule(new ExecCmdEvent(*this, pkt), when);
     if (written & RegFile::WROTE_PRIV_CMD)
         tcu.schedule(new ExecPrivCmdEvent(*this, pkt), when);
+    if (written & RegFile::WROTE_QUEUE_CMD)
+        tcu.schedule(new EnqueueCmdEvent(*this), when);
+}
+
+void
+TcuCommands::enqueueCommands()
+{
+    RegFile::reg_t pending = tcu.regs().get(QueueReg::PENDING);
+    RegFile::reg_t completed = tcu.regs().get(QueueReg::COMPLETED);
+
+    for (unsigned slot = 0; slot < tcu.regs().queueSlots(); ++slot)
+    {
+        RegFile::reg_t bit = static_cast<RegFile::reg_t>(1) << slot;
+        CmdCommand::Bits cmd = tcu.regs().getSlot(slot, UnprivReg::COMMAND);
+        if ((pending & bit) || cmd.opcode == CmdCommand::IDLE)
+            continue;
+
+        DPRINTF(TcuCmd, "Queueing command %s with EP=%u in slot %u\n",
+                COMMAND_NAME(cmdNames, cmd.opcode), cmd.epid, slot);
+
+        pending |= bit;
+        completed &= ~bit;
+        cmdQueue.push_back(slot);
+        queuedCommands++;
+    }
+
+    tcu.regs().set(QueueReg::PENDING, pending);
+    tcu.regs().set(QueueReg::COMPLETED, completed);
+
+    startNextCommand();
+}
+
+void
+TcuCommands::startNextCommand()
+{
+    // wait until the running queued command is finished. the units hold the
+    // state of a single command (its registers, EP cache, transfer, and
+    // finish event), so that commands on disjoint EPs cannot overlap.
+    if (tcu.regs().getActiveSlot() != -1)
+        return;
+
+    if (cmdDeferred)
+    {
+        // a deferred SLEEP waits until the queue has been drained, because
+        // the core wants to wait for the completions anyway
+        CmdCommand::Bits cmd = tcu.regs().getCommand();
+        if (cmd.opcode != CmdCommand::SLEEP || cmdQueue.empty())
+        {
+            // the core is already waiting for the command (see
+            // executeCommand)
+            PacketPtr pkt = deferredCmdPkt;
+            cmdDeferred = false;
+            deferredCmdPkt = nullptr;
+            executeCommand(pkt, true);
+            return;
+        }
+    }
+    // the command of the core is still running
+    else if (tcu.regs().getCommand().opcode != CmdCommand::IDLE)
+        return;
+
+    if (cmdQueue.empty())
+        return;
+
+    unsigned slot = cmdQueue.front();
+    cmdQueue.pop_front();
+
+    DPRINTF(TcuCmd, "Starting queued command in slot %u\n", slot);
+
+    tcu.regs().setActiveSlot(slot);
+    executeCommand(nullptr);
+}
+
+void
+TcuCommands::nextCommand()
+{
+    // the commands run synchronously in atomic mode
+    if (tcu.atomicMode())
+        tcu.runAtomic([this] { startNextCommand(); });
+    else
+        startNextCommand();
+}
+
+void
+TcuCommands::finishQueuedCommand(unsigned slot, TcuError error)
+{
+    DPRINTF(TcuCmd, "Finished queued command in slot %u -> %u\n",
+            slot, static_cast<uint>(error));
+
+    RegFile::reg_t bit = static_cast<RegFile::reg_t>(1) << slot;
+    RegFile::reg_t pending = tcu.regs().get(QueueReg::PENDING);
+    tcu.regs().set(QueueReg::PENDING, pending & ~bit);
+    RegFile::reg_t completed = tcu.regs().get(QueueReg::COMPLETED);
+    tcu.regs().set(QueueReg::COMPLETED, completed | bit);
+}
+
+void
+TcuCommands::abortDeferredCommand()
+{
+    CmdCommand::Bits cmd = tcu.regs().get(UnprivReg::COMMAND,
+                                          RegAccess::CPU);
+
+    DPRINTF(TcuCmd, "Dropping deferred command %s with EP=%u\n",
+            COMMAND_NAME(cmdNames, cmd.opcode), cmd.epid);
+
+    // report the command of the core instead of the running queued one
+    tcu.regs().set(PrivReg::PRIV_CMD_ARG1, cmd);
+
+    // the command has not been started, so that we can simply drop it
+    cmd = 0;
+    cmd.error = static_cast<unsigned>(TcuError::ABORT);
+    cmd.opcode = CmdCommand::IDLE;
+    tcu.regs().set(UnprivReg::COMMAND, cmd, RegAccess::CPU);
+
+    if (deferredCmdPkt)
+    {
+        tcu.connector.stopSleep();
+        tcu.schedCpuResponse(deferredCmdPkt, tcu.clockEdge(Cycles(1)));
+    }
+    deferredCmdPkt = nullptr;
+    cmdDeferred = false;
+}
+
+void
+TcuCommands::waitForCommand()
+{
+    // suspend the core until the command is finished, if possible. otherwise
+    // let it continue right away and poll the COMMAND register.
+    if (tcu.connector.canSuspendCmds())
+        tcu.connector.startSleep(Tcu::INVALID_EP_ID);
+    else
+    {
+        tcu.schedCpuResponse(cmdPkt, tcu.clockEdge(Cycles(1)));
+        cmdPkt = nullptr;
+    }
+}
+
+void
+TcuCommands::abortQueuedCommands()
+{
+    for (unsigned slot : cmdQueue)
+    {
+        CmdCommand::Bits cmd = 0;
+        cmd.error = static_cast<unsigned>(TcuError::ABORT);
+        cmd.opcode = CmdCommand::IDLE;
+        tcu.regs().setSlot(slot, UnprivReg::COMMAND, cmd);
+
+        finishQueuedCommand(slot, TcuError::ABORT);
+    }
+    cmdQueue.clear();
 }
 
 void
@@ -152,8 +337,29 @@ TcuCommands::stopCommand()
 }
 
 void
-TcuCommands::executeCommand(PacketPtr pkt)
+TcuCommands::executeCommand(PacketPtr pkt, bool waiting)
 {
+    // the units work on one command at a time; let the core wait until the
+    // queued command is finished
+    if (tcu.regs().getActiveSlot() != -1)
+    {
+        DPRINTF(TcuCmd, "Deferring command until queued command is done\n");
+        assert(!cmdDeferred);
+        cmdDeferred = true;
+        deferredCommands++;
+
+        // the core waits for the command as if it had been started. SLEEP
+        // suspends the core as soon as it starts.
+        CmdCommand::Bits cmd = tcu.regs().get(UnprivReg::COMMAND,
+                                              RegAccess::CPU);
+        cmdPkt = pkt;
+        if (cmdPkt && cmd.opcode != CmdCommand::SLEEP)
+            waitForCommand();
+        deferredCmdPkt = cmdPkt;
+        cmdPkt = nullptr;
+        return;
+    }
+
     CmdCommand::Bits cmd = tcu.regs().getCommand();
     if (cmd.opcode == CmdCommand::IDLE)
     {
@@ -171,6 +377,13 @@ TcuCommands::executeCommand(PacketPtr pkt)
     DPRINTF(TcuCmd, "Starting command %s with EP=%u, arg0=%#lx\n",
             COMMAND_NAME(cmdNames, cmd.opcode), cmd.epid, cmd.arg0);
 
+    // queued commands cannot suspend the core
+    if (tcu.regs().getActiveSlot() != -1 && cmd.opcode == CmdCommand::SLEEP)
+    {
+        finishCommand(TcuError::UNKNOWN_CMD);
+        return;
+    }
+
     switch (cmd.opcode)
     {
         case CmdCommand::SEND:
@@ -185,36 +398,48 @@ TcuCommands::executeCommand(PacketPtr pkt)
         case CmdCommand::WRITE:
             tcu.memUnit->startWrite(cmd);
             break;
+        case CmdCommand::ATOMIC:
+            tcu.memUnit->startAtomic(cmd);
+            break;
+        case CmdCommand::COPY:
+            tcu.memUnit->startCopy(cmd);
+            break;
         case CmdCommand::FETCH_MSG:
+        case CmdCommand::FETCH_MSGS:
             tcu.msgUnit->startFetch(cmd);
             break;
         case CmdCommand::ACK_MSG:
+        case CmdCommand::ACK_MSGS:
             tcu.msgUnit->startAck(cmd);
             break;
         case CmdCommand::SLEEP:
             tcu.connector.startWaitEP(cmd);
             break;
+        case CmdCommand::SEND_MC:
+            tcu.msgUnit->startSendMcast(cmd);
+            break;
         default:
             finishCommand(TcuError::UNKNOWN_CMD);
             return;
     }
 
-    if (cmdPkt && cmd.opcode != CmdCommand::SLEEP)
-    {
-        if (tcu.connector.canSuspendCmds())
-            tcu.connector.startSleep(Tcu::INVALID_EP_ID);
-        else
-        {
-            tcu.schedCpuResponse(cmdPkt, tcu.clockEdge(Cycles(1)));
-            cmdPkt = nullptr;
-        }
-    }
+    if (cmdPkt && cmd.opcode != CmdCommand::SLEEP && !waiting)
+        waitForCommand();
 }
 
 void
 TcuCommands::abortCommand()
 {
+    // commands that have not been started yet are simply dropped
+    abortQueuedCommands();
+    bool dropped = cmdDeferred;
+    if (dropped)
+        abortDeferredCommand();
+
+    // report the aborted command in PRIV_CMD_ARG1
     CmdCommand::Bits cmd = tcu.regs().getCommand();
+    if (!dropped)
+        tcu.regs().set(PrivReg::PRIV_CMD_ARG1, cmd);
 
     // if we've already scheduled finishCommand, consider the command done
     if (!cmdFinish && cmd.opcode != CmdCommand::IDLE)
@@ -222,12 +447,13 @@ TcuCommands::abortCommand()
         // if we are waiting for a NoC response, just wait until we receive it.
         // we deem this acceptable, because these remotely running transfers
         // never cause page faults and thus complete in short amounts of time.
-        if (cmdIsRemote)
+        if (cmdRemoteReqs > 0)
         {
             // SEND/REPLY needs to finish successfully as soon as we've sent
             // out the message.
             if (cmd.opcode != CmdCommand::SEND &&
-                cmd.opcode != CmdCommand::REPLY)
+                cmd.opcode != CmdCommand::REPLY &&
+                cmd.opcode != CmdCommand::SEND_MC)
                 abort = AbortType::REMOTE;
         }
         // otherwise, abort it locally. this is done for all commands, because
@@ -237,8 +463,11 @@ TcuCommands::abortCommand()
             abort = AbortType::LOCAL;
 
             auto res = tcu.xferUnit->tryAbortCommand();
-            // if the current command used the xferUnit, we're done
-            if (res == XferUnit::AbortResult::ABORTED)
+            // if the current command used the xferUnit, we're done. READ and
+            // WRITE finish on their own as soon as all packets are done.
+            if (res == XferUnit::AbortResult::ABORTED &&
+                cmd.opcode != CmdCommand::READ &&
+                cmd.opcode != CmdCommand::WRITE)
                 scheduleCmdFinish(Cycles(1), TcuError::ABORT);
         }
 
@@ -250,7 +479,7 @@ TcuCommands::abortCommand()
     }
     else
     {
-        abort = AbortType::NONE;
+        abort = dropped ? AbortType::LOCAL : AbortType::NONE;
         // don't do that if we'll do that in finishCommand event anyway
         if (!cmdFinish)
             finishAbort();
@@ -268,7 +497,15 @@ TcuCommands::scheduleCmdFinish(Cycles delay, TcuError error)
             delete cmdFinish;
         }
 
-        if (delay == 0)
+        // during an atomic request, the command is finished afterwards (see
+        // finishAtomic), because we might be in the middle of the units
+        if (tcu.inAtomicAccess())
+        {
+            tcu.chargeAtomic(tcu.cyclesToTicks(delay));
+            atomicFinish = true;
+            atomicError = error;
+        }
+        else if (delay == 0)
             finishCommand(error);
         else
         {
@@ -287,23 +524,9 @@ TcuCommands::finishCommand(TcuError error)
 
     switch(cmd.opcode)
     {
-        case CmdCommand::READ:
-        case CmdCommand::WRITE:
-        {
-            const CmdData::Bits data = tcu.regs().getData();
-            if (error == TcuError::NONE && data.size > 0)
-            {
-                if (cmd.opcode == CmdCommand::READ)
-                    tcu.memUnit->startRead(cmd);
-                else
-                    tcu.memUnit->startWrite(cmd);
-                return;
-            }
-            break;
-        }
-
         case CmdCommand::SEND:
         case CmdCommand::REPLY:
+        case CmdCommand::SEND_MC:
             // if not finished yet, don't continue here
             if (!tcu.msgUnit->finishMsgSend(error))
                 return;
@@ -327,8 +550,47 @@ TcuCommands::finishCommand(TcuError error)
         tcu.schedCpuResponse(cmdPkt, tcu.clockEdge(Cycles(1)));
     cmdPkt = NULL;
 
+    int slot = tcu.regs().getActiveSlot();
+    if (slot != -1)
+    {
+        tcu.regs().setActiveSlot(-1);
+        finishQueuedCommand(slot, error);
+    }
+
     // finish command abortion, if there is any
     finishAbort();
+
+    // continue with the next command in this cycle, if there is any. we
+    // don't start it from here, because we might be called from the units.
+    // during atomic requests, finishAtomic does that.
+    if ((cmdDeferred || !cmdQueue.empty()) && !nextCmdEvent.scheduled() &&
+        !tcu.inAtomicAccess())
+        tcu.schedule(nextCmdEvent, tcu.clockEdge());
+}
+
+bool
+TcuCommands::isIdle() const
+{
+    // the commands that are about to start hold the CPU's or NoC's request,
+    // which keeps the requester busy
+    return tcu.regs().getActiveSlot() == -1 &&
+           tcu.regs().getCommand().opcode == CmdCommand::IDLE &&
+           !cmdFinish && !extCmdFinish && !abortCmdPending &&
+           cmdQueue.empty() && !cmdDeferred && !nextCmdEvent.scheduled();
+}
+
+void
+TcuCommands::finishAtomic()
+{
+    while (atomicFinish)
+    {
+        atomicFinish = false;
+        // SEND and REPLY need another step, which records the next finish
+        finishCommand(atomicError);
+
+        if (!atomicFinish && (cmdDeferred || !cmdQueue.empty()))
+            startNextCommand();
+    }
 }
 
 void
@@ -358,10 +620,17 @@ TcuCommands::executePrivCommand(PacketPtr pkt)
                 if (!tcu.tlb()->remove(virt, asid))
                     res = TcuError::TLB_MISS;
             }
+            // the page tables have changed
+            if (tcu.walker())
+                tcu.walker()->flush();
+            tcu.memUnit->invalidatePage();
             break;
         case PrivCommand::INV_TLB:
             if (tcu.tlb())
                 tcu.tlb()->clear();
+            if (tcu.walker())
+                tcu.walker()->flush();
+            tcu.memUnit->invalidatePage();
             break;
         case PrivCommand::INS_TLB:
             if (tcu.tlb())
@@ -387,6 +656,7 @@ TcuCommands::executePrivCommand(PacketPtr pkt)
         case PrivCommand::ABORT_CMD:
             privCmdPkt = pkt;
             pkt = nullptr;
+            abortCmdPending = true;
             abortCommand();
             return;
         default:
@@ -410,10 +680,13 @@ TcuCommands::executePrivCommand(PacketPtr pkt)
 void
 TcuCommands::finishAbort()
 {
-    if (privCmdPkt != nullptr)
+    if (abortCmdPending)
     {
-        tcu.schedCpuResponse(privCmdPkt, tcu.clockEdge(Cycles(1)));
+        // there is no packet in atomic mode
+        if (privCmdPkt != nullptr)
+            tcu.schedCpuResponse(privCmdPkt, tcu.clockEdge(Cycles(1)));
         privCmdPkt = nullptr;
+        abortCmdPending = false;
 
         PrivCommand::Bits cmd = tcu.regs().get(PrivReg::PRIV_CMD);
         cmd.arg0 = static_cast<RegFile::reg_t>(abort);
@@ -473,8 +746,10 @@ TcuCommands::finishExtCommand(TcuError error, RegFile::reg_t arg)
     cmd.error = static_cast<uint>(error);
     tcu.regs().set(ExtReg::EXT_CMD, cmd);
 
-    assert(extCmdPkt != nullptr);
-    tcu.schedNocResponse(extCmdPkt, tcu.clockEdge(Cycles(1)));
+    // there is no packet in atomic mode
+    assert(extCmdPkt != nullptr || tcu.atomicMode());
+    if (extCmdPkt != nullptr)
+        tcu.schedNocResponse(extCmdPkt, tcu.clockEdge(Cycles(1)));
     extCmdPkt = nullptr;
     extCmdFinish = nullptr;
 }
@@ -489,7 +764,12 @@ TcuCommands::scheduleExtCmdFinish(Cycles delay, TcuError error,
         delete extCmdFinish;
     }
 
-    if (delay == 0)
+    if (tcu.atomicMode())
+    {
+        tcu.chargeAtomic(tcu.cyclesToTicks(delay));
+        finishExtCommand(error, arg);
+    }
+    else if (delay == 0)
         finishExtCommand(error, arg);
     else
     {
@@ -31,6 +31,8 @@
 #ifndef __MEM_TCU_CMDS_HH__
 #define __MEM_TCU_CMDS_HH__
 
+#include <list>
+
 #include "mem/tcu/base.hh"
 #include "mem/tcu/error.hh"
 
@@ -63,9 +65,22 @@ class TcuCommands
 
     void scheduleExtCmdFinish(Cycles delay, TcuError error, RegFile::reg_t arg);
 
+    /**
+     * Finishes the commands that have completed during the current atomic
+     * request (and starts queued commands, if any).
+     */
+    void finishAtomic();
+
     void setRemoteCommand(bool remote)
     {
-        cmdIsRemote = remote;
+        // READ and WRITE can have multiple NoC requests in flight
+        if (remote)
+            cmdRemoteReqs++;
+        else
+        {
+            assert(cmdRemoteReqs > 0);
+            cmdRemoteReqs--;
+        }
     }
 
     bool isCommandAborting() const
@@ -73,9 +88,26 @@ class TcuCommands
         return abort != AbortType::NONE;
     }
 
+    /// whether no command is running or waiting for execution
+    bool isIdle() const;
+
   private:
 
-    void executeCommand(PacketPtr pkt);
+    void enqueueCommands();
+
+    void startNextCommand();
+
+    void nextCommand();
+
+    void finishQueuedCommand(unsigned slot, TcuError error);
+
+    void abortQueuedCommands();
+
+    void abortDeferredCommand();
+
+    void waitForCommand();
+
+    void executeCommand(PacketPtr pkt, bool waiting = false);
 
     void abortCommand();
 
@@ -119,6 +151,21 @@ class TcuCommands
         const char* description() const override { return "ExecCmdEvent"; }
     };
 
+    struct EnqueueCmdEvent : public CmdEvent
+    {
+        EnqueueCmdEvent(TcuCommands& _cmds)
+            : CmdEvent(_cmds)
+        {}
+
+        void process() override
+        {
+            cmds.enqueueCommands();
+            setFlags(AutoDelete);
+        }
+
+        const char* description() const override { return "EnqueueCmdEvent"; }
+    };
+
     struct ExecPrivCmdEvent : public CmdEvent
     {
         PacketPtr pkt;
@@ -200,13 +247,29 @@ class TcuCommands
     FinishCommandEvent *cmdFinish;
     FinishExtCommandEvent *extCmdFinish;
     AbortType abort;
-    bool cmdIsRemote;
+    bool abortCmdPending;
+    unsigned cmdRemoteReqs;
+
+    // the command that has completed during an atomic request
+    bool atomicFinish;
+    TcuError atomicError;
+
+    // the queue slots that wait for execution (in order). they are executed
+    // one after another, because the units support a single command only.
+    std::list<unsigned> cmdQueue;
+    // a command of the core that arrived while a queued command was running
+    PacketPtr deferredCmdPkt;
+    bool cmdDeferred;
+
+    EventWrapper<TcuCommands, &TcuCommands::nextCommand> nextCmdEvent;
 
   public:
 
     Stats::Vector commands;
     Stats::Vector privCommands;
     Stats::Vector extCommands;
+    Stats::Scalar queuedCommands;
+    Stats::Scalar deferredCommands;
 
 };
 
@@ -38,6 +38,7 @@ TcuConnector::TcuConnector(Tcu &_tcu, BaseConnector *_connector)
       connector(_connector),
       sleepEPs(tcu.eps().newCache()),
       wakeupEp(0xFFFF),
+      sleeping(),
       fireTimerEvent(*this)
 {
     connector->setTcu(&tcu);
@@ -64,7 +65,9 @@ TcuConnector::startWaitEP(const CmdCommand::Bits &cmd)
 
     if (ep == Tcu::INVALID_EP_ID)
     {
-        if (tcu.regs().getAct(PrivReg::CUR_ACT).msgs > 0)
+        // finished queued commands count as events as well
+        if (tcu.regs().getAct(PrivReg::CUR_ACT).msgs > 0 ||
+            tcu.regs().get(QueueReg::COMPLETED) != 0)
         {
             tcu.scheduleCmdFinish(Cycles(1), TcuError::NONE);
             return;
@@ -102,6 +105,7 @@ TcuConnector::startSleep(epid_t ep)
         return false;
 
     wakeupEp = ep;
+    sleeping = true;
     DPRINTF(TcuConnector, "Suspending CU (waiting for EP %d)\n", wakeupEp);
     connector->suspend();
 
@@ -111,6 +115,7 @@ TcuConnector::startSleep(epid_t ep)
 void
 TcuConnector::stopSleep()
 {
+    sleeping = false;
     connector->wakeup();
 }
 
@@ -124,7 +129,10 @@ TcuConnector::wakeupCore(bool force, epid_t rep)
         if (tcu.regs().getCommand().opcode == CmdCommand::SLEEP)
             tcu.scheduleCmdFinish(Cycles(0));
         else
+        {
+            sleeping = false;
             connector->wakeup();
+        }
     }
 }
 
@@ -161,3 +169,22 @@ TcuConnector::restartTimer(uint64_t nanos)
         tcu.schedule(&fireTimerEvent, tcu.clockEdge(sleep_time));
     }
 }
+
+void
+TcuConnector::serialize(CheckpointOut &cp) const
+{
+    // the core never sleeps when we are drained (see Tcu::isDrained)
+    assert(!sleeping);
+
+    SERIALIZE_SCALAR(wakeupEp);
+    SERIALIZE_EVENT(fireTimerEvent);
+}
+
+void
+TcuConnector::unserialize(CheckpointIn &cp)
+{
+    UNSERIALIZE_SCALAR(wakeupEp);
+
+    fireTimerEvent.unserializeSection(cp, "fireTimerEvent");
+    tcu.eventQueue()->checkpointReschedule(&fireTimerEvent);
+}
@@ -37,7 +37,7 @@
 
 class Tcu;
 
-class TcuConnector
+class TcuConnector : public Serializable
 {
   public:
 
@@ -69,6 +69,13 @@ class TcuConnector
 
     void restartTimer(uint64_t nanos);
 
+    /// whether the core has been suspended by startSleep
+    bool isSleeping() const { return sleeping; }
+
+    void serialize(CheckpointOut &cp) const override;
+
+    void unserialize(CheckpointIn &cp) override;
+
   private:
 
     Tcu &tcu;
@@ -79,6 +86,8 @@ class TcuConnector
 
     int wakeupEp;
 
+    bool sleeping;
+
     EventWrapper<TcuConnector, &TcuConnector::fireTimer> fireTimerEvent;
 
   public:
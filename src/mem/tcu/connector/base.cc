@@ -62,3 +62,25 @@ BaseConnector::startIrq(IRQ irq)
     _tcu->regs().set(PrivReg::CLEAR_IRQ, irq);
     doSetIrq(irq);
 }
+
+void
+BaseConnector::serialize(CheckpointOut &cp) const
+{
+    // the first IRQ has already been injected into the core, which
+    // checkpoints it on its own
+    std::vector<int> pending;
+    for (auto q = _pending; !q.empty(); q.pop())
+        pending.push_back(q.front());
+    SERIALIZE_CONTAINER(pending);
+}
+
+void
+BaseConnector::unserialize(CheckpointIn &cp)
+{
+    std::vector<int> pending;
+    UNSERIALIZE_CONTAINER(pending);
+
+    _pending = std::queue<IRQ>();
+    for (int irq : pending)
+        _pending.push(static_cast<IRQ>(irq));
+}
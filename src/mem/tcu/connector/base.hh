@@ -78,6 +78,9 @@ class BaseConnector : public ClockedObject
     void setIrq(IRQ irq);
     void clearIrq(IRQ irq);
 
+    void serialize(CheckpointOut &cp) const override;
+    void unserialize(CheckpointIn &cp) override;
+
   private:
 
     void startIrq(IRQ irq);
@@ -74,7 +74,18 @@ X86Connector::IrqMasterPort::recvReqRetry()
 {
     assert(pending);
     if (sendTimingReq(pending))
+    {
         pending = nullptr;
+        if (con.drainState() == DrainState::Draining)
+            con.signalDrainDone();
+    }
+}
+
+DrainState
+X86Connector::drain()
+{
+    // the IRQ needs to reach the core before we can checkpoint
+    return irqPort.isBlocked() ? DrainState::Draining : DrainState::Drained;
 }
 
 void
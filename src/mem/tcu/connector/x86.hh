@@ -55,6 +55,8 @@ class X86Connector : public CoreConnector
 
         bool sendPacket(PacketPtr pkt);
 
+        bool isBlocked() const { return pending != nullptr; }
+
       protected:
         bool recvTimingResp(PacketPtr pkt) override;
 
@@ -67,6 +69,8 @@ class X86Connector : public CoreConnector
 
     Port& getPort(const std::string &n, PortID idx) override;
 
+    DrainState drain() override;
+
   private:
 
     void doSetIrq(IRQ irq) override;
@@ -169,3 +169,54 @@ CoreRequests::nextId() const
             return id;
     }
 }
+
+void
+CoreRequests::serialize(CheckpointOut &cp) const
+{
+    // foreign receives are the only requests so far
+    std::vector<size_t> ids;
+    std::vector<epid_t> eps;
+    std::vector<actid_t> acts;
+    std::vector<bool> waiting;
+    for (auto r : reqs)
+    {
+        auto freq = static_cast<ForeignRecvRequest*>(r);
+        ids.push_back(freq->id);
+        eps.push_back(freq->epId);
+        acts.push_back(freq->actId);
+        waiting.push_back(freq->waiting);
+    }
+
+    SERIALIZE_CONTAINER(ids);
+    SERIALIZE_CONTAINER(eps);
+    SERIALIZE_CONTAINER(acts);
+    SERIALIZE_CONTAINER(waiting);
+}
+
+void
+CoreRequests::unserialize(CheckpointIn &cp)
+{
+    std::vector<size_t> ids;
+    std::vector<epid_t> eps;
+    std::vector<actid_t> acts;
+    std::vector<bool> waiting;
+    UNSERIALIZE_CONTAINER(ids);
+    UNSERIALIZE_CONTAINER(eps);
+    UNSERIALIZE_CONTAINER(acts);
+    UNSERIALIZE_CONTAINER(waiting);
+
+    for (auto r : reqs)
+        delete r;
+    reqs.clear();
+
+    // nothing needs to be restarted: the started request is in the CORE_REQ
+    // register and its IRQ is pending in the connector
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        auto req = new ForeignRecvRequest(ids[i], *this);
+        req->epId = eps[i];
+        req->actId = acts[i];
+        req->waiting = waiting[i];
+        reqs.push_back(req);
+    }
+}
@@ -37,7 +37,7 @@
 
 class Tcu;
 
-class CoreRequests
+class CoreRequests : public Serializable
 {
   public:
 
@@ -84,6 +84,10 @@ class CoreRequests
 
     void abortReq(size_t id);
 
+    void serialize(CheckpointOut &cp) const override;
+
+    void unserialize(CheckpointIn &cp) override;
+
   private:
 
     void startNextReq();
@@ -32,8 +32,8 @@
 #include "mem/tcu/tcu.hh"
 
 EpFile::EpCache::EpCache(EpFile &_epfile)
-    : state(FETCH), autoFinish(), pending(), func(),
-      cachedEps(), epfile(_epfile)
+    : state(FETCH), autoFinish(), atomicRunning(), atomicPending(),
+      pending(), func(), cachedEps(), epfile(_epfile)
 {}
 
 void EpFile::EpCache::addEp(epid_t ep)
@@ -45,7 +45,7 @@ void EpFile::EpCache::addEp(epid_t ep)
 Ep
 EpFile::EpCache::getEp(epid_t ep)
 {
-    assert(epfile.lock == this);
+    assert(epfile.isLocked(ep, this));
     return cachedEps[ep].ep;
 }
 
@@ -57,7 +57,7 @@ EpFile::EpCache::onFetched(std::function<void (EpCache&)> _func,
     autoFinish = _autoFinish;
     pending++;
 
-    epfile.tcu.schedule(this, epfile.tcu.clockEdge(Cycles(1)));
+    trigger();
 }
 
 void
@@ -67,7 +67,49 @@ EpFile::EpCache::onFinished(std::function<void (EpCache&)> _func)
     autoFinish = false;
     state = WRITEBACK;
 
-    epfile.tcu.schedule(this, epfile.tcu.clockEdge(Cycles(1)));
+    trigger();
+}
+
+void
+EpFile::EpCache::trigger()
+{
+    if (epfile.tcu.atomicMode())
+    {
+        epfile.tcu.chargeAtomic(epfile.tcu.clockPeriod());
+        runAtomic();
+    }
+    else
+        epfile.tcu.schedule(this, epfile.tcu.clockEdge(Cycles(1)));
+}
+
+void
+EpFile::EpCache::runAtomic()
+{
+    // requests from our own callback are handled as soon as it returned, as
+    // if we had scheduled the event
+    if (atomicRunning)
+    {
+        atomicPending = true;
+        return;
+    }
+
+    atomicRunning = true;
+    do
+    {
+        atomicPending = false;
+
+        // the callback of the writeback might delete us
+        if (state == WRITEBACK)
+        {
+            atomicRunning = false;
+            process();
+            return;
+        }
+
+        process();
+    }
+    while (atomicPending);
+    atomicRunning = false;
 }
 
 void
@@ -77,11 +119,11 @@ EpFile::EpCache::finish()
     for(auto it = cachedEps.begin(); it != cachedEps.end(); ++it)
         assert(!it->second.dirty);
 
+    epfile.releaseLock(this);
+
     cachedEps.clear();
     pending = 0;
     state = FETCH;
-
-    epfile.releaseLock(this);
 }
 
 void
@@ -89,7 +131,6 @@ EpFile::EpCache::process()
 {
     if (state == WRITEBACK)
     {
-        assert(epfile.lock == this);
 
         // writeback all EPs that were changed
         for(auto it = cachedEps.begin(); it != cachedEps.end(); ++it)
@@ -110,14 +151,17 @@ EpFile::EpCache::process()
     }
     else
     {
-        // we need to take a lock while holding the EPs, because otherwise
+        // we need to lock the EPs while holding them, because otherwise
         // message receptions could interfere with each other and with an
-        // ongoing command.
+        // ongoing command. if that's not possible, we are woken up as soon
+        // as the EPs are released.
         if (!epfile.takeLock(this))
         {
+            // in atomic mode, the owner is further up in the call chain
+            panic_if(epfile.tcu.atomicMode(),
+                     "cache[%#x]: EPs are in use by an outer request\n", this);
             DPRINTFS(TcuEps, (&epfile),
                      "cache[%#x]: unable to take lock\n", this);
-            epfile.tcu.schedule(this, epfile.tcu.clockEdge(Cycles(1)));
             return;
         }
 
@@ -144,7 +188,7 @@ EpFile::EpCache::process()
 }
 
 EpFile::EpFile(Tcu &_tcu)
-    : tcu(_tcu), lock()
+    : tcu(_tcu), locks(), waiting()
 {}
 
 const std::string EpFile::name() const
@@ -152,13 +196,58 @@ const std::string EpFile::name() const
     return tcu.name() + ".eps";
 }
 
+bool
+EpFile::isLocked(epid_t ep, const EpCache *cache) const
+{
+    auto it = locks.find(ep);
+    return it != locks.end() && it->second == cache;
+}
+
+bool
+EpFile::canLock(const EpCache *cache,
+                std::list<EpCache*>::const_iterator end) const
+{
+    bool holding = false;
+    for (auto &cached : cache->cachedEps)
+    {
+        auto it = locks.find(cached.first);
+        if (it != locks.end() && it->second != cache)
+            return false;
+        if (it != locks.end())
+            holding = true;
+    }
+
+    // caches that already hold EPs (e.g., to lock a reply EP in addition)
+    // take precedence, because older waiters might wait for their EPs.
+    if (holding)
+        return true;
+
+    // otherwise, the EPs are reserved for the waiters that arrived before,
+    // so that they are not starved by younger caches
+    for (auto w = waiting.cbegin(); w != end; ++w)
+    {
+        for (auto &cached : cache->cachedEps)
+        {
+            if ((*w)->hasEp(cached.first))
+                return false;
+        }
+    }
+    return true;
+}
+
 bool
 EpFile::takeLock(EpCache *cache)
 {
-    if (lock && lock != cache)
+    // we take either all EPs or none to prevent deadlocks
+    if (!canLock(cache, waiting.cend()))
+    {
+        waiting.push_back(cache);
         return false;
+    }
+
     DPRINTF(TcuEps, "cache[%#x]: taking lock\n", cache);
-    lock = cache;
+    for (auto &cached : cache->cachedEps)
+        locks[cached.first] = cache;
     return true;
 }
 
@@ -166,8 +255,28 @@ void
 EpFile::releaseLock(EpCache *cache)
 {
     DPRINTF(TcuEps, "cache[%#x]: freeing lock\n", cache);
-    assert(lock == cache);
-    lock = nullptr;
+    for (auto &cached : cache->cachedEps)
+    {
+        assert(isLocked(cached.first, cache));
+        locks.erase(cached.first);
+    }
+
+    // wake up the waiting caches whose EPs are available now, in the order
+    // of their arrival
+    for (auto it = waiting.begin(); it != waiting.end(); )
+    {
+        EpCache *waiter = *it;
+        if (canLock(waiter, it))
+        {
+            DPRINTF(TcuEps, "cache[%#x]: waking up\n", waiter);
+            for (auto &cached : waiter->cachedEps)
+                locks[cached.first] = waiter;
+            tcu.schedule(waiter, tcu.clockEdge(Cycles(1)));
+            it = waiting.erase(it);
+        }
+        else
+            ++it;
+    }
 }
 
 EpFile::EpCache
@@ -34,6 +34,7 @@
 #include "mem/tcu/xfer_unit.hh"
 
 #include <functional>
+#include <list>
 #include <map>
 #include <vector>
 
@@ -45,6 +46,8 @@ class EpFile
 
     class EpCache : public Event
     {
+        friend class EpFile;
+
         struct CachedEp
         {
             Ep ep;
@@ -65,12 +68,17 @@ class EpFile
 
         void addEp(epid_t ep);
 
+        bool hasEp(epid_t ep) const
+        {
+            return cachedEps.find(ep) != cachedEps.end();
+        }
+
         Ep getEp(epid_t ep);
 
         template<class T>
         void updateEp(const T &ep)
         {
-            assert(epfile.lock == this);
+            assert(epfile.isLocked(ep.id, this));
             CachedEp &old = cachedEps[ep.id];
             old.ep.inval.id = ep.id;
             old.ep.inval.r[0] = ep.r0;
@@ -90,6 +98,10 @@ class EpFile
 
       private:
 
+        void trigger();
+
+        void runAtomic();
+
         void process() override;
 
         const char* description() const override { return "EpCacheEvent"; }
@@ -98,6 +110,11 @@ class EpFile
 
         bool autoFinish;
 
+        // whether we are processing synchronously (atomic mode) and whether
+        // another request has arrived in the meantime
+        bool atomicRunning;
+        bool atomicPending;
+
         int pending;
 
         std::function<void (EpCache&)> func;
@@ -115,13 +132,22 @@ class EpFile
 
   private:
 
+    bool isLocked(epid_t ep, const EpCache *cache) const;
+
+    bool canLock(const EpCache *cache,
+                 std::list<EpCache*>::const_iterator end) const;
+
     bool takeLock(EpCache *cache);
 
     void releaseLock(EpCache *cache);
 
     Tcu &tcu;
 
-    EpCache *lock;
+    // the owner of each locked EP
+    std::map<epid_t, EpCache*> locks;
+
+    // the caches waiting for EPs, in the order of arrival
+    std::list<EpCache*> waiting;
 };
 
 #endif // __MEM_TCU_EP_FILE_HH__
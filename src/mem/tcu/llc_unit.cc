@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#include "debug/TcuLLCMemAcc.hh"
+#include "mem/tcu/llc_unit.hh"
+#include "mem/tcu/tcu.hh"
+
+LLCUnit::LLCUnit(Tcu &_tcu, unsigned _mshrCount, Cycles _combineLatency)
+    : tcu(_tcu),
+      mshrCount(_mshrCount),
+      combineLatency(_combineLatency),
+      mshrs(),
+      blocked(),
+      wb(),
+      wbInFlight(),
+      flushEvent(*this),
+      retryEvent(*this)
+{
+}
+
+const std::string
+LLCUnit::name() const
+{
+    return tcu.name() + ".llc";
+}
+
+void
+LLCUnit::regStats()
+{
+    occupancy
+        .init(mshrCount > 0 ? mshrCount : 16)
+        .name(tcu.name() + ".llc.occupancy")
+        .desc("Occupied MSHRs when allocating a new one")
+        .flags(Stats::nozero);
+    coalescedMisses
+        .name(tcu.name() + ".llc.coalescedMisses")
+        .desc("Number of misses coalesced with an outstanding fill")
+        .flags(Stats::nozero);
+    mshrRejects
+        .name(tcu.name() + ".llc.mshrRejects")
+        .desc("Number of misses rejected due to missing MSHRs")
+        .flags(Stats::nozero);
+    combinedWritebacks
+        .name(tcu.name() + ".llc.combinedWritebacks")
+        .desc("Number of writebacks combined with a previous one")
+        .flags(Stats::nozero);
+    writebackSizes
+        .init(8)
+        .name(tcu.name() + ".llc.writebackSizes")
+        .desc("Size of the writes sent for writebacks (in bytes)")
+        .flags(Stats::nozero);
+}
+
+Addr
+LLCUnit::blockAddr(Addr addr) const
+{
+    return addr & ~static_cast<Addr>(tcu.blockSize - 1);
+}
+
+bool
+LLCUnit::canAccept(PacketPtr pkt)
+{
+    if (!pkt->isRead() || !pkt->needsResponse())
+        return true;
+    if (mshrCount == 0 || mshrs.size() < mshrCount ||
+        mshrs.find(blockAddr(pkt->getAddr())) != mshrs.end())
+        return true;
+
+    DPRINTF(TcuLLCMemAcc, "No free MSHR for %s request @ %#x\n",
+            pkt->cmdString(), pkt->getAddr());
+
+    mshrRejects++;
+    blocked = true;
+    return false;
+}
+
+bool
+LLCUnit::handleRequest(PacketPtr pkt, NocAddr noc)
+{
+    // combine writebacks (which need no response) with adjacent ones
+    if (combineLatency > 0 && pkt->isWrite() && !pkt->needsResponse())
+    {
+        Addr size = pkt->getSize();
+        bool append = !wb.pkts.empty() &&
+                      noc.tileId == wb.start.tileId &&
+                      noc.offset == wb.start.offset + wb.size;
+        bool prepend = !wb.pkts.empty() &&
+                       noc.tileId == wb.start.tileId &&
+                       noc.offset + size == wb.start.offset;
+        if ((!append && !prepend) || wb.size + size > tcu.maxNocPacketSize)
+            flushWritebacks();
+
+        DPRINTF(TcuLLCMemAcc, "Holding back writeback for %#x (%d:%#x)\n",
+                pkt->getAddr(), noc.tileId, noc.offset);
+
+        if (wb.pkts.empty())
+        {
+            wb.start = noc;
+            wb.size = 0;
+            tcu.schedule(flushEvent, tcu.clockEdge(combineLatency));
+        }
+        else
+            combinedWritebacks++;
+
+        if (prepend && !append)
+        {
+            wb.start = noc;
+            wb.pkts.push_front(pkt);
+        }
+        else
+            wb.pkts.push_back(pkt);
+        wb.size += size;
+
+        if (wb.size == tcu.maxNocPacketSize)
+            flushWritebacks();
+        return true;
+    }
+
+    // all other requests must not overtake held back writebacks
+    if (overlapsWritebacks(noc, pkt->getSize()))
+        flushWritebacks();
+
+    if (!pkt->isRead() || !pkt->needsResponse())
+        return false;
+
+    Addr block = blockAddr(pkt->getAddr());
+    auto mshr = mshrs.find(block);
+    if (mshr == mshrs.end())
+    {
+        assert(mshrCount == 0 || mshrs.size() < mshrCount);
+        Mshr &fill = mshrs[block];
+        fill.pkt = pkt;
+        fill.addr = pkt->getAddr();
+        fill.size = pkt->getSize();
+        occupancy.sample(mshrs.size());
+        return false;
+    }
+
+    // coalesce it with the outstanding fill if that covers it
+    const Mshr &fill = mshr->second;
+    if (pkt->getAddr() < fill.addr ||
+        pkt->getAddr() + pkt->getSize() > fill.addr + fill.size)
+        return false;
+
+    DPRINTF(TcuLLCMemAcc, "Coalescing %s request @ %#x with fill @ %#x\n",
+            pkt->cmdString(), pkt->getAddr(), fill.addr);
+
+    coalescedMisses++;
+    mshr->second.targets.push_back(pkt);
+    return true;
+}
+
+bool
+LLCUnit::overlapsWritebacks(NocAddr noc, Addr size) const
+{
+    return !wb.pkts.empty() &&
+           noc.tileId == wb.start.tileId &&
+           noc.offset < wb.start.offset + wb.size &&
+           noc.offset + size > wb.start.offset;
+}
+
+void
+LLCUnit::flushWritebacks()
+{
+    if (flushEvent.scheduled())
+        tcu.deschedule(flushEvent);
+    if (wb.pkts.empty())
+        return;
+
+    writebackSizes.sample(wb.size);
+
+    // a single writeback is sent as is
+    if (wb.pkts.size() == 1)
+    {
+        PacketPtr pkt = wb.pkts.front();
+        wb.pkts.clear();
+        tcu.sendLLCRequest(pkt, wb.start, false);
+        return;
+    }
+
+    DPRINTF(TcuLLCMemAcc, "Sending %lu combined writebacks to %d:%#x (%lu)\n",
+            wb.pkts.size(), wb.start.tileId, wb.start.offset, wb.size);
+
+    auto pkt = tcu.generateRequest(wb.start.getAddr(), wb.size,
+                                   MemCmd::WriteReq);
+    Addr off = 0;
+    for (auto wbpkt : wb.pkts)
+    {
+        memcpy(pkt->getPtr<uint8_t>() + off, wbpkt->getConstPtr<uint8_t>(),
+               wbpkt->getSize());
+        off += wbpkt->getSize();
+        // we are the final receiver of the writeback
+        delete wbpkt;
+    }
+    wb.pkts.clear();
+
+    tcu.printPacket(pkt);
+
+    // in contrast to the writebacks, we want to get a response to free the
+    // packet again
+    wbInFlight.insert(pkt);
+    tcu.sendNocRequest(Tcu::NocPacketType::CACHE_MEM_REQ, pkt, Cycles(1));
+}
+
+bool
+LLCUnit::finishWriteback(PacketPtr pkt)
+{
+    if (wbInFlight.erase(pkt) == 0)
+        return false;
+
+    tcu.freeRequest(pkt);
+    return true;
+}
+
+void
+LLCUnit::finishFill(PacketPtr pkt)
+{
+    auto mshr = mshrs.find(blockAddr(pkt->getAddr()));
+    if (mshr == mshrs.end() || mshr->second.pkt != pkt)
+        return;
+
+    for (auto target : mshr->second.targets)
+    {
+        DPRINTF(TcuLLCMemAcc, "Finished coalesced %s request @ %#x\n",
+                target->cmdString(), target->getAddr());
+
+        target->makeResponse();
+        Addr off = target->getAddr() - mshr->second.addr;
+        memcpy(target->getPtr<uint8_t>(),
+               pkt->getConstPtr<uint8_t>() + off,
+               target->getSize());
+        tcu.schedLLCResponse(target, true);
+    }
+
+    mshrs.erase(mshr);
+
+    if (blocked && !retryEvent.scheduled())
+        tcu.schedule(retryEvent, tcu.clockEdge(Cycles(1)));
+}
+
+void
+LLCUnit::retry()
+{
+    blocked = false;
+    tcu.sendLLCRetry();
+}
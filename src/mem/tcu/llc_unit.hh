@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#ifndef __MEM_TCU_LLC_UNIT_HH__
+#define __MEM_TCU_LLC_UNIT_HH__
+
+#include "mem/tcu/noc_addr.hh"
+#include "mem/packet.hh"
+#include "sim/eventq.hh"
+#include "sim/stats.hh"
+
+#include <deque>
+#include <map>
+#include <unordered_set>
+#include <vector>
+
+class Tcu;
+
+/**
+ * Tracks the timing requests of the LLC to the memory tiles. Concurrent
+ * misses to the same block are coalesced in MSHRs, so that only the first
+ * one is sent over the NoC and the others are answered with its data. If
+ * the number of MSHRs is limited, further misses are rejected until an MSHR
+ * is free again.
+ *
+ * Optionally, writebacks are held back for a few cycles to combine them
+ * with writebacks to adjacent blocks into a single write of up to
+ * max_noc_packet_size bytes. Requests that overlap with held back
+ * writebacks flush them first.
+ */
+class LLCUnit
+{
+  public:
+
+    LLCUnit(Tcu &_tcu, unsigned _mshrCount, Cycles _combineLatency);
+
+    const std::string name() const;
+
+    void regStats();
+
+    /**
+     * Returns whether the given timing request can be accepted now.
+     * Otherwise, the LLC is asked to retry as soon as an MSHR is free.
+     */
+    bool canAccept(PacketPtr pkt);
+
+    /**
+     * Handles the timing request <pkt>, whose physical address has been
+     * translated to <noc>. Returns true if the request has been consumed;
+     * otherwise, it has to be sent to the memory tile.
+     */
+    bool handleRequest(PacketPtr pkt, NocAddr noc);
+
+    /**
+     * Returns true if <pkt> is the response for combined writebacks, which
+     * is not forwarded to the LLC.
+     */
+    bool finishWriteback(PacketPtr pkt);
+
+    /**
+     * Answers all misses that have been coalesced with the fill <pkt>
+     * (with the physical address restored) and frees its MSHR.
+     */
+    void finishFill(PacketPtr pkt);
+
+    bool isIdle() const
+    {
+        return mshrs.empty() && wb.pkts.empty() && wbInFlight.empty();
+    }
+
+  private:
+
+    struct Mshr
+    {
+        // the miss that has been sent over the NoC and its physical range
+        PacketPtr pkt;
+        Addr addr;
+        Addr size;
+        // the misses waiting for its data
+        std::vector<PacketPtr> targets;
+    };
+
+    Addr blockAddr(Addr addr) const;
+
+    bool overlapsWritebacks(NocAddr noc, Addr size) const;
+
+    void flushWritebacks();
+
+    void retry();
+
+    Tcu &tcu;
+
+    // the maximum number of outstanding fills (0 = unlimited)
+    const unsigned mshrCount;
+    const Cycles combineLatency;
+
+    // the outstanding fills by physical block address
+    std::map<Addr, Mshr> mshrs;
+    // whether we rejected a request due to missing MSHRs
+    bool blocked;
+
+    // the held back writebacks, ordered by address
+    struct
+    {
+        NocAddr start;
+        Addr size;
+        std::deque<PacketPtr> pkts;
+    } wb;
+
+    // combined writebacks that have been sent over the NoC
+    std::unordered_set<PacketPtr> wbInFlight;
+
+    EventWrapper<LLCUnit, &LLCUnit::flushWritebacks> flushEvent;
+    EventWrapper<LLCUnit, &LLCUnit::retry> retryEvent;
+
+    Stats::Histogram occupancy;
+    Stats::Scalar coalescedMisses;
+    Stats::Scalar mshrRejects;
+    Stats::Scalar combinedWritebacks;
+    Stats::Histogram writebackSizes;
+};
+
+#endif
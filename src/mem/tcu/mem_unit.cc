@@ -29,21 +29,28 @@
  * policies, either expressed or implied, of the FreeBSD Project.
  */
 
+#include "base/amo.hh"
 #include "debug/Tcu.hh"
 #include "debug/TcuBuf.hh"
 #include "debug/TcuPackets.hh"
 #include "mem/tcu/mem_unit.hh"
+#include "mem/tcu/msg_unit.hh"
 #include "mem/tcu/xfer_unit.hh"
 #include "mem/tcu/noc_addr.hh"
+#include "mem/tcu/pt_unit.hh"
 
 static void
-finishReadWrite(Tcu &tcu, Addr size)
+finishReadWrite(Tcu &tcu, Addr size, bool sg = false)
 {
-    // change data register accordingly
-    CmdData::Bits data = tcu.regs().getData();
-    data.size = data.size - size;
-    data.addr = data.addr + size;
-    tcu.regs().setData(data);
+    // change data register accordingly. in scatter-gather mode, it refers to
+    // the descriptors, which are advanced as a whole.
+    if (!sg)
+    {
+        CmdData::Bits data = tcu.regs().getData();
+        data.size = data.size - size;
+        data.addr = data.addr + size;
+        tcu.regs().setData(data);
+    }
 
     // change offset
     Addr offset = tcu.regs().get(UnprivReg::ARG1);
@@ -73,6 +80,24 @@ MemoryUnit::regStats()
         .name(tcu.name() + ".mem.wrongAct")
         .desc("Number of received requests that targeted the wrong activity")
         .flags(Stats::nozero);
+    packetsInFlight
+        .init(tcu.nocReqCount)
+        .name(tcu.name() + ".mem.packetsInFlight")
+        .desc("Read/write packets in flight when sending a new one")
+        .flags(Stats::nozero);
+    atomicOps
+        .name(tcu.name() + ".mem.atomicOps")
+        .desc("Sent atomic requests")
+        .flags(Stats::nozero);
+    copies
+        .name(tcu.name() + ".mem.copies")
+        .desc("Sent copy requests")
+        .flags(Stats::nozero);
+    copiedBytes
+        .init(8)
+        .name(tcu.name() + ".mem.copiedBytes")
+        .desc("Bytes sent on behalf of copy requests")
+        .flags(Stats::nozero);
 }
 
 void
@@ -111,46 +136,522 @@ MemoryUnit::startReadWithEP(EpFile::EpCache &eps)
                                  "EP%u: no permission\n", cmd.epid);
     }
 
+    startTransfer(mep, false, delay);
+}
+
+void
+MemoryUnit::startTransfer(const MemEp &mep, bool write, Cycles delay)
+{
+    CmdCommand::Bits cmd = tcu.regs().getCommand();
     CmdData::Bits data = tcu.regs().getData();
     Addr offset = tcu.regs().get(UnprivReg::ARG1);
-    Addr size = std::min(static_cast<Addr>(data.size), tcu.maxNocPacketSize);
 
-    if(size == 0)
+    xfer.write = write;
+    xfer.sg = cmd.arg0 & CmdCommand::SCATTER_GATHER;
+    xfer.epid = cmd.epid;
+    xfer.base = NocAddr(mep.r0.targetTile, mep.r1.remoteAddr);
+    xfer.baseSize = mep.r2.remoteSize;
+    xfer.error = TcuError::NONE;
+    // no page translated yet
+    invalidatePage();
+
+    if (xfer.sg)
+    {
+        if (data.addr % sizeof(SgDesc))
+        {
+            return tcu.schedCmdError(delay, TcuError::MEM_UNALIGNED,
+                                     "EP%u: unaligned descriptors at %#lx\n",
+                                     cmd.epid, data.addr);
+        }
+
+        if (tcu.atomicMode())
+            transferSgAtomic(delay);
+        else
+            fetchDescriptor(delay);
+        return;
+    }
+
+    if(data.size == 0)
     {
         tcu.scheduleCmdFinish(delay, TcuError::NONE);
         return;
     }
 
-    if(size + offset < size || size + offset > mep.r2.remoteSize)
+    if(!setupTransfer(data.addr, offset, data.size))
     {
         return tcu.schedCmdError(delay, TcuError::OUT_OF_BOUNDS,
                                  "EP%u: out of bounds\n", cmd.epid);
     }
 
-    auto data_page = data.addr & ~static_cast<Addr>(TcuTlb::PAGE_MASK);
-    if(data_page !=
-       ((data.addr + size - 1) & ~static_cast<Addr>(TcuTlb::PAGE_MASK)))
+    if (tcu.atomicMode())
+        tcu.scheduleCmdFinish(transferAtomic(delay), xfer.error);
+    else
+        sendPackets(delay);
+}
+
+bool
+MemoryUnit::setupTransfer(Addr local, Addr offset, Addr size)
+{
+    if(size + offset < size || size + offset > xfer.baseSize)
+        return false;
+
+    xfer.local = local;
+    xfer.remote = NocAddr(xfer.base.tileId, xfer.base.offset + offset);
+    xfer.size = size;
+    xfer.issued = 0;
+    xfer.finished = 0;
+    xfer.done.clear();
+    xfer.inFlight = 0;
+    xfer.walking = false;
+    return true;
+}
+
+void
+MemoryUnit::finishTransfer(Cycles delay)
+{
+    if (!xfer.sg || xfer.error != TcuError::NONE)
     {
-        return tcu.schedCmdError(delay, TcuError::PAGE_BOUNDARY,
-                                 "EP%u: data contains page boundary\n", cmd.epid);
+        tcu.scheduleCmdFinish(delay, xfer.error);
+        return;
     }
 
-    readBytes.sample(size);
+    nextDescriptor();
+    fetchDescriptor(delay);
+}
 
-    DPRINTFS(Tcu, (&tcu),
-        "\e[1m[rd -> %u]\e[0m at %#018lx+%#lx with EP%u into %#018lx:%lu\n",
-        mep.r0.targetTile, mep.r1.remoteAddr, offset,
-        cmd.epid, data.addr, size);
+void
+MemoryUnit::nextDescriptor()
+{
+    CmdData::Bits data = tcu.regs().getData();
+    data.addr = data.addr + sizeof(SgDesc);
+    data.size = data.size - 1;
+    tcu.regs().setData(data);
+    tcu.regs().set(UnprivReg::ARG1, 0);
+}
+
+bool
+MemoryUnit::translateDescriptor(NocAddr *phys, Cycles *delay)
+{
+    CmdData::Bits data = tcu.regs().getData();
+    if (data.size == 0)
+        return false;
+
+    if (tcu.isCommandAborting())
+    {
+        xfer.error = TcuError::ABORT;
+        return false;
+    }
+
+    auto res = translate(data.addr, TcuTlb::READ, phys, delay);
+    if (res == TcuTlb::MISS && tcu.walker() && !tcu.atomicMode())
+    {
+        // continue as soon as the page-table walk is done
+        tcu.walker()->startWalk(new DescMissHandler(*this, data.addr));
+        return false;
+    }
+    if (res != TcuTlb::HIT)
+    {
+        DPRINTFS(Tcu, (&tcu), "EP%u: TLB miss for descriptor address\n",
+                 xfer.epid);
+        xfer.error = TcuError::TRANSLATION_FAULT;
+        return false;
+    }
+    return true;
+}
 
-    NocAddr nocAddr(mep.r0.targetTile, mep.r1.remoteAddr + offset);
+void
+MemoryUnit::fetchDescriptor(Cycles delay)
+{
+    NocAddr phys;
+    if (!translateDescriptor(&phys, &delay))
+    {
+        // otherwise, the page-table walker continues
+        if (xfer.error != TcuError::NONE || tcu.regs().getData().size == 0)
+            tcu.scheduleCmdFinish(delay, xfer.error);
+        return;
+    }
 
-    auto pkt = tcu.generateRequest(nocAddr.getAddr(),
-                                   size,
+    auto pkt = tcu.generateRequest(phys.getAddr(),
+                                   sizeof(SgDesc),
                                    MemCmd::ReadReq);
+    tcu.sendMemRequest(pkt, 0, delay, Tcu::MemReqType::DESCRIPTOR);
+}
+
+void
+MemoryUnit::DescMissHandler::finish(TcuTlb::Result res, NocAddr phys)
+{
+    Transfer &xfer = memUnit.xfer;
+
+    if (res == TcuTlb::HIT)
+    {
+        // remember the page to not depend on the TLB entry
+        memUnit.rememberPage(virt, phys, access);
+    }
+    else
+    {
+        DPRINTFS(Tcu, (&memUnit.tcu),
+                 "EP%u: TLB miss for descriptor address\n", xfer.epid);
+        xfer.error = TcuError::TRANSLATION_FAULT;
+    }
+
+    memUnit.fetchDescriptor(Cycles(1));
+}
+
+void
+MemoryUnit::recvDescriptor(PacketPtr pkt)
+{
+    SgDesc desc;
+    memcpy(&desc, pkt->getConstPtr<uint8_t>(), sizeof(desc));
+
+    Cycles delay(1);
+    if (!setupDescriptor(desc))
+    {
+        return tcu.schedCmdError(delay, TcuError::OUT_OF_BOUNDS,
+                                 "EP%u: out of bounds\n", xfer.epid);
+    }
+
+    if (xfer.size == 0)
+        finishTransfer(delay);
+    else
+        sendPackets(delay);
+}
+
+bool
+MemoryUnit::setupDescriptor(const SgDesc &desc)
+{
+    // skip the part that has already been transferred
+    Addr done = std::min<Addr>(tcu.regs().get(UnprivReg::ARG1), desc.size);
+
+    DPRINTFS(Tcu, (&tcu),
+        "EP%u: descriptor %#018lx:%lu <-> +%#lx (done: %lu)\n",
+        xfer.epid, desc.addr, desc.size, desc.offset, done);
+
+    if (desc.offset + desc.size < desc.offset)
+        return false;
+    return setupTransfer(desc.addr + done, desc.offset + done,
+                         desc.size - done);
+}
+
+void
+MemoryUnit::transferSgAtomic(Cycles delay)
+{
+    NocAddr phys;
+    while (translateDescriptor(&phys, &delay))
+    {
+        SgDesc desc;
+        tcu.chargeAtomic(tcu.accessMemAtomic(phys,
+            reinterpret_cast<uint8_t*>(&desc), sizeof(desc), false));
+
+        if (!setupDescriptor(desc))
+        {
+            return tcu.schedCmdError(delay, TcuError::OUT_OF_BOUNDS,
+                                     "EP%u: out of bounds\n", xfer.epid);
+        }
+
+        delay = transferAtomic(delay);
+        if (xfer.error != TcuError::NONE)
+            break;
+
+        nextDescriptor();
+    }
+
+    tcu.scheduleCmdFinish(delay, xfer.error);
+}
+
+Cycles
+MemoryUnit::transferAtomic(Cycles delay)
+{
+    // the packets are sent one after another, but their latency is
+    // estimated as if nocReqCount of them were in flight at the same time
+    Tick maxLatency = 0;
+    Addr packets = 0;
+
+    while (xfer.issued < xfer.size)
+    {
+        if (tcu.isCommandAborting())
+        {
+            xfer.error = TcuError::ABORT;
+            break;
+        }
+
+        Addr local = xfer.local + xfer.issued;
+        NocAddr remote(xfer.remote.tileId, xfer.remote.offset + xfer.issued);
+
+        Addr pageOff = local & TcuTlb::PAGE_MASK;
+        Addr size = std::min(xfer.size - xfer.issued, tcu.maxNocPacketSize);
+        size = std::min(size, TcuTlb::PAGE_SIZE - pageOff);
+
+        // there is no page-table walk in atomic mode; the software handles
+        // the translation fault as usual
+        NocAddr phys;
+        auto access = xfer.write ? TcuTlb::READ : TcuTlb::WRITE;
+        if (translate(local, access, &phys, &delay) != TcuTlb::HIT)
+        {
+            DPRINTFS(Tcu, (&tcu), "EP%u: TLB miss for data address\n",
+                     xfer.epid);
+            xfer.error = TcuError::TRANSLATION_FAULT;
+            break;
+        }
+
+        DPRINTFS(Tcu, (&tcu),
+            "\e[1m[%s -> %u]\e[0m at %#018lx with EP%u %s %#018lx:%lu\n",
+            xfer.write ? "wr" : "rd", remote.tileId, remote.offset,
+            xfer.epid, xfer.write ? "from" : "into", local, size);
+
+        auto cmd = xfer.write ? MemCmd::WriteReq : MemCmd::ReadReq;
+        auto pkt = tcu.generateRequest(remote.getAddr(), size, cmd);
+
+        Tick latency = 0;
+        if (xfer.write)
+        {
+            latency += tcu.accessMemAtomic(phys, pkt->getPtr<uint8_t>(),
+                                           size, false);
+            tcu.printPacket(pkt);
+        }
+
+        Tcu::NocSenderState state;
+        state.packetType = xfer.write ? Tcu::NocPacketType::WRITE_REQ
+                                      : Tcu::NocPacketType::READ_REQ;
+        state.result = TcuError::NONE;
+        pkt->pushSenderState(&state);
+
+        latency += tcu.sendAtomicNocRequest(pkt);
+
+        pkt->popSenderState();
+
+        if (state.result == TcuError::NONE && !xfer.write)
+        {
+            tcu.printPacket(pkt);
+            latency += tcu.accessMemAtomic(phys, pkt->getPtr<uint8_t>(),
+                                           size, true);
+        }
+
+        tcu.freeRequest(pkt);
+
+        if (state.result != TcuError::NONE)
+        {
+            xfer.error = state.result;
+            break;
+        }
+
+        if (xfer.write)
+            writtenBytes.sample(size);
+        else
+            readBytes.sample(size);
+        packetsInFlight.sample(1);
+
+        finishReadWrite(tcu, size, xfer.sg);
+        xfer.issued += size;
+        xfer.finished += size;
+
+        maxLatency = std::max(maxLatency, latency);
+        packets++;
+
+        // we can start one packet per cycle
+        ++delay;
+    }
+
+    delay += tcu.ticksToCycles(maxLatency * divCeil(packets, tcu.nocReqCount));
+    return delay;
+}
+
+void
+MemoryUnit::sendPackets(Cycles delay)
+{
+    // don't start new packets if the command should be aborted
+    if (tcu.isCommandAborting() && xfer.error == TcuError::NONE)
+        xfer.error = TcuError::ABORT;
+
+    while (xfer.error == TcuError::NONE && !xfer.walking &&
+           xfer.issued < xfer.size && xfer.inFlight < tcu.nocReqCount)
+    {
+        Addr local = xfer.local + xfer.issued;
+        NocAddr remote(xfer.remote.tileId, xfer.remote.offset + xfer.issued);
+
+        // a packet neither exceeds the maximum NoC packet size nor the page
+        // of the local address, so that we need one translation per page
+        Addr pageOff = local & TcuTlb::PAGE_MASK;
+        Addr size = std::min(xfer.size - xfer.issued, tcu.maxNocPacketSize);
+        size = std::min(size, TcuTlb::PAGE_SIZE - pageOff);
+
+        if (xfer.write)
+        {
+            NocAddr phys;
+            auto res = translate(local, TcuTlb::READ, &phys, &delay);
+            if (res == TcuTlb::MISS && tcu.walker())
+            {
+                // continue as soon as the page-table walk is done
+                xfer.walking = true;
+                tcu.walker()->startWalk(new WriteMissHandler(*this, local));
+                break;
+            }
+            if (res != TcuTlb::HIT)
+            {
+                DPRINTFS(Tcu, (&tcu), "EP%u: TLB miss for data address\n",
+                         xfer.epid);
+                xfer.error = TcuError::TRANSLATION_FAULT;
+                break;
+            }
+
+            DPRINTFS(Tcu, (&tcu),
+                "\e[1m[wr -> %u]\e[0m at %#018lx with EP%u from %#018lx:%lu\n",
+                remote.tileId, remote.offset, xfer.epid, local, size);
+
+            auto ev = new WriteTransferEvent(phys, size, 0, remote);
+            tcu.startTransfer(ev, delay);
+        }
+        else
+        {
+            readBytes.sample(size);
+
+            DPRINTFS(Tcu, (&tcu),
+                "\e[1m[rd -> %u]\e[0m at %#018lx with EP%u into %#018lx:%lu\n",
+                remote.tileId, remote.offset, xfer.epid, local, size);
+
+            auto pkt = tcu.generateRequest(remote.getAddr(),
+                                           size,
+                                           MemCmd::ReadReq);
+
+            tcu.sendNocRequest(Tcu::NocPacketType::READ_REQ,
+                               pkt,
+                               delay);
+        }
+
+        xfer.issued += size;
+        xfer.inFlight++;
+        packetsInFlight.sample(xfer.inFlight);
+
+        // we can start one packet per cycle
+        ++delay;
+    }
+
+    // finish the transfer as soon as all packets are done
+    if (xfer.inFlight == 0 && !xfer.walking)
+        finishTransfer(delay);
+}
+
+TcuTlb::Result
+MemoryUnit::translate(Addr virt, uint access, NocAddr *phys, Cycles *delay)
+{
+    if (!tcu.tlb())
+    {
+        *phys = NocAddr(virt);
+        return TcuTlb::HIT;
+    }
+
+    // the packets never cross a page, so that it suffices to translate each
+    // page once per kind of access
+    Addr page = virt & ~static_cast<Addr>(TcuTlb::PAGE_MASK);
+    if (page != xfer.page || (access & ~xfer.pageAccess) != 0)
+    {
+        Cycles tlbLatency;
+        NocAddr pagePhys;
+        auto asid = tcu.regs().getCurAct().id;
+        auto res = tcu.tlb()->lookup(page, asid, access,
+                                     &pagePhys, &tlbLatency);
+        *delay += tlbLatency;
+
+        if (res != TcuTlb::HIT)
+        {
+            invalidatePage();
+            return res;
+        }
+        rememberPage(page, pagePhys, access);
+    }
+
+    *phys = xfer.pagePhys;
+    phys->offset += virt & TcuTlb::PAGE_MASK;
+    return TcuTlb::HIT;
+}
+
+void
+MemoryUnit::rememberPage(Addr virt, NocAddr phys, uint access)
+{
+    Addr page = virt & ~static_cast<Addr>(TcuTlb::PAGE_MASK);
+    // the checked rights accumulate as long as we stay on the page
+    if (page != xfer.page)
+        xfer.pageAccess = 0;
+    xfer.page = page;
+    xfer.pageAccess |= access;
+    xfer.pagePhys = phys;
+    xfer.pagePhys.offset -= virt & TcuTlb::PAGE_MASK;
+}
+
+void
+MemoryUnit::invalidatePage()
+{
+    xfer.page = ~static_cast<Addr>(0);
+    xfer.pageAccess = 0;
+}
+
+void
+MemoryUnit::WriteMissHandler::finish(TcuTlb::Result res, NocAddr phys)
+{
+    Transfer &xfer = memUnit.xfer;
+    xfer.walking = false;
+
+    if (res == TcuTlb::HIT)
+    {
+        // remember the page to not depend on the TLB entry
+        memUnit.rememberPage(virt, phys, access);
+    }
+    else if (xfer.error == TcuError::NONE)
+    {
+        DPRINTFS(Tcu, (&memUnit.tcu), "EP%u: TLB miss for data address\n",
+                 xfer.epid);
+        xfer.error = TcuError::TRANSLATION_FAULT;
+    }
+
+    memUnit.sendPackets(Cycles(1));
+}
+
+void
+MemoryUnit::ReadMissHandler::finish(TcuTlb::Result res, NocAddr phys)
+{
+    if (res == TcuTlb::HIT)
+    {
+        auto ev = new ReadTransferEvent(phys, 0, pkt);
+        memUnit.tcu.startTransfer(ev, Cycles(1));
+    }
+    else
+    {
+        DPRINTFS(Tcu, (&memUnit.tcu), "EP%u: TLB miss for data address\n",
+                 memUnit.xfer.epid);
+        NocAddr remote(pkt->getAddr());
+        memUnit.tcu.freeRequest(pkt);
+        memUnit.finishPacket(remote, 0, Cycles(1),
+                             TcuError::TRANSLATION_FAULT);
+    }
+}
+
+void
+MemoryUnit::finishPacket(NocAddr remote, Addr size, Cycles delay,
+                         TcuError error)
+{
+    assert(xfer.inFlight > 0);
+    xfer.inFlight--;
+
+    if (error != TcuError::NONE)
+    {
+        // the first error determines the result of the command
+        if (xfer.error == TcuError::NONE)
+            xfer.error = error;
+    }
+    else
+    {
+        xfer.done[remote.offset - xfer.remote.offset] = size;
+
+        // advance DATA and ARG1 for all packets that are done in order
+        for (auto it = xfer.done.begin();
+             it != xfer.done.end() && it->first == xfer.finished;
+             it = xfer.done.erase(it))
+        {
+            finishReadWrite(tcu, it->second, xfer.sg);
+            xfer.finished += it->second;
+        }
+    }
 
-    tcu.sendNocRequest(Tcu::NocPacketType::READ_REQ,
-                       pkt,
-                       delay);
+    sendPackets(delay);
 }
 
 void
@@ -174,7 +675,7 @@ MemoryUnit::readComplete(const CmdCommand::Bits& cmd, PacketPtr pkt, TcuError er
 {
     tcu.printPacket(pkt);
 
-    const CmdData::Bits data = tcu.regs().getData();
+    NocAddr remote(pkt->getAddr());
 
     // since the transfer is done in steps, we can start after the header
     // delay here
@@ -182,29 +683,30 @@ MemoryUnit::readComplete(const CmdCommand::Bits& cmd, PacketPtr pkt, TcuError er
 
     if (error != TcuError::NONE)
     {
-        tcu.scheduleCmdFinish(delay, error);
+        tcu.freeRequest(pkt);
+        finishPacket(remote, 0, delay, error);
         return;
     }
 
-    NocAddr phys(data.addr);
-    if (tcu.tlb())
-    {
-        Cycles tlbLatency;
-        auto asid = tcu.regs().getCurAct().id;
-        auto res = tcu.tlb()->lookup(data.addr, asid, TcuTlb::WRITE,
-                                     &phys, &tlbLatency);
-        delay += tlbLatency;
+    Addr local = xfer.local + (remote.offset - xfer.remote.offset);
 
-        if (res != TcuTlb::HIT)
-        {
-            return tcu.schedCmdError(Cycles(1), TcuError::TRANSLATION_FAULT,
-                                     "EP%u: TLB miss for data address\n",
-                                     cmd.epid);
-        }
+    NocAddr phys;
+    auto res = translate(local, TcuTlb::WRITE, &phys, &delay);
+    if (res == TcuTlb::MISS && tcu.walker())
+    {
+        tcu.walker()->startWalk(new ReadMissHandler(*this, local, pkt));
+        return;
+    }
+    if (res != TcuTlb::HIT)
+    {
+        DPRINTFS(Tcu, (&tcu), "EP%u: TLB miss for data address\n", cmd.epid);
+        tcu.freeRequest(pkt);
+        finishPacket(remote, 0, Cycles(1), TcuError::TRANSLATION_FAULT);
+        return;
     }
 
-    auto xfer = new ReadTransferEvent(phys, 0, pkt);
-    tcu.startTransfer(xfer, delay);
+    auto ev = new ReadTransferEvent(phys, 0, pkt);
+    tcu.startTransfer(ev, delay);
 }
 
 void
@@ -218,10 +720,8 @@ MemoryUnit::ReadTransferEvent::transferStart()
 void
 MemoryUnit::ReadTransferEvent::transferDone(TcuError result)
 {
-    if (result == TcuError::NONE)
-        finishReadWrite(tcu(), pkt->getSize());
-
-    tcu().scheduleCmdFinish(Cycles(1), result);
+    tcu().mem().finishPacket(NocAddr(pkt->getAddr()), pkt->getSize(),
+                             Cycles(1), result);
 
     tcu().freeRequest(pkt);
 }
@@ -262,52 +762,7 @@ MemoryUnit::startWriteWithEP(EpFile::EpCache &eps)
                                  "EP%u: no permission\n", cmd.epid);
     }
 
-    CmdData::Bits data = tcu.regs().getData();
-    Addr offset = tcu.regs().get(UnprivReg::ARG1);
-    Addr size = std::min(static_cast<Addr>(data.size), tcu.maxNocPacketSize);
-
-    if(size == 0)
-    {
-        tcu.scheduleCmdFinish(delay, TcuError::NONE);
-        return;
-    }
-
-    if(size + offset < size || size + offset > mep.r2.remoteSize)
-    {
-        return tcu.schedCmdError(delay, TcuError::OUT_OF_BOUNDS,
-                                 "EP%u: out of bounds\n", cmd.epid);
-    }
-
-    auto data_page = data.addr & ~static_cast<Addr>(TcuTlb::PAGE_MASK);
-    if(data_page !=
-        ((data.addr + size - 1) & ~static_cast<Addr>(TcuTlb::PAGE_MASK)))
-    {
-        return tcu.schedCmdError(delay, TcuError::PAGE_BOUNDARY,
-                                 "EP%u: data contains page boundary\n",
-                                 cmd.epid);
-    }
-
-    NocAddr phys(data.addr);
-    if (tcu.tlb())
-    {
-        Cycles tlbLatency;
-        auto asid = tcu.regs().getCurAct().id;
-        auto res = tcu.tlb()->lookup(data.addr, asid, TcuTlb::READ,
-                                     &phys, &tlbLatency);
-        delay += tlbLatency;
-
-        if (res != TcuTlb::HIT)
-        {
-            return tcu.schedCmdError(delay, TcuError::TRANSLATION_FAULT,
-                                     "EP%u: TLB miss for data address\n",
-                                     cmd.epid);
-        }
-    }
-
-    NocAddr dest(mep.r0.targetTile, mep.r1.remoteAddr + offset);
-
-    auto xfer = new WriteTransferEvent(phys, size, 0, dest);
-    tcu.startTransfer(xfer, delay);
+    startTransfer(mep, true, delay);
 }
 
 void
@@ -315,7 +770,10 @@ MemoryUnit::WriteTransferEvent::transferDone(TcuError result)
 {
     if (result != TcuError::NONE)
     {
-        tcu().scheduleCmdFinish(Cycles(1), result);
+        if (flags() & XferUnit::MESSAGE)
+            tcu().scheduleCmdFinish(Cycles(1), result);
+        else
+            tcu().mem().finishPacket(dest, 0, Cycles(1), result);
     }
     else
     {
@@ -332,17 +790,6 @@ MemoryUnit::WriteTransferEvent::transferDone(TcuError result)
         else
             pktType = Tcu::NocPacketType::WRITE_REQ;
 
-        const CmdCommand::Bits cmd = tcu().regs().getCommand();
-        if (cmd.opcode == CmdCommand::WRITE)
-        {
-            const CmdData::Bits data = tcu().regs().getData();
-            Addr offset = tcu().regs().get(UnprivReg::ARG1);
-            DPRINTFS(Tcu, (&tcu()),
-                "\e[1m[wr -> %u]\e[0m at %#018lx+%#lx with EP%u from %#018lx:%lu\n",
-                dest.tileId, dest.offset - offset, offset,
-                cmd.epid, data.addr, size());
-        }
-
         tcu().sendNocRequest(pktType, pkt, Cycles(1));
     }
 }
@@ -350,21 +797,543 @@ MemoryUnit::WriteTransferEvent::transferDone(TcuError result)
 void
 MemoryUnit::writeComplete(const CmdCommand::Bits& cmd, PacketPtr pkt, TcuError error)
 {
-    if (cmd.opcode == CmdCommand::WRITE && error == TcuError::NONE)
-    {
-        writtenBytes.sample(pkt->getSize());
-        finishReadWrite(tcu, pkt->getSize());
-    }
-
     // we don't need to pay the payload delay here because the message
     // basically has no payload since we only receive an ACK back for
     // writing
     Cycles delay = tcu.ticksToCycles(pkt->headerDelay);
+
+    if (cmd.opcode == CmdCommand::WRITE)
+    {
+        if (error == TcuError::NONE)
+            writtenBytes.sample(pkt->getSize());
+        finishPacket(NocAddr(pkt->getAddr()), pkt->getSize(), delay, error);
+    }
+    else if (cmd.opcode == CmdCommand::SEND_MC)
+        tcu.msgs().finishMcastPacket(pkt, delay, error);
+    else
+        tcu.scheduleCmdFinish(delay, error);
+
+    tcu.freeRequest(pkt);
+}
+
+void
+MemoryUnit::startAtomic(const CmdCommand::Bits& cmd)
+{
+    eps.addEp(cmd.epid);
+    eps.onFetched(
+        std::bind(&MemoryUnit::startAtomicWithEP, this, std::placeholders::_1));
+}
+
+void
+MemoryUnit::startAtomicWithEP(EpFile::EpCache &eps)
+{
+    Cycles delay(tcu.cmdAtomicLatency);
+    CmdCommand::Bits cmd = tcu.regs().getCommand();
+
+    const Ep ep = eps.getEp(cmd.epid);
+
+    if(ep.type() != EpType::MEMORY)
+    {
+        return tcu.schedCmdError(delay, TcuError::NO_MEP,
+                                 "EP%u: invalid EP\n", cmd.epid);
+    }
+
+    const MemEp mep = ep.mem;
+
+    if(mep.r0.act != tcu.regs().getCurAct().id)
+    {
+        return tcu.schedCmdError(delay, TcuError::FOREIGN_EP,
+                                 "EP%u: foreign EP\n", cmd.epid);
+    }
+
+    // atomics read and write the word
+    uint perms = Tcu::MemoryFlags::READ | Tcu::MemoryFlags::WRITE;
+    if((mep.r0.flags & perms) != perms)
+    {
+        return tcu.schedCmdError(delay, TcuError::NO_PERM,
+                                 "EP%u: no permission\n", cmd.epid);
+    }
+
+    auto op = CmdCommand::atomicOp(cmd.arg0);
+    if(op > CmdCommand::SWAP)
+    {
+        return tcu.schedCmdError(delay, TcuError::UNKNOWN_CMD,
+                                 "EP%u: invalid atomic operation %d\n",
+                                 cmd.epid, op);
+    }
+
+    Addr offset = CmdCommand::atomicOffset(cmd.arg0);
+    if(offset + sizeof(uint64_t) > mep.r2.remoteSize)
+    {
+        return tcu.schedCmdError(delay, TcuError::OUT_OF_BOUNDS,
+                                 "EP%u: out of bounds\n", cmd.epid);
+    }
+
+    NocAddr remote(mep.r0.targetTile, mep.r1.remoteAddr + offset);
+    if(remote.offset & (sizeof(uint64_t) - 1))
+    {
+        return tcu.schedCmdError(delay, TcuError::MEM_UNALIGNED,
+                                 "EP%u: unaligned address %#lx\n",
+                                 cmd.epid, remote.offset);
+    }
+
+    auto pkt = tcu.generateRequest(remote.getAddr(),
+                                   sizeof(AtomicReq),
+                                   MemCmd::SwapReq);
+    AtomicReq *req = pkt->getPtr<AtomicReq>();
+    req->op = op;
+    req->value = tcu.regs().get(UnprivReg::DATA);
+    req->expected = tcu.regs().get(UnprivReg::ARG1);
+
+    DPRINTFS(Tcu, (&tcu),
+        "\e[1m[at -> %u]\e[0m at %#018lx with EP%u: op=%d val=%#lx exp=%#lx\n",
+        remote.tileId, remote.offset, cmd.epid, op, req->value, req->expected);
+
+    atomicOps++;
+
+    tcu.sendNocRequest(Tcu::NocPacketType::ATOMIC_REQ, pkt, delay);
+}
+
+void
+MemoryUnit::atomicComplete(const CmdCommand::Bits& cmd, PacketPtr pkt,
+                           TcuError error)
+{
+    Cycles delay = tcu.ticksToCycles(pkt->headerDelay);
+
+    if (error == TcuError::NONE)
+    {
+        const AtomicReq *resp = pkt->getConstPtr<AtomicReq>();
+
+        DPRINTFS(Tcu, (&tcu), "EP%u: atomic operation returned %#lx\n",
+                 cmd.epid, resp->value);
+
+        tcu.regs().set(UnprivReg::DATA, resp->value);
+    }
+
+    tcu.scheduleCmdFinish(delay, error);
+
+    tcu.freeRequest(pkt);
+}
+
+void
+MemoryUnit::recvAtomicFromNoc(PacketPtr pkt)
+{
+    NocAddr addr(pkt->getAddr());
+
+    // atomics on our registers are not supported
+    if (tcu.mmioRegion.contains(addr.offset))
+    {
+        DPRINTFS(Tcu, (&tcu), "Atomic request to MMIO region %#lx\n",
+                 addr.offset);
+        tcu.sendNocResponse(pkt, TcuError::NO_PERM);
+        return;
+    }
+    if (addr.offset & (sizeof(uint64_t) - 1))
+    {
+        DPRINTFS(Tcu, (&tcu), "Unaligned atomic request at %#lx\n",
+                 addr.offset);
+        tcu.sendNocResponse(pkt, TcuError::MEM_UNALIGNED);
+        return;
+    }
+
+    remoteAtomics.push_back(pkt);
+
+    // the request waits in our queue from now on
+    tcu.finishNocRequest(pkt);
+
+    if (remoteAtomics.size() == 1)
+        executeRemoteAtomic();
+}
+
+bool
+MemoryUnit::applyAtomic(const AtomicReq &req, uint64_t old, uint64_t *res)
+{
+    switch (req.op)
+    {
+        case CmdCommand::FETCH_ADD:
+            *res = old + req.value;
+            return true;
+        case CmdCommand::COMPARE_SWAP:
+            *res = req.value;
+            return old == req.expected;
+        default:
+            *res = req.value;
+            return true;
+    }
+}
+
+void
+MemoryUnit::executeRemoteAtomic()
+{
+    PacketPtr pkt = remoteAtomics.front();
+    Addr local = NocAddr(pkt->getAddr()).offset;
+
+    if (tcu.atomicMode())
+    {
+        uint64_t old, res;
+        tcu.chargeAtomic(tcu.accessMemAtomic(NocAddr(local),
+            reinterpret_cast<uint8_t*>(&old), sizeof(old), false));
+        remoteAtomicOld = old;
+
+        if (applyAtomic(*pkt->getConstPtr<AtomicReq>(), old, &res))
+        {
+            tcu.chargeAtomic(tcu.accessMemAtomic(NocAddr(local),
+                reinterpret_cast<uint8_t*>(&res), sizeof(res), true));
+        }
+
+        finishRemoteAtomic(TcuError::NONE);
+        return;
+    }
+
+    // the memory performs the read, the operation, and the write in a single
+    // access, so that no other write (by the core or the NoC) can come in
+    // between. the response carries the old value.
+    const AtomicReq areq = *pkt->getConstPtr<AtomicReq>();
+    auto op = new AtomicGeneric2Op<uint64_t>(areq.value,
+        [areq](uint64_t *val, uint64_t) {
+            uint64_t res;
+            if (applyAtomic(areq, *val, &res))
+                *val = res;
+        });
+
+    auto req = tcu.generateRequest(local, sizeof(uint64_t), MemCmd::SwapReq);
+    req->req->setVirt(local, sizeof(uint64_t), Request::ATOMIC_RETURN_OP,
+                      req->req->requestorId(), 0, AtomicOpFunctorPtr(op));
+    req->req->setPaddr(local);
+    tcu.sendMemRequest(req, 0, Cycles(1), Tcu::MemReqType::ATOMIC);
+}
+
+void
+MemoryUnit::recvAtomicMemResponse(PacketPtr pkt)
+{
+    memcpy(&remoteAtomicOld, pkt->getConstPtr<uint8_t>(),
+           sizeof(remoteAtomicOld));
+    finishRemoteAtomic(TcuError::NONE);
+}
+
+void
+MemoryUnit::finishRemoteAtomic(TcuError error)
+{
+    PacketPtr pkt = remoteAtomics.front();
+    remoteAtomics.pop_front();
+
+    AtomicReq *req = pkt->getPtr<AtomicReq>();
+
+    DPRINTFS(Tcu, (&tcu),
+        "\e[1m[at <- ?]\e[0m %#018lx: op=%lu val=%#lx -> old=%#lx\n",
+        NocAddr(pkt->getAddr()).offset, req->op, req->value, remoteAtomicOld);
+
+    req->value = remoteAtomicOld;
+    tcu.sendNocResponse(pkt, error);
+
+    if (!remoteAtomics.empty())
+        executeRemoteAtomic();
+}
+
+void
+MemoryUnit::startCopy(const CmdCommand::Bits& cmd)
+{
+    if (cmd.arg0 >= tcu.numEndpoints)
+    {
+        return tcu.schedCmdError(Cycles(tcu.cmdCopyLatency),
+                                 TcuError::NO_MEP,
+                                 "EP%u: invalid EP\n", cmd.arg0);
+    }
+
+    eps.addEp(cmd.epid);
+    if (cmd.arg0 != cmd.epid)
+        eps.addEp(cmd.arg0);
+    eps.onFetched(
+        std::bind(&MemoryUnit::startCopyWithEP, this, std::placeholders::_1));
+}
+
+void
+MemoryUnit::startCopyWithEP(EpFile::EpCache &eps)
+{
+    Cycles delay(tcu.cmdCopyLatency);
+    CmdCommand::Bits cmd = tcu.regs().getCommand();
+    CmdData::Bits data = tcu.regs().getData();
+    epid_t dstEp = cmd.arg0;
+    Addr srcOff = tcu.regs().get(UnprivReg::ARG1);
+    Addr dstOff = data.addr;
+    Addr size = data.size;
+
+    const Ep src = eps.getEp(cmd.epid);
+    const Ep dst = eps.getEp(dstEp);
+
+    if(src.type() != EpType::MEMORY)
+    {
+        return tcu.schedCmdError(delay, TcuError::NO_MEP,
+                                 "EP%u: invalid EP\n", cmd.epid);
+    }
+    if(dst.type() != EpType::MEMORY)
+    {
+        return tcu.schedCmdError(delay, TcuError::NO_MEP,
+                                 "EP%u: invalid EP\n", dstEp);
+    }
+
+    const MemEp smep = src.mem;
+    const MemEp dmep = dst.mem;
+
+    if(smep.r0.act != tcu.regs().getCurAct().id)
+    {
+        return tcu.schedCmdError(delay, TcuError::FOREIGN_EP,
+                                 "EP%u: foreign EP\n", cmd.epid);
+    }
+    if(dmep.r0.act != tcu.regs().getCurAct().id)
+    {
+        return tcu.schedCmdError(delay, TcuError::FOREIGN_EP,
+                                 "EP%u: foreign EP\n", dstEp);
+    }
+
+    if(!(smep.r0.flags & Tcu::MemoryFlags::READ))
+    {
+        return tcu.schedCmdError(delay, TcuError::NO_PERM,
+                                 "EP%u: no permission\n", cmd.epid);
+    }
+    if(!(dmep.r0.flags & Tcu::MemoryFlags::WRITE))
+    {
+        return tcu.schedCmdError(delay, TcuError::NO_PERM,
+                                 "EP%u: no permission\n", dstEp);
+    }
+
+    if(size == 0)
+    {
+        tcu.scheduleCmdFinish(delay, TcuError::NONE);
+        return;
+    }
+
+    if(size + srcOff < size || size + srcOff > smep.r2.remoteSize)
+    {
+        return tcu.schedCmdError(delay, TcuError::OUT_OF_BOUNDS,
+                                 "EP%u: out of bounds\n", cmd.epid);
+    }
+    if(size + dstOff < size || size + dstOff > dmep.r2.remoteSize)
+    {
+        return tcu.schedCmdError(delay, TcuError::OUT_OF_BOUNDS,
+                                 "EP%u: out of bounds\n", dstEp);
+    }
+
+    NocAddr srcAddr(smep.r0.targetTile, smep.r1.remoteAddr + srcOff);
+    NocAddr dstAddr(dmep.r0.targetTile, dmep.r1.remoteAddr + dstOff);
+
+    auto pkt = tcu.generateRequest(srcAddr.getAddr(),
+                                   sizeof(CopyReq),
+                                   MemCmd::WriteReq);
+    CopyReq *req = pkt->getPtr<CopyReq>();
+    req->dest = dstAddr.getAddr();
+    req->size = size;
+
+    DPRINTFS(Tcu, (&tcu),
+        "\e[1m[cp -> %u]\e[0m at %#018lx with EP%u to %u:%#018lx with EP%u"
+        " (%lu bytes)\n",
+        srcAddr.tileId, srcAddr.offset, cmd.epid,
+        dstAddr.tileId, dstAddr.offset, dstEp, size);
+
+    copies++;
+
+    tcu.sendNocRequest(Tcu::NocPacketType::COPY_REQ, pkt, delay);
+}
+
+void
+MemoryUnit::copyComplete(const CmdCommand::Bits& cmd, PacketPtr pkt,
+                         TcuError error)
+{
+    // the response does not carry any data
+    Cycles delay = tcu.ticksToCycles(pkt->headerDelay);
+
     tcu.scheduleCmdFinish(delay, error);
 
     tcu.freeRequest(pkt);
 }
 
+void
+MemoryUnit::recvCopyFromNoc(PacketPtr pkt)
+{
+    NocAddr addr(pkt->getAddr());
+
+    // copies from our registers are not supported
+    if (tcu.mmioRegion.contains(addr.offset))
+    {
+        DPRINTFS(Tcu, (&tcu), "Copy request from MMIO region %#lx\n",
+                 addr.offset);
+        tcu.sendNocResponse(pkt, TcuError::NO_PERM);
+        return;
+    }
+
+    if (tcu.atomicMode())
+    {
+        copyAtomic(pkt);
+        return;
+    }
+
+    // the request waits in our queue from now on
+    pkt->headerDelay = 0;
+    pkt->payloadDelay = 0;
+    remoteCopies.push_back(pkt);
+    tcu.finishNocRequest(pkt);
+
+    if (remoteCopies.size() == 1)
+        startRemoteCopy();
+}
+
+void
+MemoryUnit::copyAtomic(PacketPtr pkt)
+{
+    const CopyReq *req = pkt->getConstPtr<CopyReq>();
+    NocAddr src(pkt->getAddr());
+    NocAddr dest(req->dest);
+
+    // as for READ/WRITE, estimate the latency as if nocReqCount packets
+    // were in flight at the same time
+    TcuError error = TcuError::NONE;
+    Tick maxLatency = 0;
+    Addr packets = 0;
+    for (Addr off = 0; off < req->size; )
+    {
+        Addr size = std::min(req->size - off, tcu.maxNocPacketSize);
+        NocAddr pktDest(dest.tileId, dest.offset + off);
+
+        DPRINTFS(Tcu, (&tcu),
+            "\e[1m[cp -> %u]\e[0m at %#018lx from %#018lx:%lu\n",
+            pktDest.tileId, pktDest.offset, src.offset + off, size);
+
+        auto wpkt = tcu.generateRequest(pktDest.getAddr(), size,
+                                        MemCmd::WriteReq);
+
+        Tick latency = tcu.accessMemAtomic(NocAddr(src.offset + off),
+                                           wpkt->getPtr<uint8_t>(),
+                                           size, false);
+
+        Tcu::NocSenderState state;
+        state.packetType = Tcu::NocPacketType::COPY_DATA;
+        state.result = TcuError::NONE;
+        wpkt->pushSenderState(&state);
+
+        latency += tcu.sendAtomicNocRequest(wpkt);
+
+        wpkt->popSenderState();
+        tcu.freeRequest(wpkt);
+
+        if (state.result != TcuError::NONE)
+        {
+            error = state.result;
+            break;
+        }
+
+        copiedBytes.sample(size);
+        maxLatency = std::max(maxLatency, latency);
+        packets++;
+        off += size;
+    }
+
+    tcu.chargeAtomic(maxLatency * divCeil(packets, tcu.nocReqCount));
+    tcu.sendNocResponse(pkt, error);
+}
+
+void
+MemoryUnit::startRemoteCopy()
+{
+    copy.issued = 0;
+    copy.inFlight = 0;
+    copy.error = TcuError::NONE;
+
+    sendCopyPackets(Cycles(1));
+}
+
+void
+MemoryUnit::sendCopyPackets(Cycles delay)
+{
+    PacketPtr pkt = remoteCopies.front();
+    const CopyReq *req = pkt->getConstPtr<CopyReq>();
+    NocAddr src(pkt->getAddr());
+    NocAddr dest(req->dest);
+
+    while (copy.error == TcuError::NONE && copy.issued < req->size &&
+           copy.inFlight < tcu.nocReqCount)
+    {
+        Addr size = std::min(req->size - copy.issued, tcu.maxNocPacketSize);
+        NocAddr pktDest(dest.tileId, dest.offset + copy.issued);
+
+        DPRINTFS(Tcu, (&tcu),
+            "\e[1m[cp -> %u]\e[0m at %#018lx from %#018lx:%lu\n",
+            pktDest.tileId, pktDest.offset, src.offset + copy.issued, size);
+
+        // accesses on behalf of remote TCUs always refer to physical memory
+        auto ev = new CopyTransferEvent(NocAddr(src.offset + copy.issued),
+                                        size, pktDest);
+        tcu.startTransfer(ev, delay);
+
+        copy.issued += size;
+        copy.inFlight++;
+
+        // we can start one packet per cycle
+        ++delay;
+    }
+
+    // respond to the initiator as soon as all packets are done
+    if (copy.inFlight == 0)
+    {
+        remoteCopies.pop_front();
+
+        DPRINTFS(Tcu, (&tcu), "Copy of %lu bytes from %#018lx done: %s\n",
+                 req->size, src.offset,
+                 copy.error == TcuError::NONE ? "success" : "failure");
+
+        tcu.sendNocResponse(pkt, copy.error);
+
+        if (!remoteCopies.empty())
+            startRemoteCopy();
+    }
+}
+
+void
+MemoryUnit::CopyTransferEvent::transferDone(TcuError result)
+{
+    if (result != TcuError::NONE)
+    {
+        tcu().mem().finishCopyPacket(0, Cycles(1), result);
+        return;
+    }
+
+    auto pkt = tcu().generateRequest(dest.getAddr(),
+                                     size(),
+                                     MemCmd::WriteReq);
+    memcpy(pkt->getPtr<uint8_t>(), data(), size());
+
+    tcu().printPacket(pkt);
+
+    tcu().sendNocRequest(Tcu::NocPacketType::COPY_DATA, pkt, Cycles(1));
+}
+
+void
+MemoryUnit::copyDataComplete(PacketPtr pkt, TcuError error)
+{
+    Cycles delay = tcu.ticksToCycles(pkt->headerDelay);
+
+    finishCopyPacket(pkt->getSize(), delay, error);
+
+    tcu.freeRequest(pkt);
+}
+
+void
+MemoryUnit::finishCopyPacket(Addr size, Cycles delay, TcuError error)
+{
+    assert(copy.inFlight > 0);
+    copy.inFlight--;
+
+    // the first error determines the result of the copy
+    if (error != TcuError::NONE)
+    {
+        if (copy.error == TcuError::NONE)
+            copy.error = error;
+    }
+    else
+        copiedBytes.sample(size);
+
+    sendCopyPackets(delay);
+}
+
 void
 MemoryUnit::recvFunctionalFromNoc(PacketPtr pkt)
 {
@@ -379,6 +1348,18 @@ MemoryUnit::recvFromNoc(PacketPtr pkt)
 {
     NocAddr addr(pkt->getAddr());
 
+    auto sstate = dynamic_cast<Tcu::NocSenderState*>(pkt->senderState);
+    if (sstate->packetType == Tcu::NocPacketType::ATOMIC_REQ)
+    {
+        recvAtomicFromNoc(pkt);
+        return;
+    }
+    if (sstate->packetType == Tcu::NocPacketType::COPY_REQ)
+    {
+        recvCopyFromNoc(pkt);
+        return;
+    }
+
     DPRINTFS(Tcu, (&tcu), "\e[1m[%s <- ?]\e[0m %#018lx:%lu\n",
         pkt->isWrite() ? "wr" : "rd",
         addr.offset,
@@ -408,8 +1389,15 @@ MemoryUnit::recvFromNoc(PacketPtr pkt)
         auto type = pkt->isWrite() ? XferUnit::TransferType::REMOTE_WRITE
                                    : XferUnit::TransferType::REMOTE_READ;
         // accesses from remote TCUs always refer to physical memory
-        auto *ev = new ReceiveTransferEvent(type, NocAddr(addr.offset), 0, pkt);
+        // requests from the LLC use their own buffer class
+        uint flags = sstate->packetType == Tcu::NocPacketType::CACHE_MEM_REQ
+                     ? XferUnit::XferFlags::LLC : 0;
+        auto *ev = new ReceiveTransferEvent(type, NocAddr(addr.offset), flags,
+                                            pkt);
         tcu.startTransfer(ev, delay);
+
+        // the transfer unit takes over from here
+        tcu.finishNocRequest(pkt);
     }
 }
 
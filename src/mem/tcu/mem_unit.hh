@@ -36,6 +36,9 @@
 #include "mem/tcu/ep_file.hh"
 #include "mem/tcu/xfer_unit.hh"
 
+#include <deque>
+#include <map>
+
 class MemoryUnit
 {
   public:
@@ -99,6 +102,23 @@ class MemoryUnit
         void transferDone(TcuError result) override;
     };
 
+    class CopyTransferEvent : public XferUnit::TransferEvent
+    {
+        NocAddr dest;
+
+      public:
+
+        CopyTransferEvent(NocAddr phys, size_t size, NocAddr _dest)
+            : TransferEvent(XferUnit::TransferType::REMOTE_READ,
+                            phys, size, 0),
+              dest(_dest)
+        {}
+
+        void transferStart() override {}
+
+        void transferDone(TcuError result) override;
+    };
+
     class ReceiveTransferEvent : public XferUnit::TransferEvent
     {
       protected:
@@ -120,7 +140,51 @@ class MemoryUnit
         void transferDone(TcuError result) override;
     };
 
-    MemoryUnit(Tcu &_tcu) : tcu(_tcu), eps(_tcu.eps().newCache()) {}
+    class ReadMissHandler : public TcuTlb::MissHandler
+    {
+        MemoryUnit &memUnit;
+        PacketPtr pkt;
+
+      public:
+
+        ReadMissHandler(MemoryUnit &_memUnit, Addr virt, PacketPtr _pkt)
+            : MissHandler(virt, TcuTlb::WRITE),
+              memUnit(_memUnit),
+              pkt(_pkt)
+        {}
+
+        void finish(TcuTlb::Result res, NocAddr phys) override;
+    };
+
+    class DescMissHandler : public TcuTlb::MissHandler
+    {
+        MemoryUnit &memUnit;
+
+      public:
+
+        DescMissHandler(MemoryUnit &_memUnit, Addr virt)
+            : MissHandler(virt, TcuTlb::READ),
+              memUnit(_memUnit)
+        {}
+
+        void finish(TcuTlb::Result res, NocAddr phys) override;
+    };
+
+    class WriteMissHandler : public TcuTlb::MissHandler
+    {
+        MemoryUnit &memUnit;
+
+      public:
+
+        WriteMissHandler(MemoryUnit &_memUnit, Addr virt)
+            : MissHandler(virt, TcuTlb::READ),
+              memUnit(_memUnit)
+        {}
+
+        void finish(TcuTlb::Result res, NocAddr phys) override;
+    };
+
+    MemoryUnit(Tcu &_tcu) : tcu(_tcu), eps(_tcu.eps().newCache()), xfer() {}
 
     void regStats();
 
@@ -134,6 +198,16 @@ class MemoryUnit
      */
     void startWrite(const CmdCommand::Bits& cmd);
 
+    /**
+     * Starts an atomic operation -> NoC request
+     */
+    void startAtomic(const CmdCommand::Bits& cmd);
+
+    /**
+     * Starts a copy between two memory EPs -> NoC request to the source
+     */
+    void startCopy(const CmdCommand::Bits& cmd);
+
     /**
      * Read: response from remote TCU
      */
@@ -146,6 +220,28 @@ class MemoryUnit
     void writeComplete(const CmdCommand::Bits& cmd, PacketPtr pkt,
                        TcuError error);
 
+    /**
+     * Atomic: response from remote TCU
+     */
+    void atomicComplete(const CmdCommand::Bits& cmd, PacketPtr pkt,
+                        TcuError error);
+
+    /**
+     * Copy: response from the source TCU
+     */
+    void copyComplete(const CmdCommand::Bits& cmd, PacketPtr pkt,
+                      TcuError error);
+
+    /**
+     * Remote copy: response from the destination TCU
+     */
+    void copyDataComplete(PacketPtr pkt, TcuError error);
+
+    /**
+     * Read/Write: a single packet of the transfer is done
+     */
+    void finishPacket(NocAddr remote, Addr size, Cycles delay,
+                      TcuError error);
 
     /**
      * Functional access from NoC
@@ -157,20 +253,182 @@ class MemoryUnit
      */
     void recvFromNoc(PacketPtr pkt);
 
+    /**
+     * Read/Write: response from the local memory for a scatter-gather
+     * descriptor
+     */
+    void recvDescriptor(PacketPtr pkt);
+
+    /**
+     * Remote atomic: response from the local memory
+     */
+    void recvAtomicMemResponse(PacketPtr pkt);
+
+    /**
+     * Forgets the last translated page (e.g., because the TLB has changed)
+     */
+    void invalidatePage();
+
+    bool isIdle() const
+    {
+        return remoteAtomics.empty() && remoteCopies.empty();
+    }
+
   private:
 
+    // the payload of ATOMIC_REQ packets. the response holds the old value
+    // in <value>.
+    struct M5_ATTR_PACKED AtomicReq
+    {
+        uint64_t value;
+        uint64_t expected;
+        uint64_t op;
+    };
+
+    // the payload of COPY_REQ packets. the packet is addressed to the source
+    // and <dest> is the NoC address of the destination.
+    struct M5_ATTR_PACKED CopyReq
+    {
+        uint64_t dest;
+        uint64_t size;
+    };
+
     void startReadWithEP(EpFile::EpCache &eps);
 
     void startWriteWithEP(EpFile::EpCache &eps);
 
+    void startAtomicWithEP(EpFile::EpCache &eps);
+
+    void rememberPage(Addr virt, NocAddr phys, uint access);
+
+    void recvAtomicFromNoc(PacketPtr pkt);
+
+    void executeRemoteAtomic();
+
+    /**
+     * Applies the operation to <old> and stores the result in <res>.
+     * Returns false if nothing needs to be written (failed COMPARE_SWAP).
+     */
+    static bool applyAtomic(const AtomicReq &req, uint64_t old, uint64_t *res);
+
+    void finishRemoteAtomic(TcuError error);
+
+    void startCopyWithEP(EpFile::EpCache &eps);
+
+    void recvCopyFromNoc(PacketPtr pkt);
+
+    void copyAtomic(PacketPtr pkt);
+
+    void startRemoteCopy();
+
+    void sendCopyPackets(Cycles delay);
+
+    void finishCopyPacket(Addr size, Cycles delay, TcuError error);
+
+    void startTransfer(const MemEp &mep, bool write, Cycles delay);
+
+    /**
+     * Prepares the transfer of <size> bytes between <local> and <offset>
+     * within the memory EP. Returns false if it is out of bounds.
+     */
+    bool setupTransfer(Addr local, Addr offset, Addr size);
+
+    void sendPackets(Cycles delay);
+
+    Cycles transferAtomic(Cycles delay);
+
+    void transferSgAtomic(Cycles delay);
+
+    /**
+     * Called as soon as the contiguous transfer is done. Finishes the
+     * command or continues with the next descriptor.
+     */
+    void finishTransfer(Cycles delay);
+
+    /**
+     * Translates the address of the next descriptor. Returns false if the
+     * command should be finished.
+     */
+    bool translateDescriptor(NocAddr *phys, Cycles *delay);
+
+    void fetchDescriptor(Cycles delay);
+
+    /**
+     * Prepares the transfer for the remaining part of <desc>. Returns false
+     * if it is out of bounds.
+     */
+    bool setupDescriptor(const SgDesc &desc);
+
+    void nextDescriptor();
+
+    TcuTlb::Result translate(Addr virt, uint access, NocAddr *phys,
+                             Cycles *delay);
+
+    /**
+     * The state of the current READ/WRITE command, which is split into
+     * multiple NoC packets. The DATA and ARG1 registers are only advanced
+     * for the packets that finished in order, so that the command can be
+     * restarted after an abort or a translation fault. In scatter-gather
+     * mode, the transfer covers the current descriptor.
+     */
+    struct Transfer
+    {
+        bool write;
+        // scatter-gather mode
+        bool sg;
+        epid_t epid;
+        // the region of the memory EP
+        NocAddr base;
+        Addr baseSize;
+        // local address and remote address of the first byte
+        Addr local;
+        NocAddr remote;
+        Addr size;
+        // bytes for which a packet has been issued
+        Addr issued;
+        // bytes that have been transferred in order
+        Addr finished;
+        // packets that finished out of order (offset -> size)
+        std::map<Addr, Addr> done;
+        unsigned inFlight;
+        // waiting for the page-table walker
+        bool walking;
+        TcuError error;
+        // the last translated page and the access rights checked for it
+        Addr page;
+        uint pageAccess;
+        NocAddr pagePhys;
+    };
+
     Tcu &tcu;
 
     EpFile::EpCache eps;
 
+    Transfer xfer;
+
+    // remote atomic operations on our memory are executed one after another
+    // as a single memory access each. the first one is currently executed.
+    std::deque<PacketPtr> remoteAtomics;
+    uint64_t remoteAtomicOld;
+
+    // copies with us as the source are executed one after another as well.
+    // the packets of the first one are pipelined like the ones of READ/WRITE.
+    std::deque<PacketPtr> remoteCopies;
+    struct
+    {
+        Addr issued;
+        unsigned inFlight;
+        TcuError error;
+    } copy;
+
     Stats::Histogram readBytes;
     Stats::Histogram writtenBytes;
     Stats::Histogram receivedBytes;
     Stats::Scalar wrongAct;
+    Stats::Histogram packetsInFlight;
+    Stats::Scalar atomicOps;
+    Stats::Scalar copies;
+    Stats::Histogram copiedBytes;
 
 };
 
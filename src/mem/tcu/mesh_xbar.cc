@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#include "mem/tcu/mesh_xbar.hh"
+
+#include <algorithm>
+
+#include "base/intmath.hh"
+#include "base/trace.hh"
+#include "debug/MeshXBar.hh"
+
+static const char *dirNames[] = {"east", "west", "north", "south"};
+
+MeshXBar::MeshXBar(const MeshXBarParams &p)
+    : NoncoherentXBar(p),
+      rows(p.rows),
+      cols(p.cols),
+      torus(p.torus),
+      routerLatency(p.router_latency),
+      linkLatency(p.link_latency),
+      linkWidth(p.link_width),
+      numVcs(p.vcs),
+      cpuSideRouters(p.cpu_side_routers),
+      memSideRouters(p.mem_side_routers),
+      links(p.rows * p.cols * DIRECTIONS)
+{
+    fatal_if(rows == 0 || cols == 0, "The mesh needs at least one router\n");
+    fatal_if(linkWidth == 0 || p.buffer_depth == 0 || numVcs == 0,
+             "Links need a width, buffers, and virtual channels\n");
+
+    for (auto r : cpuSideRouters)
+        fatal_if(r >= rows * cols, "Invalid router %u\n", r);
+    for (auto r : memSideRouters)
+        fatal_if(r >= rows * cols, "Invalid router %u\n", r);
+
+    for (auto &link : links)
+    {
+        link.vcs.resize(numVcs);
+        for (auto &vc : link.vcs)
+        {
+            vc.end = 0;
+            vc.slots.resize(p.buffer_depth, 0);
+        }
+    }
+}
+
+void
+MeshXBar::regStats()
+{
+    NoncoherentXBar::regStats();
+
+    linkBusy
+        .init(links.size())
+        .name(name() + ".linkBusy")
+        .desc("Number of ticks the links were busy")
+        .flags(Stats::nozero);
+    linkPackets
+        .init(links.size())
+        .name(name() + ".linkPackets")
+        .desc("Number of packets transferred over the links")
+        .flags(Stats::nozero);
+    for (size_t i = 0; i < links.size(); ++i)
+    {
+        std::string lname = csprintf("r%u_%s", i / DIRECTIONS,
+                                     dirNames[i % DIRECTIONS]);
+        linkBusy.subname(i, lname);
+        linkPackets.subname(i, lname);
+    }
+
+    linkUtilization
+        .name(name() + ".linkUtilization")
+        .desc("Utilization of the links")
+        .flags(Stats::nozero | Stats::nonan);
+    linkUtilization = linkBusy / simTicks;
+    for (size_t i = 0; i < links.size(); ++i)
+    {
+        linkUtilization.subname(i, csprintf("r%u_%s", i / DIRECTIONS,
+                                            dirNames[i % DIRECTIONS]));
+    }
+
+    creditStalls
+        .name(name() + ".creditStalls")
+        .desc("Number of ticks packets waited for buffers of the next router");
+    hopCount
+        .init(8)
+        .name(name() + ".hops")
+        .desc("Number of hops per packet");
+    meshLatency
+        .init(16)
+        .name(name() + ".meshLatency")
+        .desc("Latency through the mesh (in cycles)")
+        .flags(Stats::nozero);
+    vcLatency
+        .init(numVcs, 0, 255, 8)
+        .name(name() + ".vcLatency")
+        .desc("Latency through the mesh per virtual channel (in cycles)")
+        .flags(Stats::nozero);
+}
+
+unsigned
+MeshXBar::router(const std::vector<unsigned> &routers, PortID id) const
+{
+    // ports without explicit placement are attached to the first router
+    return static_cast<size_t>(id) < routers.size() ? routers[id] : 0;
+}
+
+MeshXBar::Direction
+MeshXBar::nextDirection(unsigned cur, unsigned dst) const
+{
+    unsigned cx = cur % cols, cy = cur / cols;
+    unsigned dx = dst % cols, dy = dst / cols;
+
+    // XY routing: first along the row, then along the column
+    if (cx != dx)
+    {
+        if (torus)
+        {
+            unsigned east = (dx + cols - cx) % cols;
+            return east <= cols - east ? EAST : WEST;
+        }
+        return dx > cx ? EAST : WEST;
+    }
+
+    assert(cy != dy);
+    if (torus)
+    {
+        unsigned south = (dy + rows - cy) % rows;
+        return south <= rows - south ? SOUTH : NORTH;
+    }
+    return dy > cy ? SOUTH : NORTH;
+}
+
+unsigned
+MeshXBar::neighbor(unsigned cur, Direction dir) const
+{
+    unsigned x = cur % cols, y = cur / cols;
+    switch (dir)
+    {
+        case EAST:
+            x = (x + 1) % cols;
+            break;
+        case WEST:
+            x = (x + cols - 1) % cols;
+            break;
+        case SOUTH:
+            y = (y + 1) % rows;
+            break;
+        default:
+            y = (y + rows - 1) % rows;
+            break;
+    }
+    return y * cols + x;
+}
+
+unsigned
+MeshXBar::virtualChannel(PacketPtr pkt) const
+{
+    return std::min<unsigned>(pkt->qosValue(), numVcs - 1);
+}
+
+Tick
+MeshXBar::linkFree(const Link &link, unsigned vc, Tick when,
+                   Tick duration) const
+{
+    // wait for the packets of our own and higher channels
+    Tick free = when;
+    for (unsigned i = vc; i < numVcs; ++i)
+        free = std::max(free, link.vcs[i].end);
+
+    // the packets of lower channels have already been reserved and cannot
+    // be pushed back, because their latency is fixed. thus, find the first
+    // gap that is large enough.
+    auto it = link.busy.upper_bound(free);
+    if (it != link.busy.begin())
+        --it;
+    for (; it != link.busy.end(); ++it)
+    {
+        if (it->first >= free + duration)
+            break;
+        free = std::max(free, it->second);
+    }
+    return free;
+}
+
+Tick
+MeshXBar::route(unsigned src, unsigned dst, unsigned size, unsigned vc,
+                std::vector<Hop> &path) const
+{
+    // one header flit plus the payload
+    Tick serialize = cyclesToTicks(Cycles(1 + divCeil(size, linkWidth)));
+    Tick now = clockEdge();
+    Tick t = now + cyclesToTicks(routerLatency);
+
+    unsigned cur = src;
+    while (cur != dst)
+    {
+        Direction dir = nextDirection(cur, dst);
+        unsigned idx = cur * DIRECTIONS + dir;
+        const Link &link = links[idx];
+        const VirtualChannel &chan = link.vcs[vc];
+
+        // wait for the link and for a free slot in the next router's buffer
+        auto slot = std::min_element(chan.slots.begin(), chan.slots.end());
+        Tick start = linkFree(link, vc, t, serialize);
+        Tick stall = 0;
+        if (*slot > start)
+        {
+            stall = *slot - start;
+            start = linkFree(link, vc, *slot, serialize);
+        }
+
+        // the packet leaves the previous buffer once it has been sent
+        if (!path.empty())
+            path.back().leave = start + serialize;
+
+        path.push_back(Hop {
+            idx, vc, static_cast<unsigned>(slot - chan.slots.begin()),
+            start, start + serialize, 0, stall
+        });
+
+        // the next router can start to forward the packet after the header
+        // arrived (virtual cut-through)
+        t = start + cyclesToTicks(linkLatency + routerLatency);
+        cur = neighbor(cur, dir);
+    }
+
+    // the destination router hands the packet to the port
+    if (!path.empty())
+        path.back().leave = t + serialize;
+
+    return t - curTick();
+}
+
+void
+MeshXBar::reserve(const std::vector<Hop> &path, unsigned vc, Tick delay)
+{
+    for (auto &hop : path)
+    {
+        Link &link = links[hop.link];
+        VirtualChannel &chan = link.vcs[hop.vc];
+        chan.end = std::max(chan.end, hop.end);
+        chan.slots[hop.slot] = hop.leave;
+
+        // forget the occupancy that is over and record ours
+        while (!link.busy.empty() && link.busy.begin()->second <= curTick())
+            link.busy.erase(link.busy.begin());
+        link.busy[hop.start] = hop.end;
+
+        linkBusy[hop.link] += hop.end - hop.start;
+        linkPackets[hop.link]++;
+        creditStalls += hop.stall;
+    }
+
+    hopCount.sample(path.size());
+    meshLatency.sample(ticksToCycles(delay));
+    vcLatency[vc].sample(ticksToCycles(delay));
+}
+
+bool
+MeshXBar::recvTimingReq(PacketPtr pkt, PortID cpu_side_port_id)
+{
+    ResponsePort *src_port = cpuSidePorts[cpu_side_port_id];
+
+    PortID mem_side_port_id = findPort(pkt->getAddrRange());
+
+    if (!reqLayers[mem_side_port_id]->tryTiming(src_port))
+    {
+        DPRINTF(MeshXBar, "recvTimingReq: src %s %s 0x%x BUSY\n",
+                src_port->name(), pkt->cmdString(), pkt->getAddr());
+        return false;
+    }
+
+    unsigned int pkt_size = pkt->hasData() ? pkt->getSize() : 0;
+    unsigned int pkt_cmd = pkt->cmdToIndex();
+
+    unsigned vc = virtualChannel(pkt);
+    std::vector<Hop> path;
+    Tick mesh_delay = route(router(cpuSideRouters, cpu_side_port_id),
+                            router(memSideRouters, mem_side_port_id),
+                            pkt_size, vc, path);
+
+    DPRINTF(MeshXBar,
+            "recvTimingReq: src %s %s 0x%x (vc %u, %lu hops, %lu ticks)\n",
+            src_port->name(), pkt->cmdString(), pkt->getAddr(),
+            vc, path.size(), mesh_delay);
+
+    Tick old_header_delay = pkt->headerDelay;
+
+    Tick xbar_delay = (frontendLatency + forwardLatency) * clockPeriod();
+    calcPacketTiming(pkt, xbar_delay + mesh_delay);
+
+    Tick packetFinishTime = clockEdge(Cycles(1)) + pkt->payloadDelay;
+
+    const bool expect_response = pkt->needsResponse() &&
+        !pkt->cacheResponding();
+
+    if (!memSidePorts[mem_side_port_id]->sendTimingReq(pkt))
+    {
+        DPRINTF(MeshXBar, "recvTimingReq: src %s %s 0x%x RETRY\n",
+                src_port->name(), pkt->cmdString(), pkt->getAddr());
+
+        // the packet did not enter the mesh; leave the links untouched
+        pkt->headerDelay = old_header_delay;
+        reqLayers[mem_side_port_id]->failedTiming(src_port,
+                                                  clockEdge(Cycles(1)));
+        return false;
+    }
+
+    reserve(path, vc, mesh_delay);
+
+    if (expect_response)
+    {
+        assert(routeTo.find(pkt->req) == routeTo.end());
+        routeTo[pkt->req] = cpu_side_port_id;
+    }
+
+    reqLayers[mem_side_port_id]->succeededTiming(packetFinishTime);
+
+    pktCount[cpu_side_port_id][mem_side_port_id]++;
+    pktSize[cpu_side_port_id][mem_side_port_id] += pkt_size;
+    transDist[pkt_cmd]++;
+
+    return true;
+}
+
+bool
+MeshXBar::recvTimingResp(PacketPtr pkt, PortID mem_side_port_id)
+{
+    RequestPort *src_port = memSidePorts[mem_side_port_id];
+
+    const auto route_lookup = routeTo.find(pkt->req);
+    assert(route_lookup != routeTo.end());
+    const PortID cpu_side_port_id = route_lookup->second;
+    assert(cpu_side_port_id != InvalidPortID);
+    assert(cpu_side_port_id < respLayers.size());
+
+    if (!respLayers[cpu_side_port_id]->tryTiming(src_port))
+    {
+        DPRINTF(MeshXBar, "recvTimingResp: src %s %s 0x%x BUSY\n",
+                src_port->name(), pkt->cmdString(), pkt->getAddr());
+        return false;
+    }
+
+    unsigned int pkt_size = pkt->hasData() ? pkt->getSize() : 0;
+    unsigned int pkt_cmd = pkt->cmdToIndex();
+
+    // responses take the way back and are always accepted
+    unsigned vc = virtualChannel(pkt);
+    std::vector<Hop> path;
+    Tick mesh_delay = route(router(memSideRouters, mem_side_port_id),
+                            router(cpuSideRouters, cpu_side_port_id),
+                            pkt_size, vc, path);
+    reserve(path, vc, mesh_delay);
+
+    DPRINTF(MeshXBar,
+            "recvTimingResp: src %s %s 0x%x (vc %u, %lu hops, %lu ticks)\n",
+            src_port->name(), pkt->cmdString(), pkt->getAddr(),
+            vc, path.size(), mesh_delay);
+
+    Tick xbar_delay = responseLatency * clockPeriod();
+    calcPacketTiming(pkt, xbar_delay + mesh_delay);
+
+    Tick packetFinishTime = clockEdge(Cycles(1)) + pkt->payloadDelay;
+
+    Tick latency = pkt->headerDelay;
+    pkt->headerDelay = 0;
+    cpuSidePorts[cpu_side_port_id]->schedTimingResp(pkt,
+                                                    curTick() + latency);
+
+    routeTo.erase(route_lookup);
+
+    respLayers[cpu_side_port_id]->succeededTiming(packetFinishTime);
+
+    pktCount[cpu_side_port_id][mem_side_port_id]++;
+    pktSize[cpu_side_port_id][mem_side_port_id] += pkt_size;
+    transDist[pkt_cmd]++;
+
+    return true;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#ifndef __MEM_TCU_MESH_XBAR_HH__
+#define __MEM_TCU_MESH_XBAR_HH__
+
+#include "mem/noncoherent_xbar.hh"
+#include "params/MeshXBar.hh"
+#include "sim/stats.hh"
+
+#include <map>
+#include <vector>
+
+/**
+ * A packet-switched 2D mesh (or torus) that connects the tiles. It uses the
+ * ports, address decoding and layers of the non-coherent crossbar, but adds
+ * the latency of the path through the mesh to each packet.
+ *
+ * Every port is attached to one of the rows * cols routers. Packets are
+ * routed in XY order. Each hop pays the router latency and waits until the
+ * link is free and the input buffer of the next router has a free slot
+ * (credit-based flow control). The link is occupied for the serialization
+ * time of the packet (header flit + payload) and the buffer slot is held
+ * until the packet has left the next router.
+ *
+ * Each link has multiple virtual channels with separate buffers. Packets use
+ * the channel of their QoS value (the TCU stores its traffic class there).
+ * The link arbitrates between the channels with strict priority, higher
+ * channels first: a packet waits for the packets of its own and higher
+ * channels, but can use the gaps between the packets of lower channels.
+ *
+ * Like the crossbar, the mesh does not delay the packets itself, but
+ * annotates the latency on the packet. Thus, the links and buffers are
+ * reserved in advance when a packet enters the mesh. Since the latency of
+ * a packet is fixed at that point, reservations are never moved. Instead,
+ * each link records when it is occupied, so that a packet only uses the
+ * link when it is actually free.
+ */
+class MeshXBar : public NoncoherentXBar
+{
+  public:
+
+    MeshXBar(const MeshXBarParams &p);
+
+    void regStats() override;
+
+  private:
+
+    enum Direction
+    {
+        EAST,
+        WEST,
+        NORTH,
+        SOUTH,
+        DIRECTIONS,
+    };
+
+    struct VirtualChannel
+    {
+        // the time the last packet of this channel leaves the link
+        Tick end;
+        // the ticks at which the buffer slots of the next router become free
+        std::vector<Tick> slots;
+    };
+
+    struct Link
+    {
+        std::vector<VirtualChannel> vcs;
+        // the reserved occupancy of the link (start -> end)
+        std::map<Tick, Tick> busy;
+    };
+
+    struct Hop
+    {
+        unsigned link;
+        unsigned vc;
+        unsigned slot;
+        // the time the link is occupied
+        Tick start;
+        Tick end;
+        // the time the packet leaves the buffer of the next router
+        Tick leave;
+        // the time the packet waited for a credit
+        Tick stall;
+    };
+
+    bool recvTimingReq(PacketPtr pkt, PortID cpu_side_port_id) override;
+    bool recvTimingResp(PacketPtr pkt, PortID mem_side_port_id) override;
+
+    unsigned router(const std::vector<unsigned> &routers, PortID id) const;
+
+    Direction nextDirection(unsigned cur, unsigned dst) const;
+
+    unsigned neighbor(unsigned cur, Direction dir) const;
+
+    unsigned virtualChannel(PacketPtr pkt) const;
+
+    /**
+     * Returns the first tick at which the given link is available for
+     * <duration> ticks for a packet on the given virtual channel that
+     * arrives at <when>.
+     */
+    Tick linkFree(const Link &link, unsigned vc, Tick when,
+                  Tick duration) const;
+
+    /**
+     * Determines the path of a packet with given size and virtual channel
+     * from router <src> to router <dst>, starting at the current tick. The
+     * links are not reserved yet.
+     *
+     * @return the delay until the header arrived at the destination
+     */
+    Tick route(unsigned src, unsigned dst, unsigned size, unsigned vc,
+               std::vector<Hop> &path) const;
+
+    /**
+     * Reserves the links and buffers on the given path.
+     */
+    void reserve(const std::vector<Hop> &path, unsigned vc, Tick delay);
+
+    const unsigned rows;
+    const unsigned cols;
+    const bool torus;
+    const Cycles routerLatency;
+    const Cycles linkLatency;
+    const unsigned linkWidth;
+    const unsigned numVcs;
+    const std::vector<unsigned> cpuSideRouters;
+    const std::vector<unsigned> memSideRouters;
+
+    // DIRECTIONS links per router
+    std::vector<Link> links;
+
+    Stats::Vector linkBusy;
+    Stats::Vector linkPackets;
+    Stats::Formula linkUtilization;
+    Stats::Scalar creditStalls;
+    Stats::Histogram hopCount;
+    Stats::Histogram meshLatency;
+    Stats::VectorDistribution vcLatency;
+};
+
+#endif
@@ -36,6 +36,7 @@
 #include "debug/TcuMsgs.hh"
 #include "mem/tcu/msg_unit.hh"
 #include "mem/tcu/noc_addr.hh"
+#include "mem/tcu/pt_unit.hh"
 #include "mem/tcu/xfer_unit.hh"
 
 void
@@ -51,6 +52,11 @@ MessageUnit::regStats()
         .name(tcu.name() + ".msg.repliedBytes")
         .desc("Sent replies (in bytes)")
         .flags(Stats::nozero);
+    mcastDests
+        .init(8)
+        .name(tcu.name() + ".msg.mcastDests")
+        .desc("Number of destinations per multicast message")
+        .flags(Stats::nozero);
     receivedBytes
         .init(8)
         .name(tcu.name() + ".msg.receivedBytes")
@@ -64,6 +70,16 @@ MessageUnit::regStats()
         .name(tcu.name() + ".msg.noSpace")
         .desc("Number of received messages we dropped")
         .flags(Stats::nozero);
+    fetchedMsgs
+        .init(8)
+        .name(tcu.name() + ".msg.fetchedMsgs")
+        .desc("Number of messages fetched per FETCH_MSGS")
+        .flags(Stats::nozero);
+    ackedMsgs
+        .init(8)
+        .name(tcu.name() + ".msg.ackedMsgs")
+        .desc("Number of messages acked per ACK_MSGS")
+        .flags(Stats::nozero);
 }
 
 void
@@ -115,14 +131,20 @@ MessageUnit::startReplyWithEP(EpFile::EpCache &eps)
                                  cmd.epid, cmd.arg0);
     }
 
-    if ((rep.r0.rplEps + (1 << rep.r0.slots)) > tcu.numEndpoints)
+    if (!tcu.regs().validSlots(rep))
+    {
+        return tcu.schedCmdError(delay, TcuError::NO_REP,
+                                 "EP%u: invalid slot count\n", cmd.epid);
+    }
+
+    if (rep.r0.rplEps + rep.slotCount() > tcu.numEndpoints)
     {
         return tcu.schedCmdError(delay, TcuError::RECV_INV_RPL_EPS,
                                  "EP%u: reply EPs out of bounds\n", cmd.epid);
     }
 
     int msgidx = rep.offsetToIdx(cmd.arg0);
-    if (msgidx == RecvEp::MAX_MSGS)
+    if (msgidx == -1)
     {
         return tcu.schedCmdError(delay, TcuError::INV_MSG_OFF,
                                  "EP%u: offset out of bounds (%#x)\n",
@@ -135,118 +157,165 @@ MessageUnit::startReplyWithEP(EpFile::EpCache &eps)
                             this, std::placeholders::_1, sepid));
 }
 
-void
-MessageUnit::startSendReplyWithEP(EpFile::EpCache &eps, epid_t epid)
+bool
+MessageUnit::checkSendEp(const Ep &ep, epid_t epid, Cycles delay)
 {
     const CmdCommand::Bits cmd = tcu.regs().getCommand();
     const CmdData::Bits data = tcu.regs().getData();
 
-    Cycles delay(cmd.opcode == CmdCommand::REPLY ? tcu.cmdReplyLatency
-                                                 : tcu.cmdSendLatency);
-
-    const Ep ep = eps.getEp(epid);
-
-    Ep replyEp(0);
-    if (cmd.opcode == CmdCommand::SEND && cmd.arg0 != Tcu::INVALID_EP_ID)
-        replyEp = eps.getEp(cmd.arg0);
-
     if(ep.type() != EpType::SEND)
     {
-        return tcu.schedCmdError(delay, TcuError::NO_SEP,
-                                 "EP%u: invalid EP\n", epid);
+        tcu.schedCmdError(delay, TcuError::NO_SEP,
+                          "EP%u: invalid EP\n", epid);
+        return false;
     }
 
     const SendEp &sep = ep.send;
 
     if(sep.r0.act != tcu.regs().getCurAct().id)
     {
-        return tcu.schedCmdError(delay, TcuError::FOREIGN_EP,
-                                 "EP%u: foreign EP\n", epid);
+        tcu.schedCmdError(delay, TcuError::FOREIGN_EP,
+                          "EP%u: foreign EP\n", epid);
+        return false;
     }
 
-    if ((cmd.opcode == CmdCommand::SEND && sep.r0.reply) ||
+    if ((cmd.opcode != CmdCommand::REPLY && sep.r0.reply) ||
         (cmd.opcode == CmdCommand::REPLY && !sep.r0.reply))
     {
-        return tcu.schedCmdError(delay, TcuError::SEND_REPLY_EP,
-                                 "EP%u: send vs. reply\n", epid);
+        tcu.schedCmdError(delay, TcuError::SEND_REPLY_EP,
+                          "EP%u: send vs. reply\n", epid);
+        return false;
     }
 
     // check message size
     if (sep.r0.msgSize > 11)
     {
-        return tcu.schedCmdError(delay, TcuError::SEND_INV_MSG_SZ,
-                                 "EP%u: invalid msgSize\n", epid);
+        tcu.schedCmdError(delay, TcuError::SEND_INV_MSG_SZ,
+                          "EP%u: invalid msgSize\n", epid);
+        return false;
     }
 
     if (data.size + sizeof(MessageHeader) > (1 << sep.r0.msgSize))
     {
-        return tcu.schedCmdError(delay, TcuError::OUT_OF_BOUNDS,
-                                 "EP%u: message too large\n", epid);
+        tcu.schedCmdError(delay, TcuError::OUT_OF_BOUNDS,
+                          "EP%u: message too large\n", epid);
+        return false;
+    }
+
+    return true;
+}
+
+bool
+MessageUnit::getReplyInfo(EpFile::EpCache &eps, epid_t rpepid, Cycles delay,
+                          epid_t *replyEpId, size_t *replySize)
+{
+    if (rpepid == Tcu::INVALID_EP_ID)
+    {
+        *replyEpId = Tcu::INVALID_EP_ID;
+        *replySize = ceil(log2(sizeof(MessageHeader)));
+        return true;
     }
 
+    const Ep replyEp = eps.getEp(rpepid);
+
+    if(replyEp.type() != EpType::RECEIVE)
+    {
+        tcu.schedCmdError(delay, TcuError::NO_REP,
+                          "EP%u: invalid EP\n", rpepid);
+        return false;
+    }
+
+    const RecvEp &rep = replyEp.recv;
+
+    if(rep.r0.act != tcu.regs().getCurAct().id)
+    {
+        tcu.schedCmdError(delay, TcuError::FOREIGN_EP,
+                          "EP%u: foreign EP\n", rpepid);
+        return false;
+    }
+
+    *replyEpId = rpepid;
+    *replySize = rep.r0.slotSize;
+    return true;
+}
+
+bool
+MessageUnit::translateMsgData(epid_t epid, Cycles &delay, NocAddr *phys)
+{
+    const CmdData::Bits data = tcu.regs().getData();
+
     if (data.addr & 0xF)
     {
-        return tcu.schedCmdError(delay, TcuError::MSG_UNALIGNED,
-                                 "EP%u: message is not 16-byte aligned\n",
-                                 epid);
+        tcu.schedCmdError(delay, TcuError::MSG_UNALIGNED,
+                          "EP%u: message is not 16-byte aligned\n", epid);
+        return false;
     }
 
     auto data_page = data.addr & ~static_cast<Addr>(TcuTlb::PAGE_MASK);
     if(data.size != 0 && data_page !=
        ((data.addr + data.size - 1) & ~static_cast<Addr>(TcuTlb::PAGE_MASK)))
     {
-        return tcu.schedCmdError(delay, TcuError::PAGE_BOUNDARY,
-                                 "EP%u: message contains page boundary\n",
-                                 epid);
+        tcu.schedCmdError(delay, TcuError::PAGE_BOUNDARY,
+                          "EP%u: message contains page boundary\n", epid);
+        return false;
     }
 
-    NocAddr phys(data.addr);
+    *phys = NocAddr(data.addr);
     if (tcu.tlb())
     {
         Cycles tlbLatency;
         auto asid = tcu.regs().getCurAct().id;
         auto res = tcu.tlb()->lookup(data.addr, asid, TcuTlb::READ,
-                                     &phys, &tlbLatency);
+                                     phys, &tlbLatency);
         delay += tlbLatency;
 
+        // start the command again as soon as the page-table walk is done.
+        // in atomic mode, the software resolves the miss instead.
+        if (res == TcuTlb::MISS && tcu.walker() && !tcu.atomicMode())
+        {
+            tcu.walker()->startWalk(new SendMissHandler(*this, data.addr));
+            return false;
+        }
+
         if (res != TcuTlb::HIT)
         {
-            return tcu.schedCmdError(delay, TcuError::TRANSLATION_FAULT,
-                                     "EP%u: TLB miss for data address\n",
-                                     epid);
+            tcu.schedCmdError(delay, TcuError::TRANSLATION_FAULT,
+                              "EP%u: TLB miss for data address\n", epid);
+            return false;
         }
     }
 
+    return true;
+}
+
+void
+MessageUnit::startSendReplyWithEP(EpFile::EpCache &eps, epid_t epid)
+{
+    const CmdCommand::Bits cmd = tcu.regs().getCommand();
+    const CmdData::Bits data = tcu.regs().getData();
+
+    Cycles delay(cmd.opcode == CmdCommand::REPLY ? tcu.cmdReplyLatency
+                                                 : tcu.cmdSendLatency);
+
+    const Ep ep = eps.getEp(epid);
+
+    if (!checkSendEp(ep, epid, delay))
+        return;
+
+    const SendEp &sep = ep.send;
+
+    NocAddr phys;
+    if (!translateMsgData(epid, delay, &phys))
+        return;
+
     epid_t replyEpId;
     size_t replySize;
 
     // get info from receive EP
     if (cmd.opcode == CmdCommand::SEND)
     {
-        if (cmd.arg0 != Tcu::INVALID_EP_ID)
-        {
-            if(replyEp.type() != EpType::RECEIVE)
-            {
-                return tcu.schedCmdError(delay, TcuError::NO_REP,
-                                         "EP%u: invalid EP\n", cmd.arg0);
-            }
-
-            const RecvEp &rep = replyEp.recv;
-
-            if(rep.r0.act != tcu.regs().getCurAct().id)
-            {
-                return tcu.schedCmdError(delay, TcuError::FOREIGN_EP,
-                                         "EP%u: foreign EP\n", cmd.arg0);
-            }
-
-            replyEpId = cmd.arg0;
-            replySize = rep.r0.slotSize;
-        }
-        else
-        {
-            replyEpId = Tcu::INVALID_EP_ID;
-            replySize = ceil(log2(sizeof(MessageHeader)));
-        }
+        if (!getReplyInfo(eps, cmd.arg0, delay, &replyEpId, &replySize))
+            return;
     }
     else
     {
@@ -299,6 +368,28 @@ MessageUnit::startSendReplyWithEP(EpFile::EpCache &eps, epid_t epid)
     eps.setAutoFinish(false);
 }
 
+void
+MessageUnit::SendMissHandler::finish(TcuTlb::Result res, NocAddr phys)
+{
+    Tcu &tcu = msgUnit.tcu;
+    const CmdCommand::Bits cmd = tcu.regs().getCommand();
+
+    if (tcu.isCommandAborting())
+        tcu.scheduleCmdFinish(Cycles(1), TcuError::ABORT);
+    else if (res != TcuTlb::HIT)
+    {
+        tcu.schedCmdError(Cycles(1), TcuError::TRANSLATION_FAULT,
+                          "EP%u: TLB miss for data address\n", cmd.epid);
+    }
+    // the translation is in the TLB now
+    else if (cmd.opcode == CmdCommand::REPLY)
+        msgUnit.startReply(cmd);
+    else if (cmd.opcode == CmdCommand::SEND_MC)
+        msgUnit.startSendMcast(cmd);
+    else
+        msgUnit.startSend(cmd);
+}
+
 void
 MessageUnit::SendTransferEvent::transferStart()
 {
@@ -383,6 +474,190 @@ MessageUnit::SendTransferEvent::transferDone(TcuError result)
     msgUnit->cmdEps.onFinished([](EpFile::EpCache &) {});
 }
 
+void
+MessageUnit::startSendMcast(const CmdCommand::Bits &cmd)
+{
+    unsigned count = CmdCommand::mcastCount(cmd.arg0);
+    epid_t rpepid = CmdCommand::mcastReplyEp(cmd.arg0);
+
+    if (count == 0 || cmd.epid + count > tcu.numEndpoints)
+    {
+        return tcu.schedCmdError(Cycles(tcu.cmdSendLatency),
+                                 TcuError::OUT_OF_BOUNDS,
+                                 "EP%u: invalid multicast group (%u EPs)\n",
+                                 cmd.epid, count);
+    }
+
+    for (unsigned i = 0; i < count; ++i)
+        cmdEps.addEp(cmd.epid + i);
+    if (rpepid != Tcu::INVALID_EP_ID)
+        cmdEps.addEp(rpepid);
+    cmdEps.onFetched(std::bind(&MessageUnit::startSendMcastWithEP,
+                               this, std::placeholders::_1));
+}
+
+void
+MessageUnit::startSendMcastWithEP(EpFile::EpCache &eps)
+{
+    const CmdCommand::Bits cmd = tcu.regs().getCommand();
+    const CmdData::Bits data = tcu.regs().getData();
+
+    Cycles delay(tcu.cmdSendLatency);
+
+    unsigned count = CmdCommand::mcastCount(cmd.arg0);
+    epid_t rpepid = CmdCommand::mcastReplyEp(cmd.arg0);
+
+    // all send EPs of the group need to be valid
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if (!checkSendEp(eps.getEp(cmd.epid + i), cmd.epid + i, delay))
+            return;
+    }
+
+    NocAddr phys;
+    if (!translateMsgData(cmd.epid, delay, &phys))
+        return;
+
+    epid_t replyEpId;
+    size_t replySize;
+    if (!getReplyInfo(eps, rpepid, delay, &replyEpId, &replySize))
+        return;
+
+    sentBytes.sample(data.size);
+    mcastDests.sample(count);
+
+    // the EP-specific fields are filled in per destination
+    MessageHeader header;
+    header.flags        = 0;
+    header.senderTileId = tcu.tileId;
+    header.senderEpId   = Tcu::INVALID_EP_ID;
+    header.replyEpId    = replyEpId;
+    header.length       = data.size;
+    header.label        = 0;
+    header.replyLabel   = tcu.regs().get(UnprivReg::ARG1);
+    header.replySize    = replySize;
+
+    assert(data.size + sizeof(MessageHeader) <= tcu.maxNocPacketSize);
+
+    const SendEp &sep = eps.getEp(cmd.epid).send;
+    NocAddr nocAddr(sep.r1.tgtTile, sep.r1.tgtEp);
+    uint flags = XferUnit::MESSAGE;
+
+    // read the payload once and replicate it afterwards
+    auto *ev = new McastTransferEvent(
+        this, cmd.epid, count, phys, data.size, flags, nocAddr, header);
+    tcu.startTransfer(ev, delay);
+
+    eps.setAutoFinish(false);
+}
+
+void
+MessageUnit::McastTransferEvent::transferStart()
+{
+    memcpy(data(), &header, sizeof(header));
+
+    // for the header
+    size(sizeof(header));
+}
+
+void
+MessageUnit::McastTransferEvent::transferDone(TcuError result)
+{
+    EpFile::EpCache &eps = msgUnit->cmdEps;
+
+    // we need credits for all destinations, or we don't send at all
+    for (unsigned i = 0; result == TcuError::NONE && i < count; ++i)
+    {
+        SendEp sep = eps.getEp(firstEp + i).send;
+        if (sep.r0.curCrd == 0)
+        {
+            DPRINTFS(Tcu, (&tcu()),
+                     "EP%u: no credits to send message\n", sep.id);
+            result = TcuError::NO_CREDITS;
+        }
+    }
+
+    if (result != TcuError::NONE)
+    {
+        MemoryUnit::WriteTransferEvent::transferDone(result);
+        eps.onFinished([](EpFile::EpCache &) {});
+        return;
+    }
+
+    msgUnit->sendReplyFinished = false;
+    msgUnit->mcastPending = count;
+    msgUnit->mcastResult = TcuError::NONE;
+    msgUnit->mcastFailed.clear();
+
+    const CmdData::Bits cmdData = tcu().regs().getData();
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        SendEp sep = eps.getEp(firstEp + i).send;
+
+        if (sep.r0.curCrd != Tcu::CREDITS_UNLIM)
+        {
+            sep.r0.curCrd = sep.r0.curCrd - 1;
+
+            DPRINTFS(TcuCredits, (&tcu()),
+                     "EP%u paid 1 credit (%u left)\n",
+                     sep.id, sep.r0.curCrd);
+
+            eps.updateEp(sep);
+        }
+
+        NocAddr dest(sep.r1.tgtTile, sep.r1.tgtEp);
+        auto pkt = tcu().generateRequest(dest.getAddr(),
+                                         size(),
+                                         MemCmd::WriteReq);
+        memcpy(pkt->getPtr<uint8_t>(), data(), size());
+
+        // fill in the EP-specific part of the header
+        MessageHeader *pktHeader = pkt->getPtr<MessageHeader>();
+        pktHeader->senderEpId = sep.r0.curCrd == Tcu::CREDITS_UNLIM
+                                ? Tcu::INVALID_EP_ID
+                                : sep.id;
+        pktHeader->label = sep.r2.label;
+
+        DPRINTFS(Tcu, (&tcu()),
+                 "\e[1m[mc -> %u]\e[0m with EP%u of %#018lx:%lu\n",
+                 sep.r1.tgtTile, sep.id, cmdData.addr, cmdData.size);
+
+        DPRINTFS(Tcu, (&tcu()),
+                 "  dst: tile=%u ep=%u lbl=%#018lx\n",
+                 sep.r1.tgtTile, sep.r1.tgtEp, pktHeader->label);
+
+        tcu().printPacket(pkt);
+
+        // one packet per cycle (atomic requests accumulate the delays)
+        Cycles delay(tcu().atomicMode() ? 1 : 1 + i);
+        tcu().sendNocRequest(Tcu::NocPacketType::MESSAGE, pkt, delay);
+    }
+
+    eps.onFinished([](EpFile::EpCache &) {});
+}
+
+void
+MessageUnit::finishMcastPacket(PacketPtr pkt, Cycles delay, TcuError result)
+{
+    assert(mcastPending > 0);
+
+    if (result != TcuError::NONE)
+    {
+        // remember the first error, but wait for all other packets
+        if (mcastResult == TcuError::NONE)
+            mcastResult = result;
+
+        // this destination did not get the message; refund its credit
+        auto header = pkt->getConstPtr<MessageHeader>();
+        if (header->senderEpId != Tcu::INVALID_EP_ID)
+            mcastFailed.push_back(header->senderEpId);
+    }
+
+    if (--mcastPending == 0)
+        tcu.scheduleCmdFinish(delay, mcastResult);
+}
+
 bool
 MessageUnit::finishMsgSend(TcuError result)
 {
@@ -391,6 +666,8 @@ MessageUnit::finishMsgSend(TcuError result)
         // fetch the EP again and finish the send
         CmdCommand::Bits cmd = tcu.regs().getCommand();
         cmdEps.addEp(cmd.epid);
+        for (epid_t ep : mcastFailed)
+            cmdEps.addEp(ep);
         cmdEps.onFetched(std::bind(&MessageUnit::finishMsgSendWithEp,
                                    this, std::placeholders::_1, result));
         return false;
@@ -410,6 +687,13 @@ MessageUnit::finishMsgSendWithEp(EpFile::EpCache &eps, TcuError result)
     {
         RecvEp rep = eps.getEp(cmd.epid).recv;
         int msgidx = rep.offsetToIdx(cmd.arg0);
+        assert(msgidx != -1);
+        if (addReplyEp(eps, rep, msgidx))
+        {
+            eps.onFetched(std::bind(&MessageUnit::finishMsgSendWithEp,
+                                    this, std::placeholders::_1, result));
+            return;
+        }
         ackMessage(rep, msgidx);
     }
 
@@ -420,6 +704,17 @@ MessageUnit::finishMsgSendWithEp(EpFile::EpCache &eps, TcuError result)
         recvCredits(eps, sep);
     }
 
+    // for multicasts, only to the destinations that did not get the message
+    if (cmd.opcode == CmdCommand::SEND_MC)
+    {
+        for (epid_t ep : mcastFailed)
+        {
+            SendEp sep = eps.getEp(ep).send;
+            recvCredits(eps, sep);
+        }
+        mcastFailed.clear();
+    }
+
     // we've updated EPs, so ensure that we write them back before finishing
     cmdEps.onFinished([](EpFile::EpCache &) {});
 
@@ -457,12 +752,15 @@ MessageUnit::invalidateWithEP(EpFile::EpCache &eps)
         }
     }
 
+    // for extended receive EPs, we can only report the number of unread
+    // messages, because they do not fit into a mask
     if (!force && ep.type() == EpType::RECEIVE)
         unreadMask = ep.recv.r2.unread;
 
     for (int i = 0; i < numEpRegs; ++i)
         ep.inval.r[i] = 0;
     eps.updateEp(ep.send);
+    tcu.regs().clearExtSlots(epid);
 
     eps.onFinished([this, unreadMask](EpFile::EpCache &) {
         tcu.scheduleExtCmdFinish(Cycles(1), TcuError::NONE, unreadMask);
@@ -498,6 +796,16 @@ MessageUnit::fetchWithEP(EpFile::EpCache &eps)
                                  "EP%u: foreign EP\n", cmd.epid);
     }
 
+    if (!tcu.regs().validSlots(rep))
+    {
+        return tcu.schedCmdError(delay, TcuError::NO_REP,
+                                 "EP%u: invalid slot count\n", cmd.epid);
+    }
+
+    RecvSlots slots(tcu.regs(), rep);
+    if (cmd.opcode == CmdCommand::FETCH_MSGS)
+        return fetchAllWithEP(eps, rep, slots, delay);
+
     // check if the current activity has unread messages at all. note that this is
     // important in case it is out of sync with the receive EPs, i.e., if we
     // have ongoing foreignRecv core requests.
@@ -508,36 +816,89 @@ MessageUnit::fetchWithEP(EpFile::EpCache &eps)
         return;
     }
 
-    int i;
-    for (i = rep.r0.rpos; i < (1 << rep.r0.slots); ++i)
+    size_t start = slots.rpos();
+    int i = slots.findUnread(start);
+    assert(i != -1);
+    assert(slots.isOccupied(i));
+
+    // charge one cycle per visited slot as with a linear search
+    size_t dist = (i - start + slots.count()) % slots.count();
+    delay += Cycles(dist + 1);
+
+    slots.setUnread(i, false);
+    slots.rpos((i + 1) % slots.count());
+
+    DPRINTFS(TcuBuf, (&tcu),
+        "EP%u: fetched message at index %u (count=%u)\n",
+        cmd.epid, i, slots.unreadMsgs());
+
+    eps.updateEp(rep);
+    tcu.regs().rem_msg();
+    tcu.regs().set(UnprivReg::ARG1, i << rep.r0.slotSize);
+    delay = delay + Cycles(3);
+
+    eps.onFinished([this, delay](EpFile::EpCache &) {
+        tcu.scheduleCmdFinish(delay, TcuError::NONE);
+    });
+}
+
+void
+MessageUnit::fetchAllWithEP(EpFile::EpCache &eps, RecvEp &rep,
+                            RecvSlots &slots, Cycles delay)
+{
+    // as for FETCH_MSG, we can't fetch more messages than the activity has
+    unsigned avail = tcu.regs().getCurAct().msgs;
+    uint32_t mask = 0;
+    unsigned count = 0;
+
+    // the mask covers at most MASK_SLOTS slots. thus, for EPs with more slots,
+    // we fetch the messages from the window that contains the next unread one
+    size_t base = 0;
+    size_t window = std::min(slots.count(), RecvEp::MASK_SLOTS);
+    size_t start = slots.rpos();
+    if (slots.count() > RecvEp::MASK_SLOTS)
     {
-        ++delay;
-        if (rep.isUnread(i))
-            goto found;
+        int first = slots.findUnread(start);
+        if (first != -1)
+        {
+            delay += Cycles((first - start + slots.count()) % slots.count());
+            base = first & ~(RecvEp::MASK_SLOTS - 1);
+            start = first;
+        }
+        else
+            start = base;
     }
-    for (i = 0; i < rep.r0.rpos; ++i)
+
+    // walk through the window, starting at rpos, as FETCH_MSG would do
+    for (size_t n = 0; n < window && count < avail; ++n)
     {
+        size_t i = base + (start - base + n) % window;
         ++delay;
-        if (rep.isUnread(i))
-            goto found;
+        if (slots.isUnread(i))
+        {
+            assert(slots.isOccupied(i));
+            slots.setUnread(i, false);
+            slots.rpos((i + 1) % slots.count());
+            mask |= static_cast<uint32_t>(1) << (i - base);
+            count++;
+        }
     }
 
-    // should not get here
-    assert(false);
-
-found:
-    assert(rep.isOccupied(i));
+    tcu.regs().set(UnprivReg::ARG1, RecvEp::slotMask(mask, base));
 
-    rep.setUnread(i, false);
-    rep.r0.rpos = i + 1;
+    if (count == 0)
+    {
+        tcu.scheduleCmdFinish(delay, TcuError::NONE);
+        return;
+    }
 
     DPRINTFS(TcuBuf, (&tcu),
-        "EP%u: fetched message at index %u (count=%u)\n",
-        cmd.epid, i, rep.unreadMsgs());
+        "EP%u: fetched %u messages (mask=%#x, base=%lu, count=%u)\n",
+        rep.id, count, mask, base, slots.unreadMsgs());
 
+    fetchedMsgs.sample(count);
     eps.updateEp(rep);
-    tcu.regs().rem_msg();
-    tcu.regs().set(UnprivReg::ARG1, i << rep.r0.slotSize);
+    tcu.regs().rem_msg(count);
     delay = delay + Cycles(3);
 
     eps.onFinished([this, delay](EpFile::EpCache &) {
@@ -574,20 +935,36 @@ MessageUnit::startAckWithEP(EpFile::EpCache &eps)
                                  "EP%u: foreign EP\n", cmd.epid);
     }
 
+    if (!tcu.regs().validSlots(rep))
+    {
+        return tcu.schedCmdError(delay, TcuError::NO_REP,
+                                 "EP%u: invalid slot count\n", cmd.epid);
+    }
+
     if (rep.r0.rplEps != Tcu::INVALID_EP_ID &&
-        (rep.r0.rplEps + (1 << rep.r0.slots)) > tcu.numEndpoints)
+        rep.r0.rplEps + rep.slotCount() > tcu.numEndpoints)
     {
         return tcu.schedCmdError(delay, TcuError::RECV_INV_RPL_EPS,
                                  "EP%u: invalid reply EPs\n", cmd.epid);
     }
 
+    if (cmd.opcode == CmdCommand::ACK_MSGS)
+        return ackAllWithEP(eps, rep, delay);
+
     int msgidx = rep.offsetToIdx(cmd.arg0);
-    if (msgidx == RecvEp::MAX_MSGS)
+    if (msgidx == -1)
     {
         return tcu.schedCmdError(delay, TcuError::INV_MSG_OFF,
                                  "EP%u: invalid message offset\n", cmd.epid);
     }
 
+    if (addReplyEp(eps, rep, msgidx))
+    {
+        eps.onFetched(std::bind(&MessageUnit::startAckWithEP,
+                                this, std::placeholders::_1));
+        return;
+    }
+
     ackMessage(rep, msgidx);
 
     eps.onFinished([this, delay](EpFile::EpCache &) {
@@ -595,13 +972,82 @@ MessageUnit::startAckWithEP(EpFile::EpCache &eps)
     });
 }
 
+void
+MessageUnit::ackAllWithEP(EpFile::EpCache &eps, RecvEp &rep, Cycles delay)
+{
+    uint64_t arg = tcu.regs().get(UnprivReg::ARG1);
+    uint32_t mask = RecvEp::slotMaskBits(arg);
+    size_t base = RecvEp::slotMaskBase(arg);
+    size_t slots = rep.slotCount();
+
+    // all slots in the mask need to exist
+    if (mask != 0 && (base >= slots ||
+        (slots - base < RecvEp::MASK_SLOTS && (mask >> (slots - base)) != 0)))
+    {
+        return tcu.schedCmdError(delay, TcuError::INV_MSG_OFF,
+                                 "EP%u: invalid slot mask %#x (base %lu)\n",
+                                 rep.id, mask, base);
+    }
+
+    bool added = false;
+    for (size_t i = 0; i < RecvEp::MASK_SLOTS; ++i)
+    {
+        if (mask & (static_cast<uint32_t>(1) << i))
+            added |= addReplyEp(eps, rep, base + i);
+    }
+    if (added)
+    {
+        eps.onFetched(std::bind(&MessageUnit::startAckWithEP,
+                                this, std::placeholders::_1));
+        return;
+    }
+
+    unsigned count = 0;
+    for (size_t i = 0; i < RecvEp::MASK_SLOTS; ++i)
+    {
+        if (mask & (static_cast<uint32_t>(1) << i))
+        {
+            ackMessage(rep, base + i);
+            count++;
+        }
+    }
+
+    if (count > 0)
+    {
+        ackedMsgs.sample(count);
+        // the first ACK is included in the command latency
+        delay += Cycles(count - 1);
+    }
+
+    eps.onFinished([this, delay](EpFile::EpCache &) {
+        tcu.scheduleCmdFinish(delay, TcuError::NONE);
+    });
+}
+
+bool
+MessageUnit::addReplyEp(EpFile::EpCache &eps, const RecvEp &rep, int msgidx)
+{
+    // reply EPs are only known after the receive EP has been fetched. thus,
+    // we add them afterwards and fetch again to wait for the lock.
+    if (rep.r0.rplEps == Tcu::INVALID_EP_ID)
+        return false;
+
+    epid_t rpl = rep.r0.rplEps + msgidx;
+    if (eps.hasEp(rpl))
+        return false;
+
+    eps.addEp(rpl);
+    return true;
+}
+
 void MessageUnit::ackMessage(RecvEp &rep, int msgidx)
 {
+    RecvSlots slots(tcu.regs(), rep);
     bool unread = false;
-    rep.setOccupied(msgidx, false);
-    if (rep.isUnread(msgidx))
+    slots.setOccupied(msgidx, false);
+    if (slots.isUnread(msgidx))
     {
-        rep.setUnread(msgidx, false);
+        slots.setUnread(msgidx, false);
         unread = true;
     }
 
@@ -628,23 +1074,13 @@ void MessageUnit::ackMessage(RecvEp &rep, int msgidx)
 int
 MessageUnit::allocSlot(EpFile::EpCache &eps, RecvEp &ep)
 {
-    int i;
-    for (i = ep.r0.wpos; i < (1 << ep.r0.slots); ++i)
-    {
-        if (!ep.isOccupied(i))
-            goto found;
-    }
-    for (i = 0; i < ep.r0.wpos; ++i)
-    {
-        if (!ep.isOccupied(i))
-            goto found;
-    }
+    RecvSlots slots(tcu.regs(), ep);
+    int i = slots.findFree(slots.wpos());
+    if (i == -1)
+        return -1;
 
-    return -1;
-
-found:
-    ep.setOccupied(i, true);
-    ep.r0.wpos = i + 1;
+    slots.setOccupied(i, true);
+    slots.wpos((i + 1) % slots.count());
 
     DPRINTFS(TcuBuf, (&tcu),
         "EP%u: put message at index %u\n",
@@ -679,15 +1115,16 @@ MessageUnit::finishMsgReceive(EpFile::EpCache &eps,
                               uint xferFlags,
                               bool addMsg)
 {
+    RecvSlots slots(tcu.regs(), ep);
     int idx = (msgAddr - ep.r1.buffer) >> ep.r0.slotSize;
 
     if (error == TcuError::NONE)
     {
         DPRINTFS(TcuBuf, (&tcu),
             "EP%u: increment message count to %u\n",
-            ep.id, ep.unreadMsgs() + 1);
+            ep.id, slots.unreadMsgs() + 1);
 
-        ep.setUnread(idx, true);
+        slots.setUnread(idx, true);
 
         if (!(header->flags & Tcu::REPLY_FLAG) &&
             ep.r0.rplEps != Tcu::INVALID_EP_ID &&
@@ -717,7 +1154,7 @@ MessageUnit::finishMsgReceive(EpFile::EpCache &eps,
         }
     }
     else
-        ep.setOccupied(idx, false);
+        slots.setOccupied(idx, false);
 
     eps.updateEp(ep);
 
@@ -802,8 +1239,17 @@ MessageUnit::recvFromNocWithEP(EpFile::EpCache &eps, PacketPtr pkt)
         return;
     }
 
+    if (!tcu.regs().validSlots(rep))
+    {
+        DPRINTFS(Tcu, (&tcu),
+            "EP%u: ignoring message: invalid slot count\n",
+            epid);
+        tcu.sendNocResponse(pkt, TcuError::RECV_OUT_OF_BOUNDS);
+        return;
+    }
+
     if (rep.r0.rplEps != Tcu::INVALID_EP_ID &&
-        (rep.r0.rplEps + (1 << rep.r0.slots)) > tcu.numEndpoints)
+        rep.r0.rplEps + rep.slotCount() > tcu.numEndpoints)
     {
         DPRINTFS(Tcu, (&tcu),
             "EP%u: ignoring message: reply EPs out of bounds\n",
@@ -812,6 +1258,21 @@ MessageUnit::recvFromNocWithEP(EpFile::EpCache &eps, PacketPtr pkt)
         return;
     }
 
+    // a use-once reply EP will be installed in the slot's reply EP
+    const MessageHeader *header = pkt->getPtr<MessageHeader>();
+    if (!(header->flags & Tcu::REPLY_FLAG) &&
+        header->replyEpId != Tcu::INVALID_EP_ID)
+    {
+        RecvSlots slots(tcu.regs(), rep);
+        int freeidx = slots.findFree(slots.wpos());
+        if (freeidx != -1 && addReplyEp(eps, rep, freeidx))
+        {
+            eps.onFetched(std::bind(&MessageUnit::recvFromNocWithEP,
+                                    this, std::placeholders::_1, pkt));
+            return;
+        }
+    }
+
     int msgidx = allocSlot(eps, rep);
     if (msgidx == -1)
     {
@@ -836,6 +1297,7 @@ MessageUnit::recvFromNocWithEP(EpFile::EpCache &eps, PacketPtr pkt)
     auto *ev = new ReceiveTransferEvent(
         this, &eps, epid, NocAddr(physAddr), rflags, pkt);
     tcu.startTransfer(ev, delay);
+    tcu.finishNocRequest(pkt);
 
     eps.setAutoFinish(false);
 }
@@ -64,6 +64,34 @@ class MessageUnit
         void transferDone(TcuError result) override;
     };
 
+    class McastTransferEvent : public MemoryUnit::WriteTransferEvent
+    {
+        MessageUnit *msgUnit;
+        MessageHeader header;
+        epid_t firstEp;
+        unsigned count;
+
+      public:
+
+        McastTransferEvent(MessageUnit *_msgUnit,
+                           epid_t _firstEp,
+                           unsigned _count,
+                           NocAddr phys,
+                           size_t size,
+                           uint flags,
+                           NocAddr dest,
+                           const MessageHeader &_header)
+            : WriteTransferEvent(phys, size, flags, dest),
+              msgUnit(_msgUnit),
+              header(_header),
+              firstEp(_firstEp),
+              count(_count)
+        {}
+
+        void transferStart() override;
+        void transferDone(TcuError result) override;
+    };
+
     class ReceiveTransferEvent : public MemoryUnit::ReceiveTransferEvent
     {
         MessageUnit *msgUnit;
@@ -87,9 +115,26 @@ class MessageUnit
         void transferDone(TcuError result) override;
     };
 
+    class SendMissHandler : public TcuTlb::MissHandler
+    {
+        MessageUnit &msgUnit;
+
+      public:
+
+        SendMissHandler(MessageUnit &_msgUnit, Addr virt)
+            : MissHandler(virt, TcuTlb::READ),
+              msgUnit(_msgUnit)
+        {}
+
+        void finish(TcuTlb::Result res, NocAddr phys) override;
+    };
+
     MessageUnit(Tcu &_tcu)
       : tcu(_tcu),
         sendReplyFinished(true),
+        mcastPending(),
+        mcastResult(TcuError::NONE),
+        mcastFailed(),
         cmdEps(_tcu.eps().newCache()),
         extCmdEps(_tcu.eps().newCache())
     {}
@@ -107,7 +152,12 @@ class MessageUnit
     void startReply(const CmdCommand::Bits &cmd);
 
     /**
-     * Starts the FETCH command
+     * Starts the SEND_MC command
+     */
+    void startSendMcast(const CmdCommand::Bits &cmd);
+
+    /**
+     * Starts the FETCH_MSG or FETCH_MSGS command
      */
     void startFetch(const CmdCommand::Bits &cmd);
 
@@ -117,7 +167,7 @@ class MessageUnit
     void startInvalidate(const ExtCommand::Bits &cmd);
 
     /**
-     * Starts the ACK_MSG command
+     * Starts the ACK_MSG or ACK_MSGS command
      */
     void startAck(const CmdCommand::Bits &cmd);
 
@@ -128,6 +178,11 @@ class MessageUnit
      */
     bool finishMsgSend(TcuError result);
 
+    /**
+     * Received the response for one packet of a SEND_MC command
+     */
+    void finishMcastPacket(PacketPtr pkt, Cycles delay, TcuError result);
+
     /**
      * Received a message from NoC -> Mem request
      */
@@ -139,8 +194,15 @@ class MessageUnit
 
     void invalidateWithEP(EpFile::EpCache &eps);
 
+    void fetchAllWithEP(EpFile::EpCache &eps, RecvEp &rep,
+                        RecvSlots &slots, Cycles delay);
+
     void startAckWithEP(EpFile::EpCache &eps);
 
+    void ackAllWithEP(EpFile::EpCache &eps, RecvEp &rep, Cycles delay);
+
+    bool addReplyEp(EpFile::EpCache &eps, const RecvEp &rep, int msgidx);
+
     void ackMessage(RecvEp &rep, int msgidx);
 
     void recvCredits(EpFile::EpCache &eps, SendEp &sep);
@@ -151,6 +213,15 @@ class MessageUnit
 
     void startSendReplyWithEP(EpFile::EpCache &eps, epid_t epid);
 
+    void startSendMcastWithEP(EpFile::EpCache &eps);
+
+    bool checkSendEp(const Ep &ep, epid_t epid, Cycles delay);
+
+    bool getReplyInfo(EpFile::EpCache &eps, epid_t rpepid, Cycles delay,
+                      epid_t *replyEpId, size_t *replySize);
+
+    bool translateMsgData(epid_t epid, Cycles &delay, NocAddr *phys);
+
     void recvFromNocWithEP(EpFile::EpCache &eps, PacketPtr pkt);
 
     void finishMsgSendWithEp(EpFile::EpCache &eps, TcuError result);
@@ -168,14 +239,22 @@ class MessageUnit
     Tcu &tcu;
 
     bool sendReplyFinished;
+
+    // state of the current SEND_MC command
+    size_t mcastPending;
+    TcuError mcastResult;
+    std::vector<epid_t> mcastFailed;
     EpFile::EpCache cmdEps;
     EpFile::EpCache extCmdEps;
 
     Stats::Histogram sentBytes;
     Stats::Histogram repliedBytes;
+    Stats::Histogram mcastDests;
     Stats::Histogram receivedBytes;
     Stats::Scalar wrongAct;
     Stats::Scalar noSpace;
+    Stats::Histogram fetchedMsgs;
+    Stats::Histogram ackedMsgs;
 
 };
 
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#include "mem/tcu/pool.hh"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "base/logging.hh"
+
+static_assert(sizeof(TcuPool::Chunk) <= TcuPool::HEADER_SIZE,
+              "Chunk header too large");
+
+TcuPool::TcuPool(const std::string &name)
+    : _name(name),
+      freeLists(MAX_CLASS + 1),
+      slabs()
+{
+}
+
+TcuPool::~TcuPool()
+{
+    for (void *slab : slabs)
+        std::free(slab);
+}
+
+void
+TcuPool::regStats()
+{
+    allocs
+        .name(name() + ".allocs")
+        .desc("Number of objects allocated from the pool");
+    reuses
+        .name(name() + ".reuses")
+        .desc("Number of allocations served from a free list");
+    frees
+        .name(name() + ".frees")
+        .desc("Number of objects returned to the pool");
+    slabAllocs
+        .name(name() + ".slabAllocs")
+        .desc("Number of slabs allocated from the host");
+    largeAllocs
+        .name(name() + ".largeAllocs")
+        .desc("Number of allocations too large for the pool");
+    bytesReserved
+        .name(name() + ".bytesReserved")
+        .desc("Number of bytes allocated from the host for slabs");
+}
+
+size_t
+TcuPool::sizeClass(size_t size)
+{
+    size_t cls = MIN_CLASS;
+    while (cls <= MAX_CLASS && (static_cast<size_t>(1) << cls) < size)
+        cls++;
+    return cls;
+}
+
+TcuPool::Chunk *
+TcuPool::refill(size_t cls)
+{
+    size_t chunkSize = HEADER_SIZE + (static_cast<size_t>(1) << cls);
+    size_t count = std::max(SLAB_SIZE / chunkSize, static_cast<size_t>(1));
+
+    uint8_t *slab = static_cast<uint8_t*>(std::malloc(chunkSize * count));
+    if (!slab)
+        panic("Unable to allocate slab of %lu bytes\n", chunkSize * count);
+    slabs.push_back(slab);
+    slabAllocs++;
+    bytesReserved += chunkSize * count;
+
+    // put all but the first chunk on the free list
+    for (size_t i = count - 1; i > 0; --i)
+    {
+        Chunk *c = reinterpret_cast<Chunk*>(slab + i * chunkSize);
+        c->cls = cls;
+        c->next = freeLists[cls];
+        freeLists[cls] = c;
+    }
+
+    Chunk *first = reinterpret_cast<Chunk*>(slab);
+    first->cls = cls;
+    return first;
+}
+
+void *
+TcuPool::alloc(size_t size)
+{
+    allocs++;
+
+    size_t cls = sizeClass(size);
+    Chunk *c;
+    if (cls > MAX_CLASS)
+    {
+        // too large to be worth pooling
+        largeAllocs++;
+        c = static_cast<Chunk*>(std::malloc(HEADER_SIZE + size));
+        if (!c)
+            panic("Unable to allocate %lu bytes\n", size);
+        c->cls = cls;
+    }
+    else if (freeLists[cls])
+    {
+        reuses++;
+        c = freeLists[cls];
+        freeLists[cls] = c->next;
+    }
+    else
+        c = refill(cls);
+
+    return reinterpret_cast<uint8_t*>(c) + HEADER_SIZE;
+}
+
+void
+TcuPool::free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    frees++;
+
+    Chunk *c = reinterpret_cast<Chunk*>(static_cast<uint8_t*>(ptr) -
+                                        HEADER_SIZE);
+    if (c->cls > MAX_CLASS)
+        std::free(c);
+    else
+    {
+        c->next = freeLists[c->cls];
+        freeLists[c->cls] = c;
+    }
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#ifndef __MEM_TCU_POOL_HH__
+#define __MEM_TCU_POOL_HH__
+
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/statistics.hh"
+
+/**
+ * A simple slab allocator for the objects the TCU creates for every memory
+ * or NoC access (packets, requests, sender states and payloads).
+ *
+ * Objects are grouped into power-of-two size classes. Each class has its own
+ * free list that is refilled by carving chunks out of larger slabs. Freed
+ * objects go back to the free list of their class and are never returned to
+ * the host allocator until the pool is destroyed. Each chunk is preceded by a
+ * small header that stores its size class, so that free() does not need to
+ * know the size of the object.
+ */
+class TcuPool
+{
+  public:
+
+    struct Chunk
+    {
+        // the size class this chunk belongs to
+        size_t cls;
+        // the next free chunk; only valid while the chunk is free
+        Chunk *next;
+    };
+
+    // the chunk header is padded to keep the payload 16-byte aligned
+    static const size_t HEADER_SIZE = 16;
+    static const size_t MIN_CLASS = 4;          // 16 bytes
+    static const size_t MAX_CLASS = 16;         // 64 KiB
+    static const size_t SLAB_SIZE = 64 * 1024;
+
+    /**
+     * An allocator for STL containers and std::allocate_shared that takes
+     * its memory from a TcuPool.
+     */
+    template<typename T>
+    struct Allocator
+    {
+        typedef T value_type;
+
+        explicit Allocator(TcuPool &_pool) : pool(&_pool) {}
+
+        template<typename U>
+        Allocator(const Allocator<U> &o) : pool(o.pool) {}
+
+        T *allocate(size_t n)
+        {
+            return static_cast<T*>(pool->alloc(n * sizeof(T)));
+        }
+
+        void deallocate(T *p, size_t)
+        {
+            pool->free(p);
+        }
+
+        template<typename U>
+        bool operator==(const Allocator<U> &o) const { return pool == o.pool; }
+        template<typename U>
+        bool operator!=(const Allocator<U> &o) const { return pool != o.pool; }
+
+        TcuPool *pool;
+    };
+
+    explicit TcuPool(const std::string &name);
+    ~TcuPool();
+
+    TcuPool(const TcuPool &) = delete;
+    TcuPool &operator=(const TcuPool &) = delete;
+
+    const std::string &name() const { return _name; }
+
+    void regStats();
+
+    void *alloc(size_t size);
+
+    void free(void *ptr);
+
+    template<class T, typename... Args>
+    T *create(Args&&... args)
+    {
+        return new (alloc(sizeof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template<class T>
+    void destroy(T *obj)
+    {
+        if (obj)
+        {
+            obj->~T();
+            free(obj);
+        }
+    }
+
+  private:
+
+    static size_t sizeClass(size_t size);
+
+    Chunk *refill(size_t cls);
+
+    std::string _name;
+
+    std::vector<Chunk*> freeLists;
+
+    std::vector<void*> slabs;
+
+  public:
+
+    Stats::Scalar allocs;
+    Stats::Scalar reuses;
+    Stats::Scalar frees;
+    Stats::Scalar slabAllocs;
+    Stats::Scalar largeAllocs;
+    Stats::Scalar bytesReserved;
+};
+
+#endif // __MEM_TCU_POOL_HH__
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#include "debug/TcuPtWalk.hh"
+#include "mem/tcu/pt_unit.hh"
+#include "mem/tcu/tcu.hh"
+
+PtUnit::PtUnit(Tcu &_tcu, size_t _cacheSize)
+    : tcu(_tcu),
+      walks(),
+      walking(),
+      asid(),
+      table(),
+      level(),
+      startCycle(),
+      fetchEvent(*this),
+      cache(),
+      cacheSize(_cacheSize)
+{
+}
+
+PtUnit::~PtUnit()
+{
+    for (auto handler : walks)
+        delete handler;
+}
+
+const std::string
+PtUnit::name() const
+{
+    return tcu.name() + ".pt";
+}
+
+void
+PtUnit::regStats()
+{
+    walkCount
+        .name(tcu.name() + ".pt.walks")
+        .desc("Number of page-table walks");
+    faults
+        .name(tcu.name() + ".pt.faults")
+        .desc("Number of page-table walks that failed");
+    pteReads
+        .name(tcu.name() + ".pt.pteReads")
+        .desc("Number of PTEs read from memory");
+    cacheHits
+        .name(tcu.name() + ".pt.cacheHits")
+        .desc("Number of PTEs found in the PTE cache");
+    walkTimes
+        .init(8)
+        .name(tcu.name() + ".pt.walkTimes")
+        .desc("Page-table walk times (in Cycles)")
+        .flags(Stats::nozero);
+}
+
+void
+PtUnit::startWalk(TcuTlb::MissHandler *handler)
+{
+    walks.push_back(handler);
+    walkCount++;
+
+    // walks are done one after another
+    if (!walking)
+        startNextWalk();
+}
+
+void
+PtUnit::startNextWalk()
+{
+    TcuTlb::MissHandler *handler = walks.front();
+
+    walking = true;
+    asid = tcu.regs().getCurAct().id;
+    table = tcu.regs().get(PrivReg::PT_ROOT) & ~static_cast<Addr>(
+        TcuTlb::PAGE_MASK);
+    level = TcuTlb::LEVEL_CNT - 1;
+    startCycle = tcu.curCycle();
+
+    DPRINTFS(TcuPtWalk, (&tcu),
+             "Starting walk for virt=%p asid=%#x access=%#x root=%p\n",
+             handler->virt, asid, handler->access, table);
+
+    // no page table for this activity
+    if (table == 0)
+    {
+        finishWalk(TcuTlb::MISS, NocAddr());
+        return;
+    }
+
+    // a previous walk might have inserted the translation already
+    NocAddr phys;
+    Cycles tlbLatency;
+    if (tcu.tlb()->lookup(handler->virt, asid, handler->access,
+                          &phys, &tlbLatency) == TcuTlb::HIT)
+    {
+        finishWalk(TcuTlb::HIT, phys);
+        return;
+    }
+
+    tcu.schedule(fetchEvent, tcu.clockEdge(Cycles(1)));
+}
+
+void
+PtUnit::fetchPte()
+{
+    Addr virt = walks.front()->virt;
+    Addr idx = (virt >> (TcuTlb::PAGE_BITS + level * TcuTlb::LEVEL_BITS)) &
+               TcuTlb::LEVEL_MASK;
+    Addr addr = table + idx * TcuTlb::PTE_SIZE;
+
+    uint64_t pte;
+    if (cacheLookup(addr, &pte))
+    {
+        DPRINTFS(TcuPtWalk, (&tcu),
+                 "  level %d: PTE @ %p = %#018lx (cached)\n",
+                 level, addr, pte);
+        cacheHits++;
+        handlePte(pte);
+        return;
+    }
+
+    pteReads++;
+    auto pkt = tcu.generateRequest(addr, TcuTlb::PTE_SIZE, MemCmd::ReadReq);
+    tcu.sendMemRequest(pkt, addr, Cycles(0), Tcu::MemReqType::PT_WALK);
+}
+
+void
+PtUnit::recvMemResponse(PacketPtr pkt)
+{
+    assert(!walks.empty());
+
+    uint64_t pte = pkt->getLE<uint64_t>();
+
+    DPRINTFS(TcuPtWalk, (&tcu), "  level %d: PTE @ %p = %#018lx\n",
+             level, pkt->getAddr(), pte);
+
+    // the upper levels are cached; the last one ends up in the TLB anyway
+    bool leaf = level == 0 || (pte & TcuTlb::LARGE);
+    if (!leaf && (pte & TcuTlb::RWX))
+        cacheInsert(pkt->getAddr(), pte);
+
+    handlePte(pte);
+}
+
+void
+PtUnit::handlePte(uint64_t pte)
+{
+    TcuTlb::MissHandler *handler = walks.front();
+    uint flags = pte & (TcuTlb::RWX | TcuTlb::LARGE);
+
+    if (!(flags & TcuTlb::RWX))
+    {
+        finishWalk(TcuTlb::MISS, NocAddr());
+        return;
+    }
+
+    // pointer to the next level?
+    if (level > 0 && !(flags & TcuTlb::LARGE))
+    {
+        table = pte & ~static_cast<Addr>(TcuTlb::PAGE_MASK);
+        level--;
+        tcu.schedule(fetchEvent, tcu.clockEdge(Cycles(1)));
+        return;
+    }
+
+    // large pages only exist in the second-last level
+    if ((flags & TcuTlb::LARGE) && level != 1)
+    {
+        finishWalk(TcuTlb::MISS, NocAddr());
+        return;
+    }
+
+    if ((flags & handler->access) != handler->access)
+    {
+        finishWalk(TcuTlb::PAGEFAULT, NocAddr());
+        return;
+    }
+
+    Addr mask = (flags & TcuTlb::LARGE) ? TcuTlb::LPAGE_MASK
+                                        : TcuTlb::PAGE_MASK;
+    NocAddr phys(pte & ~mask);
+
+    // if we cannot insert the entry, let the software handle the miss
+    if (!tcu.tlb()->insert(handler->virt, asid, phys, flags))
+    {
+        finishWalk(TcuTlb::MISS, NocAddr());
+        return;
+    }
+
+    phys.offset += handler->virt & mask;
+    finishWalk(TcuTlb::HIT, phys);
+}
+
+void
+PtUnit::finishWalk(TcuTlb::Result res, NocAddr phys)
+{
+    TcuTlb::MissHandler *handler = walks.front();
+    walks.pop_front();
+    walking = false;
+
+    DPRINTFS(TcuPtWalk, (&tcu), "Finished walk for virt=%p -> %s (%p)\n",
+             handler->virt, res == TcuTlb::HIT ? "HIT" : "FAULT",
+             phys.getAddr());
+
+    if (res != TcuTlb::HIT)
+        faults++;
+    walkTimes.sample(tcu.curCycle() - startCycle);
+
+    // note that the handler might start a new walk
+    handler->finish(res, phys);
+    delete handler;
+
+    if (!walking && !walks.empty())
+        startNextWalk();
+}
+
+bool
+PtUnit::cacheLookup(Addr addr, uint64_t *pte)
+{
+    for (auto it = cache.begin(); it != cache.end(); ++it)
+    {
+        if (it->first == addr)
+        {
+            *pte = it->second;
+            // move it to the front
+            cache.splice(cache.begin(), cache, it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+PtUnit::cacheInsert(Addr addr, uint64_t pte)
+{
+    if (cacheSize == 0)
+        return;
+
+    if (cache.size() == cacheSize)
+        cache.pop_back();
+    cache.emplace_front(addr, pte);
+}
+
+void
+PtUnit::flush()
+{
+    DPRINTFS(TcuPtWalk, (&tcu), "Flushing PTE cache\n");
+    cache.clear();
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2022 Nils Asmussen, Barkhausen Institut
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ */
+
+#ifndef __MEM_TCU_PT_UNIT_HH__
+#define __MEM_TCU_PT_UNIT_HH__
+
+#include "mem/tcu/tlb.hh"
+#include "mem/packet.hh"
+#include "sim/eventq.hh"
+#include "sim/stats.hh"
+
+#include <list>
+
+class Tcu;
+
+/**
+ * The page-table walker, which resolves TLB misses in hardware. It walks the
+ * page table of the current activity, starting at the PT_ROOT register. The
+ * page table is a tree of TcuTlb::LEVEL_CNT levels, each consisting of one
+ * page with 64-bit PTEs. Each PTE contains the physical address in the upper
+ * bits and the TcuTlb flags (READ, WRITE, EXEC, LARGE) in the lower bits. A
+ * PTE without READ, WRITE and EXEC is invalid. A PTE in the last level or
+ * with the LARGE flag in the second-last level maps a page; all other PTEs
+ * point to the next level.
+ *
+ * The PTEs are read from the physical memory of the tile. The PTEs of the
+ * upper levels are kept in a small cache.
+ */
+class PtUnit
+{
+  public:
+
+    PtUnit(Tcu &_tcu, size_t _cacheSize);
+
+    ~PtUnit();
+
+    const std::string name() const;
+
+    void regStats();
+
+    /**
+     * Starts a walk for the given TLB miss. The handler is notified and
+     * deleted afterwards.
+     */
+    void startWalk(TcuTlb::MissHandler *handler);
+
+    void recvMemResponse(PacketPtr pkt);
+
+    /**
+     * Invalidates the PTE cache
+     */
+    void flush();
+
+    bool isIdle() const { return walks.empty(); }
+
+  private:
+
+    void startNextWalk();
+
+    void fetchPte();
+
+    void handlePte(uint64_t pte);
+
+    void finishWalk(TcuTlb::Result res, NocAddr phys);
+
+    bool cacheLookup(Addr addr, uint64_t *pte);
+
+    void cacheInsert(Addr addr, uint64_t pte);
+
+    Tcu &tcu;
+
+    // the pending walks; the first one is the current walk
+    std::list<TcuTlb::MissHandler*> walks;
+
+    // state of the current walk
+    bool walking;
+    uint16_t asid;
+    Addr table;
+    int level;
+    Cycles startCycle;
+
+    EventWrapper<PtUnit, &PtUnit::fetchPte> fetchEvent;
+
+    // the PTE cache (address, PTE) with the most recently used one in front
+    std::list<std::pair<Addr, uint64_t>> cache;
+    size_t cacheSize;
+
+    Stats::Scalar walkCount;
+    Stats::Scalar faults;
+    Stats::Scalar pteReads;
+    Stats::Scalar cacheHits;
+    Stats::Histogram walkTimes;
+};
+
+#endif
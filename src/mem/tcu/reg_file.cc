@@ -29,6 +29,8 @@
  * policies, either expressed or implied, of the FreeBSD Project.
  */
 
+#include "base/bitfield.hh"
+#include "base/intmath.hh"
 #include "base/trace.hh"
 #include "debug/Tcu.hh"
 #include "debug/TcuReg.hh"
@@ -52,6 +54,7 @@ const char *RegFile::privRegNames[] = {
     "PRIV_CMD_ARG",
     "CUR_ACT",
     "CLEAR_IRQ",
+    "PT_ROOT",
 };
 
 const char *RegFile::unprivRegNames[] = {
@@ -62,6 +65,11 @@ const char *RegFile::unprivRegNames[] = {
     "PRINT",
 };
 
+const char *RegFile::queueRegNames[] = {
+    "COMPLETED",
+    "PENDING",
+};
+
 const char *RegFile::epTypeNames[] = {
     "INVALID",
     "SEND",
@@ -88,13 +96,19 @@ static const char *regAccessName(RegAccess access)
     return "TCU";
 }
 
-RegFile::RegFile(Tcu &_tcu, const std::string& name, unsigned numEndpoints)
+RegFile::RegFile(Tcu &_tcu, const std::string& name, unsigned numEndpoints,
+                 unsigned numQueueSlots, unsigned maxExtSlots)
     : tcu(_tcu),
       extRegs(numExtRegs, 0),
       privRegs(numPrivRegs, 0),
       unprivRegs(numUnprivRegs, 0),
       eps(),
+      extSlotTable(numEndpoints),
+      _maxExtSlots(maxExtSlots),
       bufRegs(numBufRegs * sizeof(reg_t), 0),
+      queueRegs(numQueueRegs, 0),
+      slotRegs(numQueueSlots * numSlotRegs, 0),
+      activeSlot(-1),
       _name(name)
 {
     static_assert(sizeof(extRegNames) / sizeof(extRegNames[0]) ==
@@ -103,6 +117,10 @@ RegFile::RegFile(Tcu &_tcu, const std::string& name, unsigned numEndpoints)
         numPrivRegs, "privRegNames out of sync");
     static_assert(sizeof(unprivRegNames) / sizeof(unprivRegNames[0]) ==
         numUnprivRegs, "unprivRegNames out of sync");
+    static_assert(sizeof(queueRegNames) / sizeof(queueRegNames[0]) ==
+        numQueueRegs, "queueRegNames out of sync");
+    assert(numQueueSlots <= maxQueueSlots);
+    assert(isPowerOf2(maxExtSlots) && maxExtSlots >= RecvEp::MAX_MSGS);
 
     for(unsigned i = 0; i < numEndpoints; ++i)
         eps.push_back(Ep(i));
@@ -151,10 +169,10 @@ RegFile::add_msg()
 }
 
 void
-RegFile::rem_msg()
+RegFile::rem_msg(unsigned count)
 {
     ActState cur = getAct(PrivReg::CUR_ACT);
-    cur.msgs = cur.msgs - 1;
+    cur.msgs = cur.msgs - count;
     set(PrivReg::CUR_ACT, cur);
 }
 
@@ -211,6 +229,10 @@ RegFile::get(UnprivReg reg, RegAccess access) const
 {
     reg_t value;
 
+    // the TCU itself works on the queue slot of the running command, if any
+    if (access == RegAccess::TCU && activeSlot != -1 && isSlotReg(reg))
+        return getSlot(activeSlot, reg);
+
     if (reg == UnprivReg::CUR_TIME)
         value = curTick() / 1000;
     else
@@ -227,6 +249,12 @@ RegFile::get(UnprivReg reg, RegAccess access) const
 void
 RegFile::set(UnprivReg reg, reg_t value, RegAccess access)
 {
+    if (access == RegAccess::TCU && activeSlot != -1 && isSlotReg(reg))
+    {
+        setSlot(activeSlot, reg, value);
+        return;
+    }
+
     DPRINTF(TcuRegWrite, "%s-> CMD[%-12s]: %#018x\n",
                          regAccessName(access),
                          unprivRegNames[static_cast<Addr>(reg)],
@@ -235,6 +263,54 @@ RegFile::set(UnprivReg reg, reg_t value, RegAccess access)
     unprivRegs[static_cast<Addr>(reg)] = value;
 }
 
+RegFile::reg_t
+RegFile::get(QueueReg reg, RegAccess access) const
+{
+    reg_t value = queueRegs[static_cast<Addr>(reg)];
+
+    DPRINTF(TcuRegRead, "%s<- QUE[%-12s]: %#018x\n",
+                        regAccessName(access),
+                        queueRegNames[static_cast<Addr>(reg)],
+                        value);
+
+    return value;
+}
+
+void
+RegFile::set(QueueReg reg, reg_t value, RegAccess access)
+{
+    DPRINTF(TcuRegWrite, "%s-> QUE[%-12s]: %#018x\n",
+                         regAccessName(access),
+                         queueRegNames[static_cast<Addr>(reg)],
+                         value);
+
+    queueRegs[static_cast<Addr>(reg)] = value;
+}
+
+RegFile::reg_t
+RegFile::getSlot(unsigned slot, UnprivReg reg) const
+{
+    reg_t value = *slotReg(slot, reg);
+
+    DPRINTF(TcuRegRead, "   <- Q%02u[%-12s]: %#018x\n",
+                        slot,
+                        unprivRegNames[static_cast<Addr>(reg)],
+                        value);
+
+    return value;
+}
+
+void
+RegFile::setSlot(unsigned slot, UnprivReg reg, reg_t value)
+{
+    DPRINTF(TcuRegWrite, "   -> Q%02u[%-12s]: %#018x\n",
+                         slot,
+                         unprivRegNames[static_cast<Addr>(reg)],
+                         value);
+
+    *slotReg(slot, reg) = value;
+}
+
 void
 RegFile::printEpAccess(epid_t epId, bool read, RegAccess access) const
 {
@@ -279,6 +355,18 @@ RecvEp::print(const RegFile &rf,
               bool read,
               RegAccess access) const
 {
+    if (r0.ext)
+    {
+        DPRINTFNS(rf.name(),
+            "%s%s EP%-3u%12s: Recv[act=%u, buf=%p msz=%#x bsz=%#lx rpl=%u "
+                                  "msgs=%u occ=%u ext]\n",
+            regAccessName(access), read ? "<-" : "->",
+            id, "", r0.act,
+            r1.buffer, 1 << r0.slotSize, slotCount(), r0.rplEps,
+            r2.unread, r2.occupied);
+        return;
+    }
+
     DPRINTFNS(rf.name(),
         "%s%s EP%-3u%12s: Recv[act=%u, buf=%p msz=%#x bsz=%#x rpl=%u msgs=%u "
                               "occ=%#010x unr=%#010x rd=%u wr=%u]\n",
@@ -324,6 +412,171 @@ void
 RegFile::set(epid_t epId, size_t idx, reg_t value)
 {
     eps[epId].inval.r[idx] = value;
+
+    // the EP is (re)configured, so that the slots of an extended receive EP
+    // start empty. all other EPs don't need an entry in the side table.
+    const Ep &ep = eps[epId];
+    if (ep.type() == EpType::RECEIVE && ep.recv.r0.ext)
+        resetExtSlots(epId);
+    else
+        clearExtSlots(epId);
+}
+
+RegFile::ExtSlots &
+RegFile::extSlots(epid_t epId)
+{
+    ExtSlots &slots = extSlotTable.at(epId);
+    // allocate the entry on first use
+    if (slots.unread.empty())
+        resetExtSlots(epId);
+    return slots;
+}
+
+void
+RegFile::resetExtSlots(epid_t epId)
+{
+    ExtSlots &slots = extSlotTable.at(epId);
+    size_t words = divCeil(_maxExtSlots, 64);
+    slots.unread.assign(words, 0);
+    slots.occupied.assign(words, 0);
+    slots.rpos = 0;
+    slots.wpos = 0;
+}
+
+void
+RegFile::clearExtSlots(epid_t epId)
+{
+    ExtSlots &slots = extSlotTable.at(epId);
+    if (!slots.unread.empty())
+        slots = ExtSlots();
+}
+
+RecvSlots::RecvSlots(RegFile &regs, RecvEp &_ep)
+    : ep(_ep),
+      ext(_ep.r0.ext ? &regs.extSlots(_ep.id) : nullptr)
+{
+}
+
+unsigned
+RecvSlots::unreadMsgs() const
+{
+    return ext ? static_cast<unsigned>(ep.r2.unread) : ep.unreadMsgs();
+}
+
+bool
+RecvSlots::isUnread(size_t idx) const
+{
+    assert(idx < count());
+    if (!ext)
+        return ep.isUnread(idx);
+    return bits(ext->unread[idx / 64], idx % 64);
+}
+
+void
+RecvSlots::setUnread(size_t idx, bool unr)
+{
+    assert(idx < count());
+    if (!ext)
+        ep.setUnread(idx, unr);
+    else if (isUnread(idx) != unr)
+    {
+        replaceBits(ext->unread[idx / 64], idx % 64, unr);
+        ep.r2.unread = ep.r2.unread + (unr ? 1 : -1);
+    }
+}
+
+bool
+RecvSlots::isOccupied(size_t idx) const
+{
+    assert(idx < count());
+    if (!ext)
+        return ep.isOccupied(idx);
+    return bits(ext->occupied[idx / 64], idx % 64);
+}
+
+void
+RecvSlots::setOccupied(size_t idx, bool occ)
+{
+    assert(idx < count());
+    if (!ext)
+        ep.setOccupied(idx, occ);
+    else if (isOccupied(idx) != occ)
+    {
+        replaceBits(ext->occupied[idx / 64], idx % 64, occ);
+        ep.r2.occupied = ep.r2.occupied + (occ ? 1 : -1);
+    }
+}
+
+size_t
+RecvSlots::rpos() const
+{
+    return ext ? ext->rpos : ep.r0.rpos;
+}
+
+void
+RecvSlots::rpos(size_t pos)
+{
+    if (ext)
+        ext->rpos = pos;
+    else
+        ep.r0.rpos = pos;
+}
+
+size_t
+RecvSlots::wpos() const
+{
+    return ext ? ext->wpos : ep.r0.wpos;
+}
+
+void
+RecvSlots::wpos(size_t pos)
+{
+    if (ext)
+        ext->wpos = pos;
+    else
+        ep.r0.wpos = pos;
+}
+
+int
+RecvSlots::findUnread(size_t start) const
+{
+    if (ext)
+        return scan(ext->unread.data(), count(), start, true);
+    uint64_t word = ep.r2.unread;
+    return scan(&word, count(), start, true);
+}
+
+int
+RecvSlots::findFree(size_t start) const
+{
+    if (ext)
+        return scan(ext->occupied.data(), count(), start, false);
+    uint64_t word = ep.r2.occupied;
+    return scan(&word, count(), start, false);
+}
+
+int
+RecvSlots::scan(const uint64_t *words, size_t bits, size_t start, bool value)
+{
+    // search in [start, bits) first and in [0, start) afterwards
+    size_t ranges[2][2] = { { start, bits }, { 0, start } };
+    for (auto &range : ranges)
+    {
+        size_t i = range[0];
+        while (i < range[1])
+        {
+            size_t w = i / 64;
+            uint64_t word = value ? words[w] : ~words[w];
+            // ignore the bits below i and at or above the end of the range
+            word &= ~static_cast<uint64_t>(0) << (i % 64);
+            if (range[1] < (w + 1) * 64)
+                word &= mask(range[1] % 64);
+            if (word)
+                return w * 64 + findLsbSet(word);
+            i = (w + 1) * 64;
+        }
+    }
+    return -1;
 }
 
 const char *
@@ -388,6 +641,43 @@ RegFile::handleRequest(PacketPtr pkt, bool isCpuRequest)
                 set(reg, data[offset / sizeof(reg_t)], access);
             }
         }
+        // command queue registers
+        else if (regAddr >= TcuTlb::PAGE_SIZE * 3)
+        {
+            size_t idx = (regAddr - TcuTlb::PAGE_SIZE * 3) / sizeof(reg_t);
+
+            if (idx < numQueueRegs)
+            {
+                auto reg = static_cast<QueueReg>(idx);
+
+                if (pkt->isRead())
+                    data[offset / sizeof(reg_t)] = get(reg, access);
+                // completions are acknowledged by writing a 1 to their bit
+                else if (pkt->isWrite() && isCpuRequest &&
+                         reg == QueueReg::COMPLETED)
+                {
+                    reg_t done = get(reg) & ~data[offset / sizeof(reg_t)];
+                    set(reg, done, access);
+                }
+            }
+            else if (idx - numQueueRegs < slotRegs.size())
+            {
+                unsigned slot = (idx - numQueueRegs) / numSlotRegs;
+                auto reg = static_cast<UnprivReg>(
+                    (idx - numQueueRegs) % numSlotRegs);
+
+                if (pkt->isRead())
+                    data[offset / sizeof(reg_t)] = getSlot(slot, reg);
+                // pending slots are owned by the TCU
+                else if (pkt->isWrite() && isCpuRequest &&
+                         !(get(QueueReg::PENDING) & (1ULL << slot)))
+                {
+                    if (reg == UnprivReg::COMMAND)
+                        res |= WROTE_QUEUE_CMD;
+                    setSlot(slot, reg, data[offset / sizeof(reg_t)]);
+                }
+            }
+        }
         else if (regAddr >= TcuTlb::PAGE_SIZE * 2)
         {
             Addr reqAddr = regAddr - TcuTlb::PAGE_SIZE * 2;
@@ -480,8 +770,87 @@ RegFile::handleRequest(PacketPtr pkt, bool isCpuRequest)
     return static_cast<Result>(res);
 }
 
+void
+RegFile::serialize(CheckpointOut &cp) const
+{
+    SERIALIZE_CONTAINER(extRegs);
+    SERIALIZE_CONTAINER(privRegs);
+    SERIALIZE_CONTAINER(unprivRegs);
+    SERIALIZE_CONTAINER(bufRegs);
+    SERIALIZE_CONTAINER(queueRegs);
+    SERIALIZE_CONTAINER(slotRegs);
+    SERIALIZE_SCALAR(activeSlot);
+
+    std::vector<reg_t> epRegs;
+    for (const Ep &ep : eps)
+    {
+        for (size_t i = 0; i < numEpRegs; ++i)
+            epRegs.push_back(ep.inval.r[i]);
+    }
+    SERIALIZE_CONTAINER(epRegs);
+
+    // the side table only holds entries for the extended receive EPs that
+    // have been used so far
+    for (size_t ep = 0; ep < extSlotTable.size(); ++ep)
+    {
+        const ExtSlots &slots = extSlotTable[ep];
+        if (slots.unread.empty())
+            continue;
+
+        ScopedCheckpointSection sec(cp, csprintf("ext%d", ep));
+        arrayParamOut(cp, "unread", slots.unread);
+        arrayParamOut(cp, "occupied", slots.occupied);
+        paramOut(cp, "rpos", slots.rpos);
+        paramOut(cp, "wpos", slots.wpos);
+    }
+}
+
+void
+RegFile::unserialize(CheckpointIn &cp)
+{
+    UNSERIALIZE_CONTAINER(extRegs);
+    UNSERIALIZE_CONTAINER(privRegs);
+    UNSERIALIZE_CONTAINER(unprivRegs);
+    UNSERIALIZE_CONTAINER(bufRegs);
+    UNSERIALIZE_CONTAINER(queueRegs);
+    UNSERIALIZE_CONTAINER(slotRegs);
+    UNSERIALIZE_SCALAR(activeSlot);
+
+    std::vector<reg_t> epRegs;
+    UNSERIALIZE_CONTAINER(epRegs);
+    fatal_if(epRegs.size() != eps.size() * numEpRegs,
+             "%s: checkpoint has %lu EPs, but we have %lu\n",
+             name(), epRegs.size() / numEpRegs, eps.size());
+    for (size_t ep = 0; ep < eps.size(); ++ep)
+    {
+        for (size_t i = 0; i < numEpRegs; ++i)
+            eps[ep].inval.r[i] = epRegs[ep * numEpRegs + i];
+    }
+
+    for (size_t ep = 0; ep < extSlotTable.size(); ++ep)
+    {
+        ExtSlots &slots = extSlotTable[ep];
+        slots = ExtSlots();
+
+        std::string section =
+            csprintf("%s.ext%d", Serializable::currentSection(), ep);
+        if (!cp.sectionExists(section))
+            continue;
+
+        ScopedCheckpointSection sec(cp, csprintf("ext%d", ep));
+        arrayParamIn(cp, "unread", slots.unread);
+        arrayParamIn(cp, "occupied", slots.occupied);
+        paramIn(cp, "rpos", slots.rpos);
+        paramIn(cp, "wpos", slots.wpos);
+        fatal_if(slots.unread.size() != divCeil(_maxExtSlots, 64),
+                 "%s: EP%lu has a different number of extended slots\n",
+                 name(), ep);
+    }
+}
+
 Addr
 RegFile::getSize() const
 {
-    return TcuTlb::PAGE_SIZE * 2 + sizeof(reg_t) * numPrivRegs;
+    return TcuTlb::PAGE_SIZE * 3 +
+           sizeof(reg_t) * (numQueueRegs + slotRegs.size());
 }
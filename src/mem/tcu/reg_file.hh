@@ -38,6 +38,7 @@
 #include "base/bitunion.hh"
 #include "mem/tcu/error.hh"
 #include "mem/packet.hh"
+#include "sim/serialize.hh"
 
 // external registers (only externally writable)
 enum class ExtReg : Addr
@@ -59,6 +60,7 @@ enum class PrivReg : Addr
     PRIV_CMD_ARG1,
     CUR_ACT,
     CLEAR_IRQ,
+    PT_ROOT,
 };
 
 // unprivileged registers (writable by the application)
@@ -71,12 +73,26 @@ enum class UnprivReg : Addr
     PRINT,
 };
 
+// command queue registers (unprivileged, located in the 4th MMIO page). the
+// queue lets software submit commands without waiting for each of them, but
+// the TCU still executes them one after another (see TcuCommands).
+enum class QueueReg : Addr
+{
+    COMPLETED,
+    PENDING,
+};
+
 constexpr unsigned numExtRegs = 2;
-constexpr unsigned numPrivRegs = 5;
+constexpr unsigned numPrivRegs = 6;
 constexpr unsigned numUnprivRegs = 5;
 constexpr unsigned numEpRegs = 3;
 // buffer for prints (32 * 8 bytes)
 constexpr unsigned numBufRegs = 32;
+constexpr unsigned numQueueRegs = 2;
+// each queue slot has a COMMAND, DATA, and ARG1 register
+constexpr unsigned numSlotRegs = 3;
+// the COMPLETED and PENDING registers are bitmaps
+constexpr unsigned maxQueueSlots = 64;
 
 typedef uint16_t actid_t;
 typedef uint16_t epid_t;
@@ -109,6 +125,18 @@ struct CmdCommand
         FETCH_MSG       = 5,
         ACK_MSG         = 6,
         SLEEP           = 7,
+        SEND_MC         = 8,
+        FETCH_MSGS      = 9,
+        ACK_MSGS        = 10,
+        ATOMIC          = 11,
+        COPY            = 12,
+    };
+
+    enum AtomicOp
+    {
+        FETCH_ADD       = 0,
+        COMPARE_SWAP    = 1,
+        SWAP            = 2,
     };
 
     BitUnion64(Bits)
@@ -126,6 +154,64 @@ struct CmdCommand
         cmd.arg0 = arg0;
         return cmd;
     }
+
+    // SEND_MC sends the message via the send EPs epid .. epid + count - 1.
+    // arg0 holds the reply EP in the lower and the count in the upper bits.
+    static uint64_t mcastArg(epid_t replyEp, unsigned count)
+    {
+        return static_cast<uint64_t>(replyEp) |
+               (static_cast<uint64_t>(count) << 16);
+    }
+    static epid_t mcastReplyEp(uint64_t arg0)
+    {
+        return arg0 & 0xFFFF;
+    }
+    static unsigned mcastCount(uint64_t arg0)
+    {
+        return (arg0 >> 16) & 0xFFFF;
+    }
+
+    // ATOMIC performs the operation on the 64-bit word at the given offset
+    // within the memory EP. arg0 holds the operation in the lower 2 bits and
+    // the index of the word (offset / 8) in the upper bits. DATA holds the
+    // operand (the addend or the new value) and ARG1 the expected value for
+    // COMPARE_SWAP. On completion, DATA holds the old value.
+    static uint64_t atomicArg(AtomicOp op, Addr offset)
+    {
+        return static_cast<uint64_t>(op) | ((offset / 8) << 2);
+    }
+    static AtomicOp atomicOp(uint64_t arg0)
+    {
+        return static_cast<AtomicOp>(arg0 & 0x3);
+    }
+    static Addr atomicOffset(uint64_t arg0)
+    {
+        return (arg0 >> 2) * 8;
+    }
+
+    // COPY copies DATA.size bytes from the source memory EP (epid) at offset
+    // ARG1 to the destination memory EP (arg0) at offset DATA.addr. The data
+    // is sent by the TCU of the source tile directly to the destination.
+
+    // if set in arg0, READ and WRITE perform a scatter-gather transfer:
+    // DATA.addr points to an array of DATA.size descriptors (see SgDesc) and
+    // ARG1 holds the number of bytes of the first descriptor that have
+    // already been transferred. DATA is advanced by one descriptor as soon as
+    // it is done, so that the command can be restarted after an abort or a
+    // translation fault.
+    static const uint64_t SCATTER_GATHER = 1;
+};
+
+// a scatter-gather descriptor, which is aligned to its size and thus never
+// crosses a page boundary
+struct M5_ATTR_PACKED SgDesc
+{
+    // local virtual address
+    uint64_t addr;
+    uint64_t size;
+    // offset within the memory EP
+    uint64_t offset;
+    uint64_t : 64;
 };
 
 struct CmdData
@@ -219,21 +305,49 @@ struct SendEp
 
 struct RecvEp
 {
+    // the maximum number of slots of ordinary receive EPs. extended receive
+    // EPs (r0.ext = 1) keep their bitmaps in the TCU's side table instead of
+    // R2 and can therefore have more slots (see RecvSlots).
     static const size_t MAX_MSGS    = 32;
 
     explicit RecvEp() : id(), r0(0), r1(0), r2(0) {}
 
+    // FETCH_MSGS and ACK_MSGS refer to messages by a mask of slots in ARG1.
+    // bit i in the lower half stands for slot base + i, the base is stored
+    // in the upper half.
+    static const size_t MASK_SLOTS  = 32;
+
+    static uint64_t slotMask(uint32_t mask, unsigned base)
+    {
+        return static_cast<uint64_t>(mask) |
+               (static_cast<uint64_t>(base) << 32);
+    }
+    static uint32_t slotMaskBits(uint64_t arg)
+    {
+        return arg & 0xFFFFFFFF;
+    }
+    static unsigned slotMaskBase(uint64_t arg)
+    {
+        return arg >> 32;
+    }
+
     int unreadMsgs() const
     {
         return popCount(r2.unread);
     }
 
+    size_t slotCount() const
+    {
+        return static_cast<size_t>(1) << r0.slots;
+    }
+
+    // returns the slot index for the given offset or -1 if it is invalid
     int offsetToIdx(Addr off) const
     {
         if (r0.slotSize == 0)
-            return MAX_MSGS;
-        int idx = off >> r0.slotSize;
-        return (idx >= 0 && idx < (1 << r0.slots)) ? idx : MAX_MSGS;
+            return -1;
+        Addr idx = off >> r0.slotSize;
+        return idx < slotCount() ? static_cast<int>(idx) : -1;
     }
 
     bool isUnread(int idx) const
@@ -265,6 +379,7 @@ struct RecvEp
                RegAccess access) const;
 
     BitUnion64(R0)
+        Bitfield<59> ext;
         Bitfield<58, 53> rpos;
         Bitfield<52, 47> wpos;
         Bitfield<46, 41> slotSize;
@@ -278,6 +393,8 @@ struct RecvEp
         Bitfield<63, 0> buffer;
     EndBitUnion(R1)
 
+    // for extended receive EPs, R2 holds the number of unread and occupied
+    // slots instead of the bitmaps
     BitUnion64(R2)
         Bitfield<63, 32> unread;
         Bitfield<31, 0> occupied;
@@ -412,7 +529,7 @@ struct M5_ATTR_PACKED MessageHeader
 class Tcu;
 class EpFile;
 
-class RegFile
+class RegFile : public Serializable
 {
     friend class Tcu;
     friend class EpFile;
@@ -432,9 +549,35 @@ class RegFile
         WROTE_CORE_REQ  = 8,
         WROTE_CLEAR_IRQ = 16,
         WROTE_PRINT     = 32,
+        WROTE_QUEUE_CMD = 64,
+    };
+
+    /**
+     * The side-table entry of an extended receive EP
+     */
+    struct ExtSlots
+    {
+        std::vector<uint64_t> unread;
+        std::vector<uint64_t> occupied;
+        size_t rpos;
+        size_t wpos;
     };
 
-    RegFile(Tcu &tcu, const std::string& name, unsigned numEndpoints);
+    RegFile(Tcu &tcu, const std::string& name, unsigned numEndpoints,
+            unsigned numQueueSlots, unsigned maxExtSlots);
+
+    /// whether the slot count is supported by the format of the given EP
+    bool validSlots(const RecvEp &ep) const
+    {
+        return ep.slotCount() <=
+               (ep.r0.ext ? _maxExtSlots : RecvEp::MAX_MSGS);
+    }
+
+    ExtSlots &extSlots(epid_t epId);
+
+    void resetExtSlots(epid_t epId);
+
+    void clearExtSlots(epid_t epId);
 
     bool hasFeature(Features feature) const
     {
@@ -443,7 +586,7 @@ class RegFile
 
     void add_msg();
 
-    void rem_msg();
+    void rem_msg(unsigned count = 1);
 
     ActState getAct(PrivReg reg) const
     {
@@ -467,6 +610,24 @@ class RegFile
 
     void set(UnprivReg reg, reg_t value, RegAccess access = RegAccess::TCU);
 
+    reg_t get(QueueReg reg, RegAccess access = RegAccess::TCU) const;
+
+    void set(QueueReg reg, reg_t value, RegAccess access = RegAccess::TCU);
+
+    reg_t getSlot(unsigned slot, UnprivReg reg) const;
+
+    void setSlot(unsigned slot, UnprivReg reg, reg_t value);
+
+    unsigned queueSlots() const { return slotRegs.size() / numSlotRegs; }
+
+    /**
+     * Redirects the TCU-internal accesses to COMMAND, DATA, and ARG1 to the
+     * given queue slot (-1 = the architectural command registers).
+     */
+    void setActiveSlot(int slot) { activeSlot = slot; }
+
+    int getActiveSlot() const { return activeSlot; }
+
     CmdCommand::Bits getCommand()
     {
         return get(UnprivReg::COMMAND);
@@ -487,6 +648,10 @@ class RegFile
     /// returns which command registers have been written
     Result handleRequest(PacketPtr pkt, bool isCpuRequest);
 
+    void serialize(CheckpointOut &cp) const override;
+
+    void unserialize(CheckpointIn &cp) override;
+
     const std::string name() const { return _name; }
 
   private:
@@ -511,6 +676,21 @@ class RegFile
 
     reg_t get(epid_t epId, size_t idx) const;
 
+    static bool isSlotReg(UnprivReg reg)
+    {
+        return reg == UnprivReg::COMMAND || reg == UnprivReg::DATA ||
+               reg == UnprivReg::ARG1;
+    }
+
+    reg_t *slotReg(unsigned slot, UnprivReg reg)
+    {
+        return &slotRegs.at(slot * numSlotRegs + static_cast<Addr>(reg));
+    }
+    const reg_t *slotReg(unsigned slot, UnprivReg reg) const
+    {
+        return &slotRegs.at(slot * numSlotRegs + static_cast<Addr>(reg));
+    }
+
     void set(epid_t epId, size_t idx, reg_t value);
 
     void printEpAccess(epid_t epId, bool read, RegAccess access) const;
@@ -529,8 +709,18 @@ class RegFile
 
     std::vector<Ep> eps;
 
+    std::vector<ExtSlots> extSlotTable;
+
+    const size_t _maxExtSlots;
+
     std::vector<reg_t> bufRegs;
 
+    std::vector<reg_t> queueRegs;
+
+    std::vector<reg_t> slotRegs;
+
+    int activeSlot;
+
     // used for debug messages (DPRINTF)
     const std::string _name;
 
@@ -539,7 +729,52 @@ class RegFile
     static const char *extRegNames[];
     static const char *privRegNames[];
     static const char *unprivRegNames[];
+    static const char *queueRegNames[];
     static const char *epTypeNames[];
 };
 
+/**
+ * Provides access to the slots of a receive EP, independent of whether the
+ * bitmaps are stored in R2 (ordinary receive EPs) or in the side table of the
+ * register file (extended receive EPs). Changes of ordinary EPs are made in
+ * the given RecvEp and need to be written back as usual, whereas the side
+ * table is updated immediately.
+ */
+class RecvSlots
+{
+  public:
+
+    RecvSlots(RegFile &regs, RecvEp &ep);
+
+    size_t count() const { return ep.slotCount(); }
+
+    unsigned unreadMsgs() const;
+
+    bool isUnread(size_t idx) const;
+    void setUnread(size_t idx, bool unr);
+
+    bool isOccupied(size_t idx) const;
+    void setOccupied(size_t idx, bool occ);
+
+    size_t rpos() const;
+    void rpos(size_t pos);
+
+    size_t wpos() const;
+    void wpos(size_t pos);
+
+    /// the first unread slot at or behind <start> (wrapping around) or -1
+    int findUnread(size_t start) const;
+
+    /// the first free slot at or behind <start> (wrapping around) or -1
+    int findFree(size_t start) const;
+
+  private:
+
+    static int scan(const uint64_t *words, size_t bits, size_t start,
+                    bool value);
+
+    RecvEp &ep;
+    RegFile::ExtSlots *ext;
+};
+
 #endif // __MEM_TCU_REG_FILE_HH__
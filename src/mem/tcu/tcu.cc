@@ -29,6 +29,7 @@
  * policies, either expressed or implied, of the FreeBSD Project.
  */
 
+#include <algorithm>
 #include <iomanip>
 #include <sstream>
 #include <ostream>
@@ -40,8 +41,10 @@
 #include "debug/TcuLLCMemAcc.hh"
 #include "debug/TcuCoreMemAcc.hh"
 #include "mem/tcu/tcu.hh"
+#include "mem/tcu/llc_unit.hh"
 #include "mem/tcu/msg_unit.hh"
 #include "mem/tcu/mem_unit.hh"
+#include "mem/tcu/pt_unit.hh"
 #include "mem/tcu/xfer_unit.hh"
 #include "mem/cache/cache.hh"
 #include "sim/tile_memory.hh"
@@ -49,16 +52,25 @@
 
 Tcu::Tcu(const TcuParams &p)
   : BaseTcu(p),
-    regFile(*this, name() + ".regFile", p.num_endpoints),
+    regFile(*this, name() + ".regFile", p.num_endpoints, p.cmd_queue_slots,
+            p.ext_recv_slots),
     connector(*this, p.connector),
-    tlBuf(p.tlb_entries > 0 ? new TcuTlb(*this, p.tlb_entries) : NULL),
+    tlBuf(p.tlb_entries > 0 ? new TcuTlb(*this, p) : NULL),
+    ptUnit(tlBuf && p.pt_walker ? new PtUnit(*this, p.pte_cache_entries)
+                                : NULL),
     msgUnit(new MessageUnit(*this)),
     memUnit(new MemoryUnit(*this)),
-    xferUnit(new XferUnit(*this, p.block_size, p.buf_count, p.buf_size)),
+    xferUnit(new XferUnit(*this, p.block_size, p.buf_count, p.buf_size,
+                          {p.buf_reserved_local, p.buf_reserved_llc,
+                           p.buf_reserved_msgrecv, p.buf_reserved_remote})),
+    llcUnit(new LLCUnit(*this, p.llc_mshrs, p.llc_wb_combine_latency)),
     coreReqs(*this, p.buf_count),
     epFile(*this),
     cmds(*this),
     completeCoreReqEvent(coreReqs),
+    nocRetryEvent(*this),
+    nocSlotsUsed(),
+    nocBuffersClaimed(),
     tileMemOffset(p.tile_mem_offset),
     numEndpoints(p.num_endpoints),
     maxNocPacketSize(p.max_noc_packet_size),
@@ -66,11 +78,18 @@ Tcu::Tcu(const TcuParams &p)
     bufCount(p.buf_count),
     bufSize(p.buf_size),
     reqCount(p.req_count),
+    nocReqCount(p.noc_req_count),
+    nocSlots{p.noc_msg_slots, p.noc_mem_slots, p.noc_llc_slots},
+    memBackdoor(p.mem_backdoor),
+    memBackdoorLatency(p.mem_backdoor_latency),
+    memBackdoorThroughput(p.mem_backdoor_throughput),
     mmioLatency(p.mmio_latency),
     cpuToCacheLatency(p.cpu_to_cache_latency),
     tlbLatency(p.tlb_latency),
     cmdReadLatency(p.cmd_read_latency),
     cmdWriteLatency(p.cmd_write_latency),
+    cmdAtomicLatency(p.cmd_atomic_latency),
+    cmdCopyLatency(p.cmd_copy_latency),
     cmdSendLatency(p.cmd_send_latency),
     cmdReplyLatency(p.cmd_reply_latency),
     cmdRecvLatency(p.cmd_recv_latency),
@@ -78,13 +97,18 @@ Tcu::Tcu(const TcuParams &p)
     cmdAckLatency(p.cmd_ack_latency)
 {
     assert(p.buf_size >= maxNocPacketSize);
+    assert(p.noc_req_count > 0);
+    assert(p.noc_msg_slots > 0 && p.noc_mem_slots > 0 && p.noc_llc_slots > 0);
+    assert(p.mem_backdoor_throughput > 0);
 }
 
 Tcu::~Tcu()
 {
+    delete llcUnit;
     delete xferUnit;
     delete memUnit;
     delete msgUnit;
+    delete ptUnit;
     delete tlBuf;
 }
 
@@ -102,6 +126,20 @@ Tcu::regStats()
     nocWriteRecvs
         .name(name() + ".nocWriteRecvs")
         .desc("Number of received write requests");
+    nocAtomicRecvs
+        .name(name() + ".nocAtomicRecvs")
+        .desc("Number of received atomic requests");
+    nocCopyRecvs
+        .name(name() + ".nocCopyRecvs")
+        .desc("Number of received copy requests");
+    nocSlotRejects
+        .init(NOC_SLOT_NONE)
+        .name(name() + ".nocSlotRejects")
+        .desc("Number of NoC requests rejected due to missing slots")
+        .flags(Stats::nozero);
+    nocSlotRejects.subname(NOC_SLOT_MSG, "msg");
+    nocSlotRejects.subname(NOC_SLOT_MEM, "mem");
+    nocSlotRejects.subname(NOC_SLOT_LLC, "llc");
 
     regFileReqs
         .name(name() + ".regFileReqs")
@@ -118,9 +156,12 @@ Tcu::regStats()
 
     if (tlb())
         tlb()->regStats();
+    if (walker())
+        walker()->regStats();
     cmds.regStats();
     coreReqs.regStats();
     xferUnit->regStats();
+    llcUnit->regStats();
     memUnit->regStats();
     msgUnit->regStats();
     connector.regStats();
@@ -133,11 +174,59 @@ Tcu::isMemTile(unsigned tile) const
     return !sys || sys->hasMem(tile);
 }
 
+void
+Tcu::serialize(CheckpointOut &cp) const
+{
+    // all units are idle at this point (see isDrained). the memory of the
+    // tile is checkpointed by the system.
+    regFile.serializeSection(cp, "regFile");
+    connector.serializeSection(cp, "connector");
+    coreReqs.serializeSection(cp, "coreReqs");
+    if (tlBuf)
+        tlBuf->serializeSection(cp, "tlb");
+}
+
+void
+Tcu::unserialize(CheckpointIn &cp)
+{
+    regFile.unserializeSection(cp, "regFile");
+    connector.unserializeSection(cp, "connector");
+    coreReqs.unserializeSection(cp, "coreReqs");
+    if (tlBuf)
+        tlBuf->unserializeSection(cp, "tlb");
+}
+
+bool
+Tcu::isDrained()
+{
+    // a sleeping core would never drain. since the software has to expect
+    // spurious wakeups anyway, we simply finish the SLEEP command.
+    if (connector.isSleeping() &&
+        regs().getCommand().opcode == CmdCommand::SLEEP)
+    {
+        DPRINTF(Tcu, "Waking up core to drain\n");
+        cmds.scheduleCmdFinish(Cycles(0));
+    }
+
+    return BaseTcu::isDrained() &&
+           cmds.isIdle() &&
+           xferUnit->isIdle() &&
+           (!ptUnit || ptUnit->isIdle()) &&
+           memUnit->isIdle() &&
+           llcUnit->isIdle() &&
+           !completeCoreReqEvent.scheduled() &&
+           !nocRetryEvent.scheduled() &&
+           std::all_of(std::begin(nocSlotsUsed), std::end(nocSlotsUsed),
+                       [](unsigned used) { return used == 0; });
+}
+
 void
 Tcu::reset()
 {
     if (tlb())
         tlb()->clear();
+    if (walker())
+        walker()->flush();
 
     connector.reset();
     resets++;
@@ -179,12 +268,11 @@ Tcu::WriteCoverageEvent::process()
     if (mmu->translateFunctional(tmpReq, tc, BaseTLB::Read) != NoFault)
         panic("Translation of address %u failed", _gen.addr());
 
-    auto req = std::make_shared<Request>(tmpReq->getPaddr(), _gen.size(),
-                                         flags, _tcu.requestorId);
-    auto pkt = new Packet(req, MemCmd::ReadReq);
-    pkt->dataStatic(_buffer);
+    auto pkt = _tcu.generateRequest(tmpReq->getPaddr(), _gen.size(),
+                                    MemCmd::ReadReq);
 
-    _tcu.sendMemRequest(pkt, reinterpret_cast<Addr>(this), Cycles(1), true);
+    _tcu.sendMemRequest(pkt, reinterpret_cast<Addr>(this), Cycles(1),
+                        MemReqType::COVERAGE);
 }
 
 void
@@ -227,6 +315,12 @@ Tcu::startTransfer(void *event, Cycles delay)
     xferUnit->startTransfer(ev, delay);
 }
 
+Tick
+Tcu::accessMemAtomic(NocAddr phys, uint8_t *data, size_t size, bool write)
+{
+    return xferUnit->accessAtomic(phys, data, size, write);
+}
+
 size_t
 Tcu::startForeignReceive(epid_t epId, actid_t actId)
 {
@@ -237,19 +331,142 @@ Tcu::startForeignReceive(epid_t epId, actid_t actId)
     return coreReqs.startForeignReceive(epId, actId);
 }
 
+Tcu::NocSlotType
+Tcu::nocSlotType(PacketPtr pkt) const
+{
+    auto senderState = dynamic_cast<NocSenderState*>(pkt->senderState);
+    switch (senderState->packetType)
+    {
+        case NocPacketType::MESSAGE:
+            return NOC_SLOT_MSG;
+        case NocPacketType::CACHE_MEM_REQ:
+            return NOC_SLOT_LLC;
+        default:
+            return NOC_SLOT_MEM;
+    }
+}
+
+bool
+Tcu::nocNeedsBuffer(PacketPtr pkt) const
+{
+    auto senderState = dynamic_cast<NocSenderState*>(pkt->senderState);
+    switch (senderState->packetType)
+    {
+        // atomics access the memory directly and copy requests are queued
+        // until we send the data
+        case NocPacketType::ATOMIC_REQ:
+        case NocPacketType::COPY_REQ:
+            return false;
+        case NocPacketType::MESSAGE:
+            return true;
+        default:
+            // register accesses are forwarded to the register file
+            return !mmioRegion.contains(NocAddr(pkt->getAddr()).offset);
+    }
+}
+
+Tcu::TrafficClass
+Tcu::trafficClass(NocPacketType type, PacketPtr pkt) const
+{
+    switch (type)
+    {
+        case NocPacketType::MESSAGE:
+        {
+            // replies are sent via reply EPs and complete a pending request
+            auto header = pkt->getConstPtr<MessageHeader>();
+            return (header->flags & REPLY_FLAG) ? TC_REPLY : TC_MSG;
+        }
+        // atomics are used for synchronization and thus latency critical
+        case NocPacketType::ATOMIC_REQ:
+            return TC_MSG;
+        case NocPacketType::CACHE_MEM_REQ:
+        case NocPacketType::CACHE_MEM_REQ_FUNC:
+            return TC_LLC;
+        default:
+            return TC_MEM;
+    }
+}
+
+bool
+Tcu::reserveNocSlot(PacketPtr pkt)
+{
+    auto senderState = dynamic_cast<NocSenderState*>(pkt->senderState);
+    NocSlotType type = nocSlotType(pkt);
+
+    // requests that will need a transfer buffer at some point can only be
+    // accepted if there is a buffer that is not yet claimed
+    bool buffer = nocNeedsBuffer(pkt);
+    if (nocSlotsUsed[type] >= nocSlots[type] ||
+        (buffer && nocBuffersClaimed >= xferUnit->freeBuffers()))
+    {
+        DPRINTF(TcuPackets,
+                "No free NoC slot of type %d (%u/%u, %u buffers claimed)\n",
+                type, nocSlotsUsed[type], nocSlots[type], nocBuffersClaimed);
+        nocSlotRejects[type]++;
+        return false;
+    }
+
+    nocSlotsUsed[type]++;
+    if (buffer)
+        nocBuffersClaimed++;
+    senderState->slot = type;
+    senderState->buffer = buffer;
+    return true;
+}
+
+void
+Tcu::finishNocRequest(PacketPtr pkt)
+{
+    auto senderState = dynamic_cast<NocSenderState*>(pkt->senderState);
+    if (senderState->slot == NOC_SLOT_NONE)
+        return;
+
+    assert(nocSlotsUsed[senderState->slot] > 0);
+    nocSlotsUsed[senderState->slot]--;
+    senderState->slot = NOC_SLOT_NONE;
+    if (senderState->buffer)
+    {
+        assert(nocBuffersClaimed > 0);
+        nocBuffersClaimed--;
+        senderState->buffer = false;
+    }
+
+    retryNocRequests();
+}
+
 void
-Tcu::handleNocRequest(PacketPtr pkt)
+Tcu::retryNocRequests()
+{
+    // don't retry synchronously, because we might be in the middle of
+    // handling a NoC request
+    if (!atomicMode() && !nocRetryEvent.scheduled())
+        schedule(nocRetryEvent, clockEdge(Cycles(1)));
+}
+
+void
+Tcu::sendNocRetry()
+{
+    nocSlavePort.retryRequest();
+}
+
+bool
+Tcu::handleNocRequest(PacketPtr pkt, bool functional)
 {
     assert(!pkt->isError());
 
     if (pkt->cacheResponding())
     {
         DPRINTF(TcuPackets, "Ignoring packet, because cache is responding\n");
-        schedNocRequestFinished(clockEdge(Cycles(1)));
-        return;
+        return true;
     }
 
     auto senderState = dynamic_cast<NocSenderState*>(pkt->senderState);
+    senderState->slot = NOC_SLOT_NONE;
+    senderState->buffer = false;
+
+    // functional and atomic requests are handled immediately
+    if (!functional && !atomicMode() && !reserveNocSlot(pkt))
+        return false;
 
     switch (senderState->packetType)
     {
@@ -261,12 +478,20 @@ Tcu::handleNocRequest(PacketPtr pkt)
         }
         case NocPacketType::READ_REQ:
         case NocPacketType::WRITE_REQ:
+        case NocPacketType::ATOMIC_REQ:
+        case NocPacketType::COPY_REQ:
+        case NocPacketType::COPY_DATA:
         case NocPacketType::CACHE_MEM_REQ:
         {
             if (senderState->packetType == NocPacketType::READ_REQ)
                 nocReadRecvs++;
-            else if (senderState->packetType == NocPacketType::WRITE_REQ)
+            else if (senderState->packetType == NocPacketType::WRITE_REQ ||
+                     senderState->packetType == NocPacketType::COPY_DATA)
                 nocWriteRecvs++;
+            else if (senderState->packetType == NocPacketType::ATOMIC_REQ)
+                nocAtomicRecvs++;
+            else if (senderState->packetType == NocPacketType::COPY_REQ)
+                nocCopyRecvs++;
             memUnit->recvFromNoc(pkt);
             break;
         }
@@ -276,6 +501,7 @@ Tcu::handleNocRequest(PacketPtr pkt)
         default:
             panic("Unexpected NocPacketType\n");
     }
+    return true;
 }
 
 void
@@ -284,21 +510,33 @@ Tcu::sendNocRequest(NocPacketType type,
                     Cycles delay,
                     bool functional)
 {
-    auto senderState = new NocSenderState();
+    auto senderState = pool.create<NocSenderState>();
     senderState->packetType = type;
     senderState->result = TcuError::NONE;
 
     if (type == NocPacketType::MESSAGE || type == NocPacketType::READ_REQ ||
-        type == NocPacketType::WRITE_REQ)
+        type == NocPacketType::WRITE_REQ ||
+        type == NocPacketType::ATOMIC_REQ || type == NocPacketType::COPY_REQ)
         cmds.setRemoteCommand(true);
 
     pkt->pushSenderState(senderState);
+    pkt->qosValue(trafficClass(type, pkt));
 
     if (functional)
     {
         sendFunctionalNocRequest(pkt);
         completeNocRequest(pkt);
     }
+    else if (atomicMode())
+    {
+        chargeAtomic(cyclesToTicks(delay));
+        chargeAtomic(sendAtomicNocRequest(pkt));
+
+        // the latency is already charged
+        pkt->headerDelay = 0;
+        pkt->payloadDelay = 0;
+        completeNocRequest(pkt);
+    }
     else
         schedNocRequest(pkt, clockEdge(delay));
 }
@@ -313,13 +551,19 @@ Tcu::completeNocRequest(PacketPtr pkt)
         // as these target memory tiles, there can't be any error
         assert(senderState->result == TcuError::NONE);
 
+        if (llcUnit->finishWriteback(pkt))
+        {
+            pool.destroy(senderState);
+            return;
+        }
+
         if (auto state = dynamic_cast<InitSenderState*>(pkt->senderState))
         {
             // undo the change from handleCacheMemRequest
             pkt->setAddr(state->oldAddr);
             pkt->req->setPaddr(state->oldAddr);
             pkt->popSenderState();
-            delete state;
+            pool.destroy(state);
         }
 
         DPRINTF(TcuLLCMemAcc,
@@ -330,31 +574,35 @@ Tcu::completeNocRequest(PacketPtr pkt)
         if(pkt->isRead())
             printPacket(pkt);
 
+        llcUnit->finishFill(pkt);
         schedLLCResponse(pkt, true);
     }
+    // the data packets of a COPY do not belong to our own command
+    else if (senderState->packetType == NocPacketType::COPY_DATA)
+        memUnit->copyDataComplete(pkt, senderState->result);
     else if (senderState->packetType != NocPacketType::CACHE_MEM_REQ_FUNC)
     {
         cmds.setRemoteCommand(false);
-        // if the current command should be aborted, just ignore the packet
-        // and finish the command
+        // if the current command should be aborted, just ignore the packet's
+        // result; the command finishes as soon as all packets are done
+        TcuError result = senderState->result;
         if (cmds.isCommandAborting())
-        {
-            freeRequest(pkt);
-            scheduleCmdFinish(Cycles(1), TcuError::ABORT);
-        }
+            result = TcuError::ABORT;
+
+        auto cmd = regs().getCommand();
+        if (senderState->packetType == NocPacketType::ATOMIC_REQ)
+            memUnit->atomicComplete(cmd, pkt, result);
+        else if (senderState->packetType == NocPacketType::COPY_REQ)
+            memUnit->copyComplete(cmd, pkt, result);
+        else if (pkt->isWrite())
+            memUnit->writeComplete(cmd, pkt, result);
+        else if (pkt->isRead())
+            memUnit->readComplete(cmd, pkt, result);
         else
-        {
-            auto cmd = regs().getCommand();
-            if (pkt->isWrite())
-                memUnit->writeComplete(cmd, pkt, senderState->result);
-            else if (pkt->isRead())
-                memUnit->readComplete(cmd, pkt, senderState->result);
-            else
-                panic("unexpected packet type\n");
-        }
+            panic("unexpected packet type\n");
     }
 
-    delete senderState;
+    pool.destroy(senderState);
 }
 
 void
@@ -371,7 +619,7 @@ Tcu::sendNocResponse(PacketPtr pkt, TcuError result)
     pkt->headerDelay = 0;
     pkt->payloadDelay = 0;
 
-    schedNocRequestFinished(clockEdge(Cycles(1)));
+    finishNocRequest(pkt);
     schedNocResponse(pkt, clockEdge(delay));
 }
 
@@ -379,16 +627,23 @@ void
 Tcu::sendMemRequest(PacketPtr pkt,
                     Addr data,
                     Cycles delay,
-                    bool coverage)
+                    MemReqType type)
 {
-    auto senderState = new MemSenderState();
+    auto senderState = pool.create<MemSenderState>();
     senderState->data = data;
     senderState->mid = pkt->req->requestorId();
-    senderState->coverage = coverage;
+    senderState->type = type;
 
     pkt->pushSenderState(senderState);
 
-    schedMemRequest(pkt, clockEdge(delay));
+    if (atomicMode())
+    {
+        chargeAtomic(cyclesToTicks(delay));
+        chargeAtomic(sendAtomicMemRequest(pkt));
+        completeMemRequest(pkt);
+    }
+    else
+        schedMemRequest(pkt, clockEdge(delay));
 }
 
 void
@@ -402,15 +657,29 @@ Tcu::completeMemRequest(PacketPtr pkt)
     // set the old requestor id again
     pkt->req->setRequestorId(senderState->mid);
 
-    if (senderState->coverage)
+    switch (senderState->type)
     {
-        auto ev = reinterpret_cast<WriteCoverageEvent*>(senderState->data);
-        ev->completed(pkt);
+        case MemReqType::TRANSFER:
+            xferUnit->recvMemResponse(senderState->data, pkt);
+            break;
+        case MemReqType::COVERAGE:
+        {
+            auto ev = reinterpret_cast<WriteCoverageEvent*>(senderState->data);
+            ev->completed(pkt);
+            break;
+        }
+        case MemReqType::PT_WALK:
+            ptUnit->recvMemResponse(pkt);
+            break;
+        case MemReqType::ATOMIC:
+            memUnit->recvAtomicMemResponse(pkt);
+            break;
+        case MemReqType::DESCRIPTOR:
+            memUnit->recvDescriptor(pkt);
+            break;
     }
-    else
-        xferUnit->recvMemResponse(senderState->data, pkt);
 
-    delete senderState;
+    pool.destroy(senderState);
     freeRequest(pkt);
 }
 
@@ -443,6 +712,11 @@ Tcu::handleCoreMemRequest(PacketPtr pkt,
 
         if (functional)
             mport.sendFunctional(pkt);
+        else if (atomicMode())
+        {
+            chargeAtomic(cyclesToTicks(cpuToCacheLatency));
+            chargeAtomic(mport.sendAtomic(pkt));
+        }
         else
         {
             Tick tick;
@@ -487,8 +761,11 @@ Tcu::forwardRequestToRegFile(PacketPtr pkt, bool isCpuRequest)
 
     Tick when = clockEdge(transportDelay + mmioLatency);
 
+    if (atomicMode())
+        chargeAtomic(cyclesToTicks(mmioLatency));
+
     if (!isCpuRequest)
-        schedNocRequestFinished(clockEdge(Cycles(1)));
+        finishNocRequest(pkt);
 
     if (~result & RegFile::WROTE_EXT_CMD)
     {
@@ -522,6 +799,13 @@ Tcu::forwardRequestToRegFile(PacketPtr pkt, bool isCpuRequest)
     cmds.startCommand(result, pkt, when);
 }
 
+void
+Tcu::finishAtomicAccess()
+{
+    // finish the commands the request has started or woken up
+    cmds.finishAtomic();
+}
+
 NocAddr
 Tcu::translatePhysToNoC(Addr phys, bool write)
 {
@@ -582,6 +866,26 @@ Tcu::handleLLCRequest(PacketPtr pkt, bool functional)
     if (!noc.valid)
         return false;
 
+    extMemReqs++;
+
+    // coalesced and combined requests are sent later, if at all
+    if (!functional && !atomicMode() && llcUnit->handleRequest(pkt, noc))
+        return true;
+
+    sendLLCRequest(pkt, noc, functional);
+    return true;
+}
+
+bool
+Tcu::canHandleLLCRequest(PacketPtr pkt)
+{
+    return llcUnit->canAccept(pkt);
+}
+
+void
+Tcu::sendLLCRequest(PacketPtr pkt, NocAddr noc, bool functional)
+{
+    Addr pktAddr = pkt->getAddr();
     pkt->setAddr(noc.getAddr());
 
     DPRINTF(TcuLLCMemAcc, "Sending LLC request for %#x to %d:%#x\n",
@@ -592,7 +896,7 @@ Tcu::handleLLCRequest(PacketPtr pkt, bool functional)
 
     // remember that we did this change
     if (!functional)
-        pkt->pushSenderState(new InitSenderState(pktAddr));
+        pkt->pushSenderState(pool.create<InitSenderState>(pktAddr));
 
     auto type = functional ? Tcu::NocPacketType::CACHE_MEM_REQ_FUNC
                            : Tcu::NocPacketType::CACHE_MEM_REQ;
@@ -602,11 +906,8 @@ Tcu::handleLLCRequest(PacketPtr pkt, bool functional)
                    Cycles(1),
                    functional);
 
-    extMemReqs++;
-
     if (functional)
         pkt->setAddr(pktAddr);
-    return true;
 }
 
 void
@@ -46,8 +46,10 @@
 #include "mem/tcu/error.hh"
 #include "params/Tcu.hh"
 
+class LLCUnit;
 class MessageUnit;
 class MemoryUnit;
+class PtUnit;
 class XferUnit;
 
 class Tcu : public BaseTcu
@@ -78,19 +80,55 @@ class Tcu : public BaseTcu
         WRITE_REQ,
         CACHE_MEM_REQ_FUNC,
         CACHE_MEM_REQ,
+        ATOMIC_REQ,
+        // initiator -> source of a COPY
+        COPY_REQ,
+        // source -> destination of a COPY
+        COPY_DATA,
+    };
+
+    // the traffic classes of NoC packets, which are stored in the QoS value
+    // of the packets (higher values have priority)
+    enum TrafficClass : uint8_t
+    {
+        TC_MEM,
+        TC_LLC,
+        TC_MSG,
+        TC_REPLY,
+    };
+
+    enum NocSlotType
+    {
+        NOC_SLOT_MSG,
+        NOC_SLOT_MEM,
+        NOC_SLOT_LLC,
+        NOC_SLOT_NONE,
+    };
+
+    enum class MemReqType
+    {
+        TRANSFER,
+        COVERAGE,
+        PT_WALK,
+        ATOMIC,
+        DESCRIPTOR,
     };
 
     struct MemSenderState : public Packet::SenderState
     {
         Addr data;
         RequestorID mid;
-        bool coverage;
+        MemReqType type;
     };
 
     struct NocSenderState : public Packet::SenderState
     {
         TcuError result;
         NocPacketType packetType;
+        // the slot the request occupies at the receiving TCU
+        NocSlotType slot = NOC_SLOT_NONE;
+        // whether the request has claimed a transfer buffer
+        bool buffer = false;
     };
 
     struct InitSenderState : public Packet::SenderState
@@ -104,7 +142,6 @@ class Tcu : public BaseTcu
     {
         Tcu &_tcu;
         uint16_t _act;
-        uint8_t *_buffer;
         ChunkGenerator _gen;
         OutputStream *_out;
         std::ostream *_os;
@@ -113,7 +150,6 @@ class Tcu : public BaseTcu
             : Event(),
               _tcu(tcu),
               _act(act),
-              _buffer(new uint8_t[tcu.blockSize]),
               _gen(address, size, tcu.blockSize),
               _out(),
               _os()
@@ -122,7 +158,6 @@ class Tcu : public BaseTcu
         {
             if (_out)
                 simout.close(_out);
-            delete[] _buffer;
         }
 
         void process() override;
@@ -139,6 +174,10 @@ class Tcu : public BaseTcu
 
     void regStats() override;
 
+    void serialize(CheckpointOut &cp) const override;
+
+    void unserialize(CheckpointIn &cp) override;
+
     System *systemObject() { return system; }
 
     RegFile &regs() { return regFile; }
@@ -149,6 +188,12 @@ class Tcu : public BaseTcu
 
     TcuTlb *tlb() { return tlBuf; }
 
+    MemoryUnit &mem() { return *memUnit; }
+
+    MessageUnit &msgs() { return *msgUnit; }
+
+    PtUnit *walker() { return ptUnit; }
+
     bool isMemTile(unsigned tile) const;
 
     void printLine(Addr len);
@@ -185,7 +230,7 @@ class Tcu : public BaseTcu
     void sendMemRequest(PacketPtr pkt,
                         Addr data,
                         Cycles delay,
-                        bool coverage);
+                        MemReqType type);
 
     void sendNocRequest(NocPacketType type,
                         PacketPtr pkt,
@@ -194,10 +239,36 @@ class Tcu : public BaseTcu
 
     void sendNocResponse(PacketPtr pkt, TcuError result = TcuError::NONE);
 
+    /**
+     * Releases the slot of the given NoC request, once we have started its
+     * transfer or completed it.
+     */
+    void finishNocRequest(PacketPtr pkt);
+
+    /**
+     * Lets the NoC retry a rejected request, because a slot or buffer
+     * became available.
+     */
+    void retryNocRequests();
+
+    /**
+     * Lets the LLC retry a rejected request, because an MSHR became
+     * available.
+     */
+    void sendLLCRetry() { llcSlavePort.retryRequest(); }
+
+    /**
+     * Sends the request of the LLC to the memory tile at <noc>.
+     */
+    void sendLLCRequest(PacketPtr pkt, NocAddr noc, bool functional);
+
     NocAddr translatePhysToNoC(Addr phys, bool write);
 
     void startTransfer(void *event, Cycles delay);
 
+    Tick accessMemAtomic(NocAddr phys, uint8_t *data, size_t size,
+                         bool write);
+
     size_t startForeignReceive(epid_t epId, actid_t actId);
 
     void printPacket(PacketPtr pkt) const;
@@ -210,7 +281,17 @@ class Tcu : public BaseTcu
 
     void completeMemRequest(PacketPtr pkt) override;
 
-    void handleNocRequest(PacketPtr pkt) override;
+    bool handleNocRequest(PacketPtr pkt, bool functional) override;
+
+    NocSlotType nocSlotType(PacketPtr pkt) const;
+
+    bool nocNeedsBuffer(PacketPtr pkt) const;
+
+    TrafficClass trafficClass(NocPacketType type, PacketPtr pkt) const;
+
+    bool reserveNocSlot(PacketPtr pkt);
+
+    void sendNocRetry();
 
     bool handleCoreMemRequest(PacketPtr pkt,
                               TcuSlavePort &sport,
@@ -218,8 +299,14 @@ class Tcu : public BaseTcu
                               bool icache,
                               bool functional) override;
 
+    bool canHandleLLCRequest(PacketPtr pkt) override;
+
     bool handleLLCRequest(PacketPtr pkt, bool functional) override;
 
+    void finishAtomicAccess() override;
+
+    bool isDrained() override;
+
   private:
 
     RegFile regFile;
@@ -228,12 +315,16 @@ class Tcu : public BaseTcu
 
     TcuTlb *tlBuf;
 
+    PtUnit *ptUnit;
+
     MessageUnit *msgUnit;
 
     MemoryUnit *memUnit;
 
     XferUnit *xferUnit;
 
+    LLCUnit *llcUnit;
+
     CoreRequests coreReqs;
 
     EpFile epFile;
@@ -242,6 +333,12 @@ class Tcu : public BaseTcu
 
     EventWrapper<CoreRequests, &CoreRequests::completeReqs> completeCoreReqEvent;
 
+    EventWrapper<Tcu, &Tcu::sendNocRetry> nocRetryEvent;
+
+    unsigned nocSlotsUsed[NOC_SLOT_NONE];
+    // the number of accepted requests that will need a transfer buffer
+    unsigned nocBuffersClaimed;
+
   public:
 
     const Addr tileMemOffset;
@@ -255,6 +352,12 @@ class Tcu : public BaseTcu
     const size_t bufCount;
     const size_t bufSize;
     const size_t reqCount;
+    const size_t nocReqCount;
+    const unsigned nocSlots[NOC_SLOT_NONE];
+
+    const bool memBackdoor;
+    const Cycles memBackdoorLatency;
+    const unsigned memBackdoorThroughput;
 
     const Cycles mmioLatency;
     const Cycles cpuToCacheLatency;
@@ -262,6 +365,8 @@ class Tcu : public BaseTcu
 
     const Cycles cmdReadLatency;
     const Cycles cmdWriteLatency;
+    const Cycles cmdAtomicLatency;
+    const Cycles cmdCopyLatency;
     const Cycles cmdSendLatency;
     const Cycles cmdReplyLatency;
     const Cycles cmdRecvLatency;
@@ -272,6 +377,9 @@ class Tcu : public BaseTcu
     Stats::Scalar nocMsgRecvs;
     Stats::Scalar nocReadRecvs;
     Stats::Scalar nocWriteRecvs;
+    Stats::Scalar nocAtomicRecvs;
+    Stats::Scalar nocCopyRecvs;
+    Stats::Vector nocSlotRejects;
 
     // other
     Stats::Scalar regFileReqs;
@@ -33,8 +33,6 @@
 
 #include "debug/TcuTlb.hh"
 
-#include <limits>
-
 static const char *decode_access(uint access)
 {
     static char buf[6];
@@ -47,11 +45,146 @@ static const char *decode_access(uint access)
     return buf;
 }
 
-TcuTlb::TcuTlb(Tcu &_tcu, size_t _num)
-    : tcu(_tcu), entries(), num(_num), lru_seq()
+TcuTlb::Level::Level(size_t num, size_t _assoc, ReplacementPolicy::Base *_rp)
+    : entries(num), sets(), assoc(_assoc ? _assoc : num), rp(_rp)
 {
+    // an associativity of 0 means fully associative
+    fatal_if(assoc == 0 || num % assoc != 0,
+             "TLB size (%lu) has to be a multiple of the associativity (%lu)",
+             num, assoc);
+    sets = num / assoc;
+
     for (size_t i = 0; i < num; ++i)
-        entries.push_back(Entry());
+    {
+        entries[i].setPosition(i / assoc, i % assoc);
+        entries[i].replacementData = rp->instantiateEntry();
+    }
+}
+
+size_t
+TcuTlb::Level::index(Addr virt, uint16_t asid) const
+{
+    // fold the upper bits into the page number to spread large pages, whose
+    // lower page-number bits are zero, over all sets as well
+    Addr pageNo = virt >> PAGE_BITS;
+    return (pageNo ^ (pageNo >> LEVEL_BITS) ^ asid) % sets;
+}
+
+TcuTlb::Entry *
+TcuTlb::Level::find(Addr virt, uint16_t asid)
+{
+    for (Addr mask : {static_cast<Addr>(PAGE_MASK),
+                      static_cast<Addr>(LPAGE_MASK)})
+    {
+        Addr pgVirt = virt & ~mask;
+        bool large = mask == LPAGE_MASK;
+        Entry *set = &entries[index(pgVirt, asid) * assoc];
+        for (size_t i = 0; i < assoc; ++i)
+        {
+            Entry &e = set[i];
+            if (e.flags != 0 && e.asid == asid && e.virt == pgVirt &&
+                !!(e.flags & LARGE) == large)
+                return &e;
+        }
+    }
+    return nullptr;
+}
+
+TcuTlb::Entry *
+TcuTlb::Level::findVictim(Addr virt, uint16_t asid)
+{
+    ReplacementCandidates candidates;
+    Entry *set = &entries[index(virt, asid) * assoc];
+    for (size_t i = 0; i < assoc; ++i)
+    {
+        if (set[i].flags == 0)
+            return &set[i];
+        // fixed entries are never evicted
+        if (!(set[i].flags & FIXED))
+            candidates.push_back(&set[i]);
+    }
+
+    if (candidates.empty())
+        return nullptr;
+    return static_cast<Entry*>(rp->getVictim(candidates));
+}
+
+void
+TcuTlb::Level::touch(Entry *e)
+{
+    rp->touch(e->replacementData);
+}
+
+void
+TcuTlb::Level::invalidate(Entry *e)
+{
+    e->flags = 0;
+    rp->invalidate(e->replacementData);
+}
+
+void
+TcuTlb::Level::serialize(CheckpointOut &cp) const
+{
+    // the replacement state is not part of the checkpoint
+    std::vector<Addr> virt, phys;
+    std::vector<uint16_t> asid;
+    std::vector<uint> flags;
+    for (const Entry &e : entries)
+    {
+        virt.push_back(e.virt);
+        asid.push_back(e.asid);
+        phys.push_back(e.phys.getAddr());
+        flags.push_back(e.flags);
+    }
+
+    SERIALIZE_CONTAINER(virt);
+    SERIALIZE_CONTAINER(asid);
+    SERIALIZE_CONTAINER(phys);
+    SERIALIZE_CONTAINER(flags);
+}
+
+void
+TcuTlb::Level::unserialize(CheckpointIn &cp)
+{
+    std::vector<Addr> virt, phys;
+    std::vector<uint16_t> asid;
+    std::vector<uint> flags;
+    UNSERIALIZE_CONTAINER(virt);
+    UNSERIALIZE_CONTAINER(asid);
+    UNSERIALIZE_CONTAINER(phys);
+    UNSERIALIZE_CONTAINER(flags);
+
+    fatal_if(virt.size() != entries.size(),
+             "TLB size changed (%lu -> %lu)\n", virt.size(), entries.size());
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        Entry &e = entries[i];
+        e.virt = virt[i];
+        e.asid = asid[i];
+        e.phys = NocAddr(phys[i]);
+        e.flags = flags[i];
+        if (e.flags != 0)
+            rp->reset(e.replacementData);
+        else
+            rp->invalidate(e.replacementData);
+    }
+}
+
+TcuTlb::TcuTlb(Tcu &_tcu, const TcuParams &p)
+    : tcu(_tcu),
+      l1(p.tlb_entries, p.tlb_assoc, p.tlb_replacement_policy),
+      l2(p.l2_tlb_entries > 0
+            ? new Level(p.l2_tlb_entries, p.l2_tlb_assoc,
+                        p.l2_tlb_replacement_policy)
+            : nullptr),
+      l2Latency(p.l2_tlb_latency)
+{
+}
+
+TcuTlb::~TcuTlb()
+{
+    delete l2;
 }
 
 void
@@ -60,6 +193,9 @@ TcuTlb::regStats()
     hits
         .name(tcu.name() + ".tlb.hits")
         .desc("Number of TLB accesses that caused a hit");
+    l2Hits
+        .name(tcu.name() + ".tlb.l2Hits")
+        .desc("Number of TLB hits in the L2 TLB");
     misses
         .name(tcu.name() + ".tlb.misses")
         .desc("Number of TLB accesses that caused a miss");
@@ -76,6 +212,9 @@ TcuTlb::regStats()
     evicts
         .name(tcu.name() + ".tlb.evicts")
         .desc("Number of TLB evictions");
+    l2Evicts
+        .name(tcu.name() + ".tlb.l2Evicts")
+        .desc("Number of evictions in the L2 TLB");
     invalidates
         .name(tcu.name() + ".tlb.invalidates")
         .desc("Number of TLB invalidates");
@@ -95,12 +234,30 @@ TcuTlb::lookup(Addr virt, uint16_t asid, uint access, NocAddr *phys,
         "PAGEFAULT",
     };
 
-    size_t iters;
-    Entry *e = do_lookup(virt, asid, &iters);
-
-    *delay = Cycles(tcu.tlbLatency + iters);
+    // the latency depends on the level that provides the entry
+    *delay = tcu.tlbLatency;
     *phys = NocAddr();
 
+    Entry *e = l1.find(virt, asid);
+    if (e)
+        l1.touch(e);
+    else if (l2)
+    {
+        *delay += l2Latency;
+        e = l2->find(virt, asid);
+        if (e)
+        {
+            l2->touch(e);
+            l2Hits++;
+
+            // move a copy into the L1 TLB, if possible
+            Entry *l1e = insertInto(l1, e->virt, e->asid, e->phys, e->flags,
+                                    evicts);
+            if (l1e)
+                e = l1e;
+        }
+    }
+
     Result res;
     if (!e)
     {
@@ -116,7 +273,6 @@ TcuTlb::lookup(Addr virt, uint16_t asid, uint access, NocAddr *phys,
     {
         assert(e->flags != 0);
         *phys = e->phys;
-        e->lru_seq = ++lru_seq;
         Addr mask = (e->flags & LARGE) ? LPAGE_MASK : PAGE_MASK;
         phys->offset += virt & mask;
         hits++;
@@ -132,44 +288,33 @@ TcuTlb::lookup(Addr virt, uint16_t asid, uint access, NocAddr *phys,
 }
 
 TcuTlb::Entry *
-TcuTlb::do_lookup(Addr virt, uint16_t asid, size_t *iters)
+TcuTlb::insertInto(Level &level, Addr virt, uint16_t asid, NocAddr phys,
+                   uint flags, Stats::Scalar &evictStat)
 {
-    for(size_t i = 0; i < num; ++i)
+    Entry *e = level.find(virt, asid);
+    // the page size determines the set; thus, start from scratch if it
+    // changed
+    if (e && (e->flags & LARGE) != (flags & LARGE))
     {
-        if (entries[i].flags == 0 || entries[i].asid != asid)
-            continue;
-
-        Addr offMask = (entries[i].flags & LARGE) ? LPAGE_MASK : PAGE_MASK;
-        Addr pgMask = ~offMask;
-        if ((virt & pgMask) == entries[i].virt)
-        {
-            *iters = i + 1;
-            return &entries[i];
-        }
+        level.invalidate(e);
+        e = nullptr;
     }
-    *iters = num;
-    return nullptr;
-}
 
-TcuTlb::Entry *
-TcuTlb::find_free()
-{
-    uint min = std::numeric_limits<uint>::max();
-    Entry *minEntry = NULL;
-    for (size_t i = 0; i < num; ++i)
+    if (!e)
     {
-        if (entries[i].flags == 0)
-            return &entries[i];
-
-        if (entries[i].lru_seq < min && !(entries[i].flags & FIXED))
-        {
-            min = entries[i].lru_seq;
-            minEntry = &entries[i];
-        }
+        e = level.findVictim(virt, asid);
+        if (!e)
+            return nullptr;
+        if (e->flags != 0)
+            evictStat++;
     }
 
-    evicts++;
-    return minEntry;
+    e->asid = asid;
+    e->virt = virt;
+    e->phys = phys;
+    e->flags = flags;
+    level.rp->reset(e->replacementData);
+    return e;
 }
 
 bool
@@ -178,23 +323,20 @@ TcuTlb::insert(Addr virt, uint16_t asid, NocAddr phys, uint flags)
     assert(flags != 0);
     Addr mask = (flags & LARGE) ? LPAGE_MASK : PAGE_MASK;
 
-    size_t iters;
-    Entry *e = do_lookup(virt, asid, &iters);
-    if (!e)
-    {
-        e = find_free();
-        if (!e)
-            return false;
-    }
+    virt &= ~mask;
+    phys = NocAddr(phys.getAddr() & ~mask);
 
-    e->asid = asid;
-    e->virt = virt & ~mask;
-    e->phys = NocAddr(phys.getAddr() & ~mask);
-    e->flags = flags;
+    // the L2 TLB holds all entries, if possible. an entry is only missing in
+    // the L1 TLB, if its set is occupied by fixed entries.
+    Entry *e1 = insertInto(l1, virt, asid, phys, flags, evicts);
+    Entry *e2 = l2 ? insertInto(*l2, virt, asid, phys, flags, l2Evicts)
+                   : nullptr;
+    if (!e1 && !e2)
+        return false;
 
     DPRINTFS(TcuTlbWrite, (&tcu),
              "TLB insert for virt=%p asid=%#x perm=%s -> %p\n",
-             e->virt, e->asid, decode_access(e->flags), e->phys.getAddr());
+             virt, asid, decode_access(flags), phys.getAddr());
     inserts++;
     return true;
 }
@@ -202,16 +344,20 @@ TcuTlb::insert(Addr virt, uint16_t asid, NocAddr phys, uint flags)
 bool
 TcuTlb::remove(Addr virt, uint16_t asid)
 {
-    size_t iters;
-    Entry *e = do_lookup(virt, asid, &iters);
-    if (!e)
+    Entry *e1 = l1.find(virt, asid);
+    Entry *e2 = l2 ? l2->find(virt, asid) : nullptr;
+    if (!e1 && !e2)
         return false;
 
+    Entry *e = e1 ? e1 : e2;
     DPRINTFS(TcuTlbWrite, (&tcu),
              "TLB invalidate for virt=%p asid=%#x perm=%s -> %p\n",
              virt, asid, decode_access(e->flags), e->phys.getAddr());
 
-    e->flags = 0;
+    if (e1)
+        l1.invalidate(e1);
+    if (e2)
+        l2->invalidate(e2);
     invalidates++;
     return true;
 }
@@ -221,10 +367,53 @@ TcuTlb::clear()
 {
     DPRINTFS(TcuTlbWrite, (&tcu), "TLB flush\n");
 
-    for (size_t i = 0; i < num; ++i)
+    for (Level *level : {&l1, l2})
     {
-        if (entries[i].flags != 0 && !(entries[i].flags & FIXED))
-            entries[i].flags = 0;
+        if (!level)
+            continue;
+
+        for (auto &e : level->entries)
+        {
+            if (e.flags != 0 && !(e.flags & FIXED))
+                level->invalidate(&e);
+        }
     }
     flushes++;
 }
+
+void
+TcuTlb::serialize(CheckpointOut &cp) const
+{
+    bool hasL2 = l2 != nullptr;
+    SERIALIZE_SCALAR(hasL2);
+
+    {
+        ScopedCheckpointSection sec(cp, "l1");
+        l1.serialize(cp);
+    }
+    if (l2)
+    {
+        ScopedCheckpointSection sec(cp, "l2");
+        l2->serialize(cp);
+    }
+}
+
+void
+TcuTlb::unserialize(CheckpointIn &cp)
+{
+    bool hasL2;
+    UNSERIALIZE_SCALAR(hasL2);
+    fatal_if(hasL2 != (l2 != nullptr),
+             "%s: the checkpoint was taken with%s L2 TLB\n",
+             tcu.name(), hasL2 ? "" : "out");
+
+    {
+        ScopedCheckpointSection sec(cp, "l1");
+        l1.unserialize(cp);
+    }
+    if (l2)
+    {
+        ScopedCheckpointSection sec(cp, "l2");
+        l2->unserialize(cp);
+    }
+}
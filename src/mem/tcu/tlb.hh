@@ -33,23 +33,56 @@
 
 #include "base/statistics.hh"
 #include "base/types.hh"
+#include "mem/cache/replacement_policies/base.hh"
 #include "mem/tcu/noc_addr.hh"
+#include "params/Tcu.hh"
+#include "sim/serialize.hh"
 #include <vector>
 
 class Tcu;
 
-class TcuTlb
+class TcuTlb : public Serializable
 {
   private:
 
-    struct Entry
+    struct Entry : public ReplaceableEntry
     {
+        Entry() : virt(), asid(), phys(), flags()
+        {}
+
         Addr virt;
         uint16_t asid;
         NocAddr phys;
         uint flags;
+    };
+
+    /**
+     * One level of the TLB. The entries are organized in sets, which are
+     * indexed by a hash of the page number and the ASID. Small and large
+     * pages are both indexed by their own page number.
+     */
+    struct Level
+    {
+        Level(size_t num, size_t assoc, ReplacementPolicy::Base *rp);
+
+        Entry *find(Addr virt, uint16_t asid);
+
+        Entry *findVictim(Addr virt, uint16_t asid);
+
+        size_t index(Addr virt, uint16_t asid) const;
+
+        void touch(Entry *e);
 
-        uint lru_seq;
+        void invalidate(Entry *e);
+
+        void serialize(CheckpointOut &cp) const;
+
+        void unserialize(CheckpointIn &cp);
+
+        std::vector<Entry> entries;
+        size_t sets;
+        size_t assoc;
+        ReplacementPolicy::Base *rp;
     };
 
   public:
@@ -89,6 +122,10 @@ class TcuTlb
         RWX     = RW | EXEC,
     };
 
+    /**
+     * Is notified as soon as the page-table walk for a TLB miss is done. On
+     * success, the result is HIT and phys contains the translation of virt.
+     */
     struct MissHandler
     {
         MissHandler(Addr _virt, uint _access)
@@ -98,15 +135,15 @@ class TcuTlb
         virtual ~MissHandler()
         {}
 
-        void start();
-
-        virtual void finish(NocAddr phys) = 0;
+        virtual void finish(Result res, NocAddr phys) = 0;
 
         Addr virt;
         uint access;
     };
 
-    TcuTlb(Tcu &_tcu, size_t _num);
+    TcuTlb(Tcu &_tcu, const TcuParams &p);
+
+    ~TcuTlb();
 
     void regStats();
 
@@ -119,23 +156,29 @@ class TcuTlb
 
     void clear();
 
-  private:
+    void serialize(CheckpointOut &cp) const override;
 
-    Entry *do_lookup(Addr virt, uint16_t asid, size_t *iters);
+    void unserialize(CheckpointIn &cp) override;
+
+  private:
 
-    Entry *find_free();
+    Entry *insertInto(Level &level, Addr virt, uint16_t asid, NocAddr phys,
+                      uint flags, Stats::Scalar &evictStat);
 
     Tcu &tcu;
-    std::vector<Entry> entries;
-    size_t num;
-    uint lru_seq;
+    Level l1;
+    // the optional second level, which is only accessed on L1 misses
+    Level *l2;
+    Cycles l2Latency;
 
     Stats::Scalar hits;
+    Stats::Scalar l2Hits;
     Stats::Scalar misses;
     Stats::Scalar pagefaults;
     Stats::Formula accesses;
     Stats::Scalar inserts;
     Stats::Scalar evicts;
+    Stats::Scalar l2Evicts;
     Stats::Scalar invalidates;
     Stats::Scalar flushes;
 };
@@ -29,6 +29,9 @@
  * policies, either expressed or implied, of the FreeBSD Project.
  */
 
+#include <algorithm>
+#include <numeric>
+
 #include "debug/Tcu.hh"
 #include "debug/TcuBuf.hh"
 #include "debug/TcuPackets.hh"
@@ -38,24 +41,37 @@
 
 static const char *decodeFlags(uint flags)
 {
-    static char buf[3];
+    static char buf[4];
     buf[0] = (flags & XferUnit::MESSAGE) ? 'm' : '-';
     buf[1] = (flags & XferUnit::MSGRECV) ? 'r' : '-';
-    buf[2] = '\0';
+    buf[2] = (flags & XferUnit::LLC) ? 'l' : '-';
+    buf[3] = '\0';
     return buf;
 }
 
 XferUnit::XferUnit(Tcu &_tcu,
                    size_t _blockSize,
                    size_t _bufCount,
-                   size_t _bufSize)
+                   size_t _bufSize,
+                   const std::vector<unsigned> &_reserved)
     : tcu(_tcu),
       blockSize(_blockSize),
       bufCount(_bufCount),
       bufSize(_bufSize),
       bufs(new Buffer*[bufCount]),
-      queue()
+      reserved(_reserved),
+      used(),
+      queues(),
+      backdoor()
 {
+    assert(reserved.size() == BUF_CLASSES);
+    // every class needs at least one buffer it can use
+    unsigned total = std::accumulate(reserved.begin(), reserved.end(), 0u);
+    bool unreserved = std::count(reserved.begin(), reserved.end(), 0u) > 0;
+    fatal_if(total > bufCount || (total == bufCount && unreserved),
+             "Invalid buffer reservations (%u of %lu buffers)\n",
+             total, bufCount);
+
     for (size_t i = 0; i < bufCount; ++i)
         bufs[i] = new Buffer(i, bufSize);
 }
@@ -91,11 +107,23 @@ XferUnit::regStats()
         .desc("Written bytes (to internal memory)")
         .flags(Stats::nozero);
     delays
+        .init(BUF_CLASSES)
         .name(tcu.name() + ".xfer.delays")
-        .desc("Number of delays due to occupied buffers");
+        .desc("Number of delays due to occupied buffers")
+        .flags(Stats::total | Stats::nozero);
+    delays.subname(BUF_LOCAL, "local");
+    delays.subname(BUF_LLC, "llc");
+    delays.subname(BUF_MSGRECV, "msgrecv");
+    delays.subname(BUF_REMOTE, "remote");
     aborts
         .name(tcu.name() + ".xfer.aborts")
         .desc("Number of aborts");
+    backdoorXfers
+        .name(tcu.name() + ".xfer.backdoorXfers")
+        .desc("Number of transfers performed via the memory backdoor");
+    backdoorMisses
+        .name(tcu.name() + ".xfer.backdoorMisses")
+        .desc("Number of transfers the memory backdoor could not serve");
 }
 
 void
@@ -103,7 +131,7 @@ XferUnit::TransferEvent::tryStart()
 {
     assert(buf == NULL);
 
-    buf = xfer->allocateBuf(this, flags());
+    buf = xfer->allocateBuf(this);
 
     // try again later, if there is no free buffer
     if (!buf)
@@ -115,8 +143,8 @@ XferUnit::TransferEvent::tryStart()
             phys.getAddr(),
             decodeFlags(flags()));
 
-        xfer->delays++;
-        xfer->queue.push_back(this);
+        xfer->delays[bufClass()]++;
+        xfer->queues[bufClass()].push_back(this);
         return;
     }
 
@@ -173,6 +201,9 @@ XferUnit::TransferEvent::process()
     if (result != TcuError::NONE)
         return;
 
+    if (tryBackdoor())
+        return;
+
     Addr physAddr = phys.getAddr();
 
     while(freeSlots > 0 && remaining > 0)
@@ -198,7 +229,7 @@ XferUnit::TransferEvent::process()
         }
 
         xfer->tcu.sendMemRequest(pkt, buf->id | (buf->offset << 32),
-                                 Cycles(1), false);
+                                 Cycles(1), Tcu::MemReqType::TRANSFER);
 
         // to next block
         buf->offset += reqSize;
@@ -211,6 +242,88 @@ XferUnit::TransferEvent::process()
     phys = NocAddr(physAddr);
 }
 
+bool
+XferUnit::TransferEvent::tryBackdoor()
+{
+    // only if there are no pending memory requests of this transfer
+    if (!xfer->tcu.memBackdoor || freeSlots != xfer->tcu.reqCount)
+        return false;
+
+    uint8_t *mem = xfer->backdoorPtr(phys.getAddr(), remaining, isWrite());
+    if (!mem)
+        return false;
+
+    DPRINTFS(TcuXfers, (&xfer->tcu),
+        "buf%d: %s %lu bytes @ %p in local memory via backdoor\n",
+        buf->id,
+        isWrite() ? "Writing" : "Reading",
+        remaining,
+        phys.getAddr());
+
+    assert(buf->offset + remaining <= xfer->bufSize);
+    if (isWrite())
+        memcpy(mem, buf->bytes + buf->offset, remaining);
+    else
+        memcpy(buf->bytes + buf->offset, mem, remaining);
+
+    // we do the copy at once, but charge the time the memory requests
+    // would have taken: like in the timing path, the transfer is split
+    // into blocks and reqCount requests are in flight at the same time.
+    // contention at the crossbar and the memory is not considered, though.
+    Addr first = phys.getAddr() & ~static_cast<Addr>(xfer->blockSize - 1);
+    size_t blocks = divCeil(phys.getAddr() + remaining - first,
+                            xfer->blockSize);
+    Cycles reqLatency = xfer->tcu.memBackdoorLatency +
+        Cycles(divCeil(xfer->blockSize, xfer->tcu.memBackdoorThroughput));
+    Cycles delay(reqLatency * divCeil(blocks, xfer->tcu.reqCount));
+
+    xfer->backdoorXfers++;
+    buf->offset += remaining;
+    phys = NocAddr(phys.getAddr() + remaining);
+    remaining = 0;
+
+    // process() will finish the transfer afterwards
+    xfer->tcu.schedule(this, xfer->tcu.clockEdge(delay));
+    return true;
+}
+
+uint8_t *
+XferUnit::backdoorPtr(Addr phys, size_t size, bool write)
+{
+    if (!backdoor)
+    {
+        // ask the local memory for a backdoor by a request without data
+        auto pkt = tcu.generateRequest(phys, 0, MemCmd::ReadReq);
+        tcu.sendMemBackdoorRequest(pkt, backdoor);
+        tcu.freeRequest(pkt);
+
+        if (!backdoor)
+        {
+            backdoorMisses++;
+            return nullptr;
+        }
+
+        // the backdoor is gone as soon as the memory invalidates it
+        backdoor->addInvalidationCallback(
+            [this](const MemBackdoor &)
+            {
+                backdoor = nullptr;
+            }
+        );
+    }
+
+    AddrRange range = RangeSize(phys, size);
+    if (!range.isSubset(backdoor->range()) ||
+        (write && !backdoor->writeable()) ||
+        (!write && !backdoor->readable()))
+    {
+        backdoorMisses++;
+        return nullptr;
+    }
+
+    return backdoor->ptr() + (phys - backdoor->range().start());
+}
+
 void
 XferUnit::recvMemResponse(uint64_t id_off, PacketPtr pkt)
 {
@@ -257,15 +370,12 @@ XferUnit::continueTransfer(Buffer *buf)
         else
             writes.sample(tcu.curCycle() - buf->event->startCycle);
         buf->event->finish();
-        buf->event = NULL;
+        freeBuf(buf);
 
-        // start the next one, if there is any
-        if (!queue.empty())
-        {
-            TransferEvent *ev = queue.front();
-            queue.pop_front();
-            tcu.schedule(ev, tcu.clockEdge(Cycles(1)));
-        }
+        // start the next one, if there is any. otherwise, we might accept
+        // further requests from the NoC now
+        if (!startQueued())
+            tcu.retryNocRequests();
     }
     // continue if there was no error and there is something left to transfer
     else if(buf->event->result == TcuError::NONE && buf->event->remaining > 0)
@@ -311,37 +421,221 @@ XferUnit::startTransfer(TransferEvent *event, Cycles delay)
     else
         bytesWritten.sample(event->remaining);
 
+    if (tcu.atomicMode())
+    {
+        transferAtomic(event, delay);
+        return;
+    }
+
     tcu.schedule(event, tcu.clockEdge(Cycles(delay + 1)));
+}
+
+void
+XferUnit::transferAtomic(TransferEvent *event, Cycles delay)
+{
+    tcu.chargeAtomic(tcu.cyclesToTicks(Cycles(delay + 1)));
+
+    // transfers can be nested (e.g., a message to ourself), but never more
+    // than once, so that there is always a free buffer
+    Buffer *buf = allocateBuf(event);
+    panic_if(!buf, "No free buffer for atomic transfer\n");
+    event->buf = buf;
+
+    DPRINTFS(TcuXfers, (&tcu),
+        "buf%d: Performing atomic %s transfer of %lu bytes @ %p [flags=%s]\n",
+        buf->id,
+        event->isWrite() ? "mem-write" : "mem-read",
+        event->remaining,
+        event->phys.getAddr(),
+        decodeFlags(event->flags()));
+
+    event->transferStart();
+
+    assert(buf->offset + event->remaining <= bufSize);
+    Tick latency = accessAtomic(event->phys, buf->bytes + buf->offset,
+                                event->remaining, event->isWrite());
+    tcu.chargeAtomic(latency);
+
+    buf->offset += event->remaining;
+    event->phys = NocAddr(event->phys.getAddr() + event->remaining);
+    event->remaining = 0;
+
+    event->transferDone(event->result);
+
+    if (event->isRead())
+        reads.sample(tcu.ticksToCycles(latency));
+    else
+        writes.sample(tcu.ticksToCycles(latency));
+
+    freeBuf(buf);
+    // the event was never scheduled
+    delete event;
+}
 
-    // finish the noc request now to make the port unbusy
-    if (event->isRemote())
-        tcu.schedNocRequestFinished(tcu.clockEdge(Cycles(1)));
+Tick
+XferUnit::accessAtomic(NocAddr phys, uint8_t *data, size_t size, bool write)
+{
+    uint8_t *mem = tcu.memBackdoor ? backdoorPtr(phys.getAddr(), size, write)
+                                   : nullptr;
+    if (mem)
+    {
+        if (write)
+            memcpy(mem, data, size);
+        else
+            memcpy(data, mem, size);
+
+        backdoorXfers++;
+        return tcu.cyclesToTicks(tcu.memBackdoorLatency +
+            Cycles(divCeil(size, tcu.memBackdoorThroughput)));
+    }
+
+    Tick latency = 0;
+    Addr physAddr = phys.getAddr();
+    for (size_t off = 0; off < size; )
+    {
+        Addr physOff = physAddr & (blockSize - 1);
+        Addr reqSize = std::min(size - off, blockSize - physOff);
+
+        auto cmd = write ? MemCmd::WriteReq : MemCmd::ReadReq;
+        auto pkt = tcu.generateRequest(physAddr, reqSize, cmd);
+
+        if (write)
+            memcpy(pkt->getPtr<uint8_t>(), data + off, reqSize);
+
+        latency += tcu.sendAtomicMemRequest(pkt);
+
+        if (!write)
+            memcpy(data + off, pkt->getConstPtr<uint8_t>(), reqSize);
+
+        tcu.freeRequest(pkt);
+
+        off += reqSize;
+        physAddr += reqSize;
+    }
+
+    // reqCount requests are in flight at the same time
+    return divCeil(latency, tcu.reqCount);
+}
+
+bool
+XferUnit::isIdle() const
+{
+    for (auto &queue : queues)
+    {
+        if (!queue.empty())
+            return false;
+    }
+
+    for (size_t i = 0; i < bufCount; ++i)
+    {
+        if (bufs[i]->event)
+            return false;
+    }
+    return true;
+}
+
+size_t
+XferUnit::freeBuffers() const
+{
+    size_t free = 0;
+    for (size_t i = 0; i < bufCount; ++i)
+    {
+        if (!bufs[i]->event)
+            free++;
+    }
+    for (auto &queue : queues)
+        free -= std::min(free, queue.size());
+    return free;
 }
 
 XferUnit::AbortResult
 XferUnit::tryAbortCommand()
 {
+    // READ and WRITE can use multiple buffers at once
+    AbortResult res = AbortResult::NONE;
     for (size_t i = 0; i < bufCount; ++i)
     {
         auto ev = bufs[i]->event;
         if (ev && !ev->isRemote())
-            return ev->abort(TcuError::ABORT);
+        {
+            if (ev->abort(TcuError::ABORT) == AbortResult::WAITING)
+                res = AbortResult::WAITING;
+            else if (res == AbortResult::NONE)
+                res = AbortResult::ABORTED;
+        }
     }
-    return AbortResult::NONE;
+    return res;
+}
+
+bool
+XferUnit::canAllocate(BufClass cls) const
+{
+    // we can always use our own reserved buffers
+    if (used[cls] < reserved[cls])
+        return true;
+
+    // otherwise, leave enough buffers for the reservations of the others
+    size_t free = bufCount;
+    unsigned unclaimed = 0;
+    for (int c = 0; c < BUF_CLASSES; ++c)
+    {
+        free -= used[c];
+        if (used[c] < reserved[c])
+            unclaimed += reserved[c] - used[c];
+    }
+    return free > unclaimed;
 }
 
 XferUnit::Buffer*
-XferUnit::allocateBuf(TransferEvent *event, uint flags)
+XferUnit::allocateBuf(TransferEvent *event)
 {
+    BufClass cls = event->bufClass();
+    if (!canAllocate(cls))
+        return NULL;
+
     for (size_t i = 0; i < bufCount; ++i)
     {
         if (!bufs[i]->event)
         {
             bufs[i]->event = event;
             bufs[i]->offset = 0;
+            used[cls]++;
             return bufs[i];
         }
     }
 
     return NULL;
 }
+
+void
+XferUnit::freeBuf(Buffer *buf)
+{
+    BufClass cls = buf->event->bufClass();
+    assert(used[cls] > 0);
+    used[cls]--;
+    buf->event = NULL;
+}
+
+bool
+XferUnit::startQueued()
+{
+    // take the first waiting transfer of the class with the highest priority
+    // that is allowed to use a buffer
+    for (int c = 0; c < BUF_CLASSES; ++c)
+    {
+        auto &queue = queues[c];
+        if (queue.empty() || !canAllocate(static_cast<BufClass>(c)))
+            continue;
+
+        TransferEvent *ev = queue.front();
+        queue.pop_front();
+
+        // hand the buffer over directly, so that nobody else can take it
+        ev->buf = allocateBuf(ev);
+        assert(ev->buf);
+        ev->transferStart();
+        ev->start();
+        return true;
+    }
+    return false;
+}
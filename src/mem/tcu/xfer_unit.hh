@@ -34,6 +34,7 @@
 
 #include "mem/tcu/noc_addr.hh"
 #include "mem/tcu/error.hh"
+#include "mem/backdoor.hh"
 #include "mem/packet.hh"
 #include "sim/eventq.hh"
 #include "sim/stats.hh"
@@ -51,6 +52,21 @@ class XferUnit
     {
         MESSAGE   = 1,
         MSGRECV   = 2,
+        LLC       = 4,
+    };
+
+    // the buffer classes, ordered by priority
+    enum BufClass
+    {
+        // transfers for commands of the local core
+        BUF_LOCAL,
+        // memory requests from the LLC
+        BUF_LLC,
+        // message receives
+        BUF_MSGRECV,
+        // reads and writes from remote TCUs
+        BUF_REMOTE,
+        BUF_CLASSES,
     };
 
     enum AbortType
@@ -187,15 +203,29 @@ class XferUnit
             return type == TransferType::REMOTE_READ ||
                    type == TransferType::REMOTE_WRITE;
         }
+        BufClass bufClass() const
+        {
+            if (xferFlags & MSGRECV)
+                return BUF_MSGRECV;
+            if (!isRemote())
+                return BUF_LOCAL;
+            return (xferFlags & LLC) ? BUF_LLC : BUF_REMOTE;
+        }
 
         void process() override;
 
+        bool tryBackdoor();
+
         void tryStart();
 
         AbortResult abort(TcuError error);
     };
 
-    XferUnit(Tcu &_tcu, size_t _blockSize, size_t _bufCount, size_t _bufSize);
+    XferUnit(Tcu &_tcu,
+             size_t _blockSize,
+             size_t _bufCount,
+             size_t _bufSize,
+             const std::vector<unsigned> &_reserved);
 
     ~XferUnit();
 
@@ -203,15 +233,39 @@ class XferUnit
 
     void startTransfer(TransferEvent *event, Cycles delay);
 
+    /**
+     * Reads or writes the given local memory area in atomic mode and returns
+     * the estimated latency.
+     */
+    Tick accessAtomic(NocAddr phys, uint8_t *data, size_t size, bool write);
+
     AbortResult tryAbortCommand();
 
+    bool isIdle() const;
+
+    /**
+     * Returns the number of buffers that are neither in use nor claimed by a
+     * delayed transfer.
+     */
+    size_t freeBuffers() const;
+
     void recvMemResponse(uint64_t evId, PacketPtr pkt);
 
   private:
 
+    void transferAtomic(TransferEvent *event, Cycles delay);
+
     void continueTransfer(Buffer *buf);
 
-    Buffer* allocateBuf(TransferEvent *event, uint flags);
+    bool canAllocate(BufClass cls) const;
+
+    Buffer* allocateBuf(TransferEvent *event);
+
+    void freeBuf(Buffer *buf);
+
+    bool startQueued();
+
+    uint8_t *backdoorPtr(Addr phys, size_t size, bool write);
 
   private:
 
@@ -223,14 +277,23 @@ class XferUnit
     size_t bufSize;
     Buffer **bufs;
 
-    std::list<TransferEvent*> queue;
+    // the number of buffers reserved for and used by each class
+    std::vector<unsigned> reserved;
+    unsigned used[BUF_CLASSES];
+
+    std::list<TransferEvent*> queues[BUF_CLASSES];
+
+    // direct access to the local memory (if supported and enabled)
+    MemBackdoorPtr backdoor;
 
     Stats::Histogram reads;
     Stats::Histogram writes;
     Stats::Histogram bytesRead;
     Stats::Histogram bytesWritten;
-    Stats::Scalar delays;
+    Stats::Vector delays;
     Stats::Scalar aborts;
+    Stats::Scalar backdoorXfers;
+    Stats::Scalar backdoorMisses;
 };
 
 #endif
@@ -37,3 +37,4 @@ class MemSystem(System):
 
     mem_file = Param.String("", "The file to load into memory")
     mem_file_num = Param.Unsigned(1, "The number of times to load the file into memory")
+    mem_file_mmap = Param.Bool(False, "Map the file copy-on-write into memory instead of copying it")
@@ -29,6 +29,9 @@
  */
 
 #include "sim/mem_system.hh"
+
+#include <algorithm>
+
 #include "mem/port_proxy.hh"
 #include "mem/tcu/tlb.hh"
 #include "params/MemSystem.hh"
@@ -37,7 +40,8 @@ MemSystem::MemSystem(const Params &p)
     : System(p),
       tileId(p.tile_id),
       memFile(p.mem_file),
-      memFileNum(p.mem_file_num)
+      memFileNum(p.mem_file_num),
+      memFileMmap(p.mem_file_mmap)
 {
 }
 
@@ -58,11 +62,30 @@ MemSystem::initState()
 
         fseek(f, 0L, SEEK_END);
         size_t sz = ftell(f);
-        fseek(f, 0L, SEEK_SET);
+
+        // map as much of each copy as possible; the copies share the pages
+        // until they are written
+        std::vector<Addr> mapped(memFileNum, 0);
+        if (memFileMmap)
+        {
+            for (size_t i = 0; i < memFileNum; ++i)
+            {
+                mapped[i] = getPhysMem().mapFile(i * sz, fileno(f), sz);
+                if (mapped[i] == 0)
+                {
+                    warn("%s: cannot map copy %lu of '%s'; copying it\n",
+                         name(), i, memFile.c_str());
+                }
+            }
+        }
+
+        // the mapped part is page aligned, so that we can skip it
+        size_t start = *std::min_element(mapped.begin(), mapped.end());
+        fseek(f, start, SEEK_SET);
 
         const size_t BUF_SIZE = 1024 * 1024;
         auto data = new uint8_t[BUF_SIZE];
-        size_t rem = sz, off = 0;
+        size_t rem = sz - start, off = start;
         while (rem > 0)
         {
             size_t amount = std::min(rem, BUF_SIZE);
@@ -71,7 +94,13 @@ MemSystem::initState()
                 panic("Unable to read '%s': %lu (expected %lu)", memFile.c_str(), res, amount);
 
             for(size_t i = 0; i < memFileNum; ++i)
-                physProxy.writeBlob(i * sz + off, data, amount);
+            {
+                if (off + amount <= mapped[i])
+                    continue;
+                size_t skip = mapped[i] > off ? mapped[i] - off : 0;
+                physProxy.writeBlob(i * sz + off + skip, data + skip,
+                                    amount - skip);
+            }
 
             off += amount;
             rem -= amount;
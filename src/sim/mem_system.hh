@@ -44,6 +44,7 @@ class MemSystem : public System
     tileid_t tileId;
     std::string memFile;
     size_t memFileNum;
+    bool memFileMmap;
 
   public:
     typedef MemSystemParams Params;